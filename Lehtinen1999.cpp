@@ -3,6 +3,10 @@
 #include <cmath>
 #include <fstream>
 #include <map>
+#include <functional>
+#include <thread>
+#include <memory>
+#include <algorithm>
 
 #include "vector.hpp"
 
@@ -10,6 +14,11 @@
 #include "constants.hpp"
 #include "rand.hpp"
 #include "time_tree.hpp"
+#include "time_heap.hpp"
+#include "calendar_queue.hpp"
+#include "object_pool.hpp"
+#include "work_stealing_pool.hpp"
+#include "ID_allocator.hpp"
 #include "arrays_IO.hpp"
 
 #include "read_tables/diffusion_table.hpp"
@@ -18,14 +27,23 @@
 #include "physics/quasi_static_fields.hpp"
 #include "physics/relativistic_formulas.hpp"
 #include "physics/particles.hpp"
+#include "physics/electron_store.hpp"
 #include "physics/bethe_eq.hpp"
 #include "physics/apply_force.hpp"
+#include "physics/CSDA_table.hpp"
+#include "physics/low_energy_fluid.hpp"
 #include "physics/moller_scattering.hpp"
 #include "physics/interaction_chooser.hpp"
+#include "physics/population_control.hpp"
 
 using namespace gsl;
 using namespace std;
 
+//keeps the electrons sorted by time: time_tree, time_heap, or calendar_queue. Set in CMakeLists.txt
+#ifndef ELECTRON_SCHEDULER
+#define ELECTRON_SCHEDULER time_tree
+#endif
+
 
 class analyzer
 {
@@ -33,9 +51,8 @@ public:
     int N_bins;
     double max_t;
 
-    gsl::vector_long n_particles;
+    gsl::vector n_particles; //weighted number of particles in each bin
     gsl::vector bin_edges;
-    map<size_t, double> particle_start_times;
 
 
     analyzer(double _max_t, int _N_bins)
@@ -45,26 +62,51 @@ public:
 
         bin_edges=linspace(0, max_t, N_bins);
 
-        n_particles=gsl::vector_long(size_t(N_bins));
+        n_particles=gsl::vector(size_t(N_bins));
         LOOP(n_particles, X, n_particles, X*0); //fill n_particles with zero.
     }
 
     void reset()
     {
-        particle_start_times.clear();
         LOOP(n_particles, X, n_particles, X*0); //fill n_particles with zero
     }
 
+    //the start time of each electron is kept in the electron (tally_start_time), so that electrons can move between threads with their own analyzers
     void add_electron(electron_T* new_electron)
     {
-        particle_start_times[new_electron->ID]=new_electron->current_time;
+        new_electron->tally_start_time=new_electron->current_time;
     }
 
     void remove_electron(electron_T* new_electron)
     {
-        double end_time=new_electron->current_time;
-        double start_time=particle_start_times[new_electron->ID];
+        tally(new_electron->tally_start_time, new_electron->current_time, new_electron->weight);
+    }
+
+    void remove_electron(electron_T* new_electron, double end_time)
+    //remove an electron that would live untill end_time, which is after its current time (see sim_cls::cull_electron)
+    {
+        tally(new_electron->tally_start_time, end_time, new_electron->weight);
+    }
+
+    void reweight_electron(electron_T* electron, double old_weight)
+    //call when the weight of an electron changes. The electron counts with old_weight untill now, and with its new weight after
+    {
+        tally(electron->tally_start_time, electron->current_time, old_weight);
+        electron->tally_start_time=electron->current_time;
+    }
+
+    void add(analyzer& other)
+    //add the counts of another analyzer, with the same bins, into this one
+    {
+        for(int i=0; i<N_bins; i++)
+        {
+            n_particles[i]+=other.n_particles[i];
+        }
+    }
 
+    void tally(double start_time, double end_time, double weight)
+    //add weight to each bin between start_time and end_time
+    {
         if(start_time>=max_t)
         {
             return;
@@ -96,7 +138,7 @@ public:
 
         for(int i=start_time_index; i<end_time_index; i++)
         {
-            n_particles[i]++;
+            n_particles[i]+=weight;
         }
     }
 
@@ -110,36 +152,131 @@ public:
 };
 
 class timestep_halving_histogramer //turn this into some kind of utility that can re-used
+//number of steps, their timestep, and how many times they were halved, in bins of log energy. The bins are made once, so add_step does not allocate
 {
 public:
-    std::list<double> energy;
-    std::list<double> initial_timestep;
-    std::list<double> N_halves;
+    double lowest_energy; //in keV
+    double highest_energy;
+    int N_bins;
+    double log_lowest;
+    double bins_per_log;
+
+    std::vector<double> num_steps; //in each bin
+    std::vector<double> num_halved; //steps that were halved at least once
+    std::vector<double> timestep_sum;
+    std::vector<double> timestep_sq_sum;
+    std::vector<double> halves_sum;
+    std::vector<double> halves_sq_sum;
+
+    //all steps, including the ones outside the bins
+    double total_steps;
+    double total_halved;
+    double total_halves;
+
+    timestep_halving_histogramer(double lowest_energy_kev=3.5, double highest_energy_kev=4000, int N_bins_=100)
+    {
+        lowest_energy=lowest_energy_kev;
+        highest_energy=highest_energy_kev;
+        N_bins=N_bins_;
+        log_lowest=std::log(lowest_energy);
+        bins_per_log=N_bins/(std::log(highest_energy)-log_lowest);
+
+        num_steps.resize(N_bins);
+        num_halved.resize(N_bins);
+        timestep_sum.resize(N_bins);
+        timestep_sq_sum.resize(N_bins);
+        halves_sum.resize(N_bins);
+        halves_sq_sum.resize(N_bins);
+        reset();
+    }
 
-    void add_energy(double energy_)
+    void add_step(double energy, double timestep, int N_halves)
+    //energy at the end of the step, and its timestep before it was halved
     {
-        energy.push_back(energy_);
+        total_steps+=1;
+        total_halves+=N_halves;
+        if(N_halves>0) total_halved+=1;
+
+        double energy_kev=energy*energy_units_kev;
+        if(not (energy_kev>=lowest_energy and energy_kev<highest_energy)) return;
+        int bin=std::min(int((std::log(energy_kev)-log_lowest)*bins_per_log), N_bins-1);
+
+        num_steps[bin]+=1;
+        if(N_halves>0) num_halved[bin]+=1;
+        timestep_sum[bin]+=timestep;
+        timestep_sq_sum[bin]+=timestep*timestep;
+        halves_sum[bin]+=N_halves;
+        halves_sq_sum[bin]+=N_halves*N_halves;
     }
 
-    void add_TS(double i_TS_)
+    void reset()
     {
-        initial_timestep.push_back(i_TS_);
+        std::fill(num_steps.begin(), num_steps.end(), 0.0);
+        std::fill(num_halved.begin(), num_halved.end(), 0.0);
+        std::fill(timestep_sum.begin(), timestep_sum.end(), 0.0);
+        std::fill(timestep_sq_sum.begin(), timestep_sq_sum.end(), 0.0);
+        std::fill(halves_sum.begin(), halves_sum.end(), 0.0);
+        std::fill(halves_sq_sum.begin(), halves_sq_sum.end(), 0.0);
+        total_steps=0;
+        total_halved=0;
+        total_halves=0;
     }
 
-    void add_halves(double N_halves_)
+    void add(timestep_halving_histogramer& other)
+    //add the data of other into this one, and reset other. Both need the same bins
     {
-        N_halves.push_back(N_halves_);
+        for(int i=0; i<N_bins; i++)
+        {
+            num_steps[i]+=other.num_steps[i];
+            num_halved[i]+=other.num_halved[i];
+            timestep_sum[i]+=other.timestep_sum[i];
+            timestep_sq_sum[i]+=other.timestep_sq_sum[i];
+            halves_sum[i]+=other.halves_sum[i];
+            halves_sq_sum[i]+=other.halves_sq_sum[i];
+        }
+        total_steps+=other.total_steps;
+        total_halved+=other.total_halved;
+        total_halves+=other.total_halves;
+        other.reset();
     }
 
     void save_data()
+    //bin edges (keV), then for each bin the number of steps, the mean and standard deviation of the timestep, and of the number of halvings
     {
+        std::vector<double> bin_edges(N_bins+1);
+        std::vector<double> timestep_mean(N_bins);
+        std::vector<double> timestep_std(N_bins);
+        std::vector<double> halves_mean(N_bins);
+        std::vector<double> halves_std(N_bins);
+        for(int i=0; i<=N_bins; i++)
+        {
+            bin_edges[i]=std::exp(log_lowest + i/bins_per_log);
+        }
+        for(int i=0; i<N_bins; i++)
+        {
+            if(num_steps[i]==0) continue;
+            timestep_mean[i]=timestep_sum[i]/num_steps[i];
+            timestep_std[i]=std::sqrt(std::max(timestep_sq_sum[i]/num_steps[i] - timestep_mean[i]*timestep_mean[i], 0.0));
+            halves_mean[i]=halves_sum[i]/num_steps[i];
+            halves_std[i]=std::sqrt(std::max(halves_sq_sum[i]/num_steps[i] - halves_mean[i]*halves_mean[i], 0.0));
+        }
+
         arrays_output out;
-        out.add_doubles( make_vector(energy) );
-        out.add_doubles( make_vector(initial_timestep) );
-        out.add_doubles( make_vector(N_halves) );
+        out.add_doubles( make_vector(bin_edges) );
+        out.add_doubles( make_vector(num_steps) );
+        out.add_doubles( make_vector(timestep_mean) );
+        out.add_doubles( make_vector(timestep_std) );
+        out.add_doubles( make_vector(halves_mean) );
+        out.add_doubles( make_vector(halves_std) );
         out.to_file("./timestep_halving_hist");
     }
 
+    void print_summary()
+    //number of steps, and how many of them had to be halved
+    {
+        print("timestep halving:", total_steps, "steps,", total_halved, "were halved,", total_halves, "halvings in total");
+    }
+
 };
 
 
@@ -148,16 +285,198 @@ public:
 
 
 
+class population_history
+//number of electrons, and their total weight, at the slab boundaries of sim_cls::run_slabs
+{
+public:
+    std::list<double> time;
+    std::list<double> num_electrons;
+    std::list<double> total_weight;
+
+    void add(double time_, double num_electrons_, double total_weight_)
+    {
+        time.push_back(time_);
+        num_electrons.push_back(num_electrons_);
+        total_weight.push_back(total_weight_);
+    }
+
+    void reset()
+    {
+        time.clear();
+        num_electrons.clear();
+        total_weight.clear();
+    }
+
+    void save_data(std::string fname)
+    {
+        arrays_output out;
+        out.add_doubles( make_vector(time) );
+        out.add_doubles( make_vector(num_electrons) );
+        out.add_doubles( make_vector(total_weight) );
+        out.to_file(fname);
+    }
+};
+
+class engine_state
+//the parts of sim_cls that each thread needs its own of, to step electrons. sim_cls::main_state points to the members of sim_cls
+{
+public:
+    interaction_chooser_quadratic<1>* interaction_engine;
+    particle_history_out* save_data;
+    particle_history_out* new_electron_data; //where new electrons are recorded. save_data on the main thread
+    analyzer* histogramer;
+    timestep_halving_histogramer* timestep_hist;
+    fluid_deposits* low_energy_deposits;
+
+    //on the threads of sim_cls::run_parallel, new electrons get provisional IDs, which are replaced when the slab ends
+    bool provisional_IDs;
+    size_t worker_index;
+    size_t num_workers;
+    size_t num_provisional; //provisional IDs handed out in this slab
+
+    size_t new_ID()
+    //ID for a new electron. Provisional IDs are negative as the int32 in the output, see provisional_index
+    {
+        if(not provisional_IDs)
+        {
+            return particle_ID_T::new_ID();
+        }
+        size_t index=num_provisional*num_workers + worker_index;
+        num_provisional++;
+        return size_t(-1)-index;
+    }
+
+    static size_t provisional_index(int32_t ID)
+    //index of a provisional ID, as written in the output. num_provisional*num_workers + worker_index of the thread that made it
+    {
+        return size_t(-1-int64_t(ID));
+    }
+};
+
+class parallel_electron
+//an electron advanced by sim_cls::run_parallel. Electrons made during a slab have provisional IDs untill it ends, see sim_cls::number_born
+{
+public:
+    electron_T electron;
+    parallel_electron* parent; //nullptr for the electrons that started the slab
+    size_t number; //number of electrons the parent made before this one, in this slab
+    size_t generation; //0 for the electrons that started the slab
+    uint64_t key; //seeds the random numbers. The ID for the electrons that started the slab, else made from the key of the parent and number
+    bool kept; //reached the end of the slab
+
+    parallel_electron(const electron_T& electron_, parallel_electron* parent_, size_t number_) : electron(electron_)
+    {
+        parent=parent_;
+        number=number_;
+        kept=false;
+        if(parent)
+        {
+            generation=parent->generation+1;
+            key=mix_key(parent->key, number);
+        }
+        else
+        {
+            generation=0;
+            key=electron.ID;
+        }
+    }
+
+    static uint64_t mix_key(uint64_t key, uint64_t number)
+    //splitmix64 of key and number. Different numbers give unrelated keys, that do not depend on the threads
+    {
+        uint64_t Z=key + (number+1)*0x9E3779B97F4A7C15ULL;
+        Z=(Z^(Z>>30))*0xBF58476D1CE4E5B9ULL;
+        Z=(Z^(Z>>27))*0x94D049BB133111EBULL;
+        return Z^(Z>>31);
+    }
+};
+
+class transport_worker
+//per-thread state for sim_cls::run_parallel
+{
+public:
+    rand_gen rand; //used for all random numbers on this thread, see rand_threadsafe::set_thread_rand
+    interaction_chooser_quadratic<1> interaction_engine;
+    analyzer histogramer;
+    timestep_halving_histogramer timestep_hist;
+    fluid_deposits low_energy_deposits;
+    particle_history_out save_data; //buffer for the output of sim_cls, written when the slab ends
+    particle_history_out new_electron_data; //buffer for the new electrons, written before save_data, so electrons are added before their other records
+    electron_T working_secondary;
+    object_pool<parallel_electron> electrons; //electrons made on this thread in this slab
+    std::vector<parallel_electron*> born; //by provisional index/num_workers. nullptr for provisional IDs that were not used
+
+    engine_state state;
+
+    transport_worker(moller_table& moller_engine, particle_history_out* output, double max_t, int N_bins) :
+        interaction_engine(moller_engine),
+        histogramer(max_t, N_bins),
+        save_data(output),
+        new_electron_data(output)
+    {
+        state.interaction_engine=&interaction_engine;
+        state.save_data=&save_data;
+        state.new_electron_data=&new_electron_data;
+        state.histogramer=&histogramer;
+        state.timestep_hist=&timestep_hist;
+        state.low_energy_deposits=&low_energy_deposits;
+        state.provisional_IDs=true;
+        state.worker_index=0;
+        state.num_workers=1;
+        state.num_provisional=0;
+    }
+
+    void start_slab(size_t worker_index, size_t num_workers)
+    //called on the main thread before each slab
+    {
+        state.worker_index=worker_index;
+        state.num_workers=num_workers;
+        state.num_provisional=0;
+        electrons.release_all();
+        born.clear();
+        working_secondary.set_defaults();
+        working_secondary.ID=state.new_ID();
+    }
+
+    parallel_electron* new_electron(const electron_T& electron, parallel_electron* parent, size_t number)
+    //keep a new electron, that has a provisional ID from state
+    {
+        parallel_electron* P=electrons.create(electron, parent, number);
+        size_t slot=engine_state::provisional_index(int32_t(electron.ID))/state.num_workers;
+        if(born.size()<=slot)
+        {
+            born.resize(slot+1, nullptr);
+        }
+        born[slot]=P;
+        return P;
+    }
+};
+
 class sim_cls
 {
 public:
     ////constants////  (What will happen to results if we vary these?)
     const double RK_rel_err_tol=0.001; //0.00001  I have no idea what to set this att
+    bool predict_timesteps=false; //start new and scattered electrons from CSDA_table::initial_timestep, instead of the default or the parent's timestep. Can be changed
+                                  //between runs. Off until algorithm_tests/initial_timestep_benchmark shows fewer halvings and rejections with the real tables
+    const bool cull_below_runaway=false; //remove electrons that cannot run away, and count their remaining life analytically. Undercounts electrons, see cull_electron
+    const double culling_margin=2.0; //only cull electrons where friction is this many times the electric force
+    const double guiding_centre_gyrations=20; //follow the guiding centre when a step can span this many gyrations. 0 is always full orbits
     const double initial_energy=1000.0/energy_units_kev; //lehtininin is 1 Gev. How does this affect results?
     double max_t;
 
     const double particle_removal_energy=2.0/energy_units_kev; //how would altering this affect results?
 
+    ////low energy fluid//// electrons below fluid_handoff_energy are moved into fluid, see low_energy_fluid.hpp. Rough values for air at sea level
+    const bool use_low_energy_fluid=true;
+    const double fluid_handoff_energy=particle_removal_energy; //needs to be at least particle_removal_energy
+    const double low_energy_cutoff= use_low_energy_fluid ? std::max(fluid_handoff_energy, particle_removal_energy) : particle_removal_energy; //electrons below this are removed
+    const double fluid_mobility=0.06*E_field_units/C; //0.06 m^2/(V s)
+    const double fluid_diffusion=0.1*time_units/(distance_units*distance_units); //0.1 m^2/s
+    const double fluid_attachment_rate=1.0E8*time_units; //1E8 per second
+    const double ionization_energy=0.034/energy_units_kev; //34 eV per ion pair
+    const double fluid_output_interval=0.001;
+
     ////fields///
 	uniform_field E_field;
 	uniform_field B_field;
@@ -166,12 +485,44 @@ public:
     moller_table moller_engine; //moller scattering
     diffusion_table coulomb_scattering_engine;  //elastic scattering off air mollecules
     interaction_chooser_quadratic<1> interaction_engine; //interaction chooser (only one potential interaction at the moment
-    apply_charged_force force_engine; //apply classical forces
+    apply_charged_force_fields<uniform_field, uniform_field> force_engine; //apply classical forces
+    CSDA_table CSDA; //first timestep of new and scattered electrons, and culling of electrons that cannot run away
+    electron_ionization_table full_ionization; //stopping power without the moller losses removed
+    CSDA_table lifetime_CSDA; //remaining life of culled electrons, from full_ionization
+    density_profile* atmosphere; //air density. nullptr is sea level everywhere, see set_atmosphere
+    low_energy_fluid fluid; //electrons below low_energy_cutoff, evolved by evolve_fluid after the run
+    fluid_deposits low_energy_deposits; //electrons handed off to fluid during the run
 
     ////particles////
-	time_tree<electron_T> electrons;
+	object_pool<electron_T> electron_pool; //all electron_T in electrons are made here. Needs to be declared before electrons
+	ELECTRON_SCHEDULER<electron_T> electrons;
+	electron_store electron_store_; //used by run_slabs and run_parallel instead of electrons
+	electron_T working_electron;
+	electron_T working_secondary;
 	particle_history_out save_data;
 	analyzer histogramer;
+	weight_window population_control; //does nothing untill the window is set
+
+	population_comb comber; //limits number of electrons, see set_combing
+	double comb_interval; //combing is off if this is 0
+	double next_comb_time;
+	std::vector<double> comb_weights;
+	std::vector<size_t> comb_teeth;
+	std::vector<electron_T*> comb_electrons;
+	std::vector<size_t> comb_handles;
+
+	population_history slab_history; //filled by run_slabs
+	std::vector<size_t> slab_electrons; //handles of electrons in electron_store_, used by run_slabs
+	std::vector<size_t> next_slab_electrons;
+
+	engine_state main_state; //points to interaction_engine, save_data, histogramer, timestep_hist, and low_energy_deposits
+	std::vector< std::unique_ptr<transport_worker> > transport_workers; //one per thread, used by run_parallel
+	work_stealing_pool<parallel_electron*> task_pool; //each task advances an electron to the end of the slab
+	std::vector<parallel_electron> slab_start_electrons; //the electrons at the start of a slab of run_parallel
+	std::vector<parallel_electron*> parallel_tasks;
+	std::vector<parallel_electron*> born_electrons;
+	std::vector<parallel_electron*> kept_electrons;
+	rand_gen parallel_seeds; //a seed for each slab of run_parallel
 
 	timestep_halving_histogramer timestep_hist;
 
@@ -182,7 +533,10 @@ public:
     moller_engine(particle_removal_energy, 200000/energy_units_kev, 500, false),
 	histogramer(_max_t, 1000),
     interaction_engine(moller_engine),
-    force_engine(particle_removal_energy, E_field.pntr(), B_field.pntr() )
+    force_engine(particle_removal_energy, &E_field, &B_field ),
+    CSDA(force_engine.ionization, particle_removal_energy, 200000/energy_units_kev),
+    lifetime_CSDA(full_ionization, particle_removal_energy, 200000/energy_units_kev),
+    fluid(vec3(-5.0, -5.0, -5.0)/distance_units, 0.5/distance_units, 20, 20, 60) //10 m by 10 m by 30 m, with 0.5 m cells
 
     {
         max_t=_max_t;
@@ -200,6 +554,25 @@ public:
         ////force engine setup////
         force_engine.set_max_timestep( coulomb_scattering_engine.max_timestep() );
         force_engine.set_errorTol(RK_rel_err_tol);
+        force_engine.set_guiding_centre(guiding_centre_gyrations);
+        CSDA.set_timestep_prediction(E_delta*21.7, B_tsi*21.7, RK_rel_err_tol, coulomb_scattering_engine.max_timestep());
+        fluid.set_transport(&E_field, fluid_mobility, fluid_diffusion, fluid_attachment_rate, ionization_energy);
+
+        ////memory////
+        electrons.set_pool(&electron_pool);
+        moller_engine.set_pool(&electron_pool);
+
+        comb_interval=0;
+        next_comb_time=0;
+        atmosphere=nullptr;
+
+        main_state.interaction_engine=&interaction_engine;
+        main_state.save_data=&save_data;
+        main_state.new_electron_data=&save_data;
+        main_state.histogramer=&histogramer;
+        main_state.timestep_hist=&timestep_hist;
+        main_state.low_energy_deposits=&low_energy_deposits;
+        main_state.provisional_IDs=false;
 
         //AT some point I need to expliclitly set interaction_engine tollarances
 
@@ -211,12 +584,39 @@ public:
         max_t=_max_t;
         E_field.set_value(0, 0, -E_delta*21.7);
         B_field.set_value(B_tsi*21.7, 0, 0);
+        CSDA.set_timestep_prediction(E_delta*21.7, B_tsi*21.7, RK_rel_err_tol, coulomb_scattering_engine.max_timestep());
+        fluid.set_transport(&E_field, fluid_mobility, fluid_diffusion, fluid_attachment_rate, ionization_energy);
+        fluid.reset();
+        low_energy_deposits.clear();
         histogramer.reset();
+        slab_history.reset();
+        comber.reset();
+        force_engine.reset_step_counters();
+
+        //free all electrons from the last run at once, the memory is kept for the next run
+        electrons.clear();
+        electron_pool.release_all();
+    }
+
+    void set_atmosphere(density_profile* atmosphere_)
+    //air density that changes with altitude (Z). The stopping power, moller rate, and diffusion are all scaled by the density. Does not own atmosphere_
+    {
+        atmosphere=atmosphere_;
+        force_engine.set_atmosphere(atmosphere);
+    }
+
+    void set_combing(double comb_interval_, size_t target_number)
+    //every comb_interval_, if there are more than target_number electrons, resample them to target_number electrons with equal weight. Set comb_interval_ to 0 to turn off
+    {
+        comb_interval=comb_interval_;
+        next_comb_time=comb_interval;
+        comber.target_number=target_number;
     }
 
     void setup(int n_seeds)
     {
         electrons.clear();
+        next_comb_time=comb_interval;
         ////seed electrons////
         for(int i=0; i<n_seeds; i++)
         {
@@ -224,13 +624,363 @@ public:
             new_electron->set_position(0,0,0);
             new_electron->set_momentum(0,0, KE_to_mom( initial_energy ) );
             new_electron->update_energy();
+            if(predict_timesteps)
+            {
+                new_electron->next_timestep=CSDA.initial_timestep(new_electron->energy);
+            }
             save_data.new_electron(new_electron);
             histogramer.add_electron(new_electron);
         }
     }
 
+    bool cannot_run_away(electron_T* electron)
+    //true if friction, scaled by air density, is more than culling_margin times the local electric force at the energy of the electron and all lower energies
+    {
+        vec3 E;
+        E_field.evaluate(electron->position, electron->current_time, E);
+        double density_ratio=force_engine.density_ratio(electron->position);
+        return electron->energy < CSDA.runaway_threshold(culling_margin*E.norm()/density_ratio);
+    }
+
+    void cull_electron(electron_T* electron, engine_state& state)
+    //remove an electron that cannot run away. It is counted untill it would reach low_energy_cutoff, using the CSDA time without fields. Coulomb
+    //scattering changes the direction of these low energy electrons many times as they slow down, so the work done by the field averages out.
+    //The CSDA time is from the stopping power without moller losses removed (lifetime_CSDA), so it includes the mean energy lost to moller
+    //scattering. The moller secondaries it would have made are not made, so the number of electrons is biased low by the time those would
+    //have lived (see algorithm_tests/runaway_culling_benchmark.cpp, which measures this). This is why culling is off by default.
+    //If use_low_energy_fluid, it is handed off to the fluid at that time, where it is now (the CSDA range is small)
+    {
+        double density_ratio=force_engine.density_ratio(electron->position);
+        double remaining_time=(lifetime_CSDA.stopping_time(electron->energy) - lifetime_CSDA.stopping_time(low_energy_cutoff))/density_ratio;
+        state.save_data->remove_electron(particle_history_out::BELOW_RUNAWAY_THRESHOLD, electron);
+        state.histogramer->remove_electron(electron, electron->current_time+remaining_time);
+        if(use_low_energy_fluid)
+        {
+            state.low_energy_deposits->add(electron->current_time+remaining_time, electron->position, electron->weight, electron->energy);
+        }
+    }
+
+    void remove_low_energy(electron_T* electron, engine_state& state)
+    //remove an electron that is below low_energy_cutoff, and hand it off to the fluid if use_low_energy_fluid
+    {
+        state.save_data->remove_electron(particle_history_out::TOO_LOW_ENERGY, electron);
+        state.histogramer->remove_electron(electron);
+        if(use_low_energy_fluid)
+        {
+            state.low_energy_deposits->add(electron->current_time, electron->position, electron->weight, electron->energy);
+        }
+    }
+
+    void evolve_fluid()
+    //evolve the low energy fluid, with the electrons handed off during the run, to max_t
+    {
+        fluid.evolve(low_energy_deposits, max_t, fluid_output_interval);
+    }
+
+    bool step_electron(electron_T* current_electron, electron_T* secondary, bool& made_secondary)
+    //advance one electron by one timestep, and do the interactions. Returns false if the electron needs to be removed, which is already recorded in the output.
+    //secondary needs to be a default electron with an unused ID. If moller scattering makes a new electron it is placed in secondary, recorded in the output, and made_secondary is set to true.
+    {
+        return step_electron(current_electron, secondary, made_secondary, main_state);
+    }
+
+    bool step_electron(electron_T* current_electron, electron_T* secondary, bool& made_secondary, engine_state& state)
+    //same as above, using the interaction chooser, output, and tallies of state
+    {
+        made_secondary=false;
+        interaction_chooser_quadratic<1>& interaction_engine=*state.interaction_engine;
+        particle_history_out& save_data=*state.save_data;
+        analyzer& histogramer=*state.histogramer;
+        timestep_halving_histogramer& timestep_hist=*state.timestep_hist;
+
+        if(cull_below_runaway and cannot_run_away(current_electron))
+        {
+            cull_electron(current_electron, state);
+            return false;
+        }
+
+    /////solve equations of motion////
+        double old_energy=current_electron->energy;
+        vec3 old_position=current_electron->position;
+        vec3 old_momentum=current_electron->momentum;
+
+        bool guiding_centre=force_engine.charged_particle_step(current_electron); //if true, there is no interpolant, see reduce_timestep_to below
+        current_electron->update_energy();
+
+        //rates are proportional to air density, so sample interactions in timestep*density_ratio (see atmosphere.hpp)
+        double density_ratio=force_engine.density_ratio( (old_position+current_electron->position)*0.5 );
+
+        double pre_E=current_electron->energy;
+        double pre_TS=current_electron->timestep;
+
+
+
+        //remove particle if necisary
+        if(current_electron->energy < low_energy_cutoff)
+        {
+            remove_low_energy(current_electron, state);
+            return false;
+        }
+
+
+    //// scattering (moller only presently) ////
+        int interaction=-1;
+        double time_to_scatter=current_electron->timestep*2.0;
+        //print("Si:", current_electron->ID, old_energy*energy_units_kev, current_electron->energy*energy_units_kev);
+        int TS_halves=0;
+        while(true) //loop untill error is small enough
+        {
+            //sample interaction rates
+            time_to_scatter=interaction_engine.sample(old_energy,  mom_to_KE(interpolate_mom(current_electron, 0.5, guiding_centre, old_position, old_momentum)),    current_electron->energy,     current_electron->timestep*density_ratio, interaction)/density_ratio;
+
+            //check error code
+            auto error_code=interaction_engine.get_error_flag();
+            if(error_code==2) //this timestep was too large, try halving it
+            {
+                reduce_timestep_to(current_electron, current_electron->timestep*0.5, guiding_centre, old_position, old_momentum);
+                current_electron->next_timestep*=0.5;
+                TS_halves++;
+
+                //carry on as if nothing ever happened
+                continue;
+            }
+            else if(error_code==1) //need to reduce the timestep size
+            {
+                current_electron->next_timestep*=0.5;
+                break;
+            }
+            else
+            {
+                //no error
+                break;
+            }
+        }
+
+        timestep_hist.add_step(pre_E, pre_TS, TS_halves);
+
+
+
+        //do the scattering
+        double energy_before_scattering=current_electron->energy;
+        if( (time_to_scatter <= current_electron->timestep) and interaction != -1)
+        {
+            //set electron values to time of interaction
+            reduce_timestep_to(current_electron, time_to_scatter, guiding_centre, old_position, old_momentum); //the scatter acts on the full orbit
+
+            if(interaction==0) //moller scattering
+            {
+                //print("interact");
+
+                //do interaction
+                made_secondary=moller_engine.single_interaction(current_electron->energy, current_electron, secondary);
+
+                if(predict_timesteps)
+                {
+                    current_electron->next_timestep=CSDA.initial_timestep(current_electron->energy);
+                }
+
+                if(made_secondary)
+                {
+                    if(predict_timesteps)
+                    {
+                        secondary->next_timestep=CSDA.initial_timestep(secondary->energy);
+                    }
+                    state.new_electron_data->new_electron(secondary);
+                    histogramer.add_electron(secondary);
+                }
+            }
+
+        }
+
+        //remove particle if necessary
+        if(current_electron->energy < low_energy_cutoff)
+        {
+            remove_low_energy(current_electron, state);
+            return false;
+        }
+
+//// shielded coulomb scattering ////
+        coulomb_scattering_engine.scatter(energy_before_scattering, current_electron, density_ratio); //note that this only works if energy is relativly constant. Consider re-working this.
+
+
+        save_data.update_electron(current_electron);
+        return true;
+    }
+
+    vec3 interpolate_mom(electron_T* electron, double T_bar, bool guiding_centre, const vec3& old_position, const vec3& old_momentum)
+    //momentum part way through the last step. A guiding centre step is re-done from its start, old_position and old_momentum
+    {
+        if(not guiding_centre)
+        {
+            return electron->interpolate_mom(T_bar);
+        }
+        vec3 position;
+        vec3 momentum;
+        force_engine.guiding_centre_interpolate(electron, old_position, old_momentum, T_bar, position, momentum);
+        return momentum;
+    }
+
+    void reduce_timestep_to(electron_T* electron, double new_timestep, bool guiding_centre, const vec3& old_position, const vec3& old_momentum)
+    {
+        if(guiding_centre)
+        {
+            force_engine.guiding_centre_reduce_timestep_to(electron, old_position, old_momentum, new_timestep);
+        }
+        else
+        {
+            electron->reduce_timestep_to(new_timestep);
+        }
+    }
+
+    size_t control_population(electron_T* electron)
+    //apply population_control to an electron that is kept after step_electron. Returns the number of electrons it should become (see weight_window::apply).
+    //removal and weight change are recorded in the output. Use split_electron to make the extra electrons
+    {
+        return control_population(electron, main_state);
+    }
+
+    size_t control_population(electron_T* electron, engine_state& state)
+    {
+        double old_weight=electron->weight;
+        size_t N=population_control.apply(electron);
+        if(N==0)
+        {
+            state.save_data->remove_electron(particle_history_out::LOST_ROULETTE, electron);
+            state.histogramer->remove_electron(electron);
+        }
+        else if(electron->weight!=old_weight)
+        {
+            state.histogramer->reweight_electron(electron, old_weight);
+            state.save_data->change_weight(electron);
+        }
+        return N;
+    }
+
+    void split_electron(electron_T* electron, electron_T* copy)
+    //make copy an identical electron with a new ID, and record it in the output
+    {
+        split_electron(electron, copy, main_state);
+    }
+
+    void split_electron(electron_T* electron, electron_T* copy, engine_state& state)
+    {
+        *copy=*electron;
+        copy->ID=state.new_ID();
+        state.new_electron_data->new_electron(copy);
+        state.histogramer->add_electron(copy);
+    }
+
+    void record_comb(electron_T* electron, size_t num_teeth, double new_weight)
+    //set the weight of an electron after combing, and record the change. Electrons with no teeth are recorded as removed, and need to be removed by the caller
+    {
+        if(num_teeth==0)
+        {
+            save_data.remove_electron(particle_history_out::COMBED_OUT, electron);
+            histogramer.remove_electron(electron);
+        }
+        else if(electron->weight!=new_weight)
+        {
+            double old_weight=electron->weight;
+            electron->weight=new_weight;
+            histogramer.reweight_electron(electron, old_weight);
+            save_data.change_weight(electron);
+        }
+    }
+
+    void comb_population()
+    //comb the electrons in the time tree, if there are too many
+    {
+        comb_electrons.clear();
+        comb_weights.clear();
+        auto electron=electrons.pop_first();
+        while(electron)
+        {
+            comb_electrons.push_back(electron);
+            comb_weights.push_back(electron->weight);
+            electron=electrons.pop_first();
+        }
+
+        if(comb_electrons.size()>comber.target_number)
+        {
+            double new_weight=comber.comb(comb_weights, comb_teeth, next_comb_time);
+            print("  combing", comb_electrons.size(), "electrons at", next_comb_time);
+
+            for(size_t i=0; i<comb_electrons.size(); i++)
+            {
+                electron=comb_electrons[i];
+                record_comb(electron, comb_teeth[i], new_weight);
+                if(comb_teeth[i]==0)
+                {
+                    electrons.release(electron);
+                    continue;
+                }
+
+                for(size_t copy_i=1; copy_i<comb_teeth[i]; copy_i++)
+                {
+                    electron_T* copy=electron_pool.create();
+                    split_electron(electron, copy);
+                    electrons.insert(copy->current_time, copy);
+                }
+                electrons.insert(electron->current_time, electron);
+            }
+        }
+        else
+        {
+            for(auto E : comb_electrons)
+            {
+                electrons.insert(E->current_time, E);
+            }
+        }
+
+        while(next_comb_time<=electrons.get_first_time())
+        {
+            next_comb_time+=comb_interval;
+        }
+    }
+
+    void comb_stored_electrons(std::vector<size_t>& handles)
+    //comb the electrons in electron_store_ that have these handles, if there are too many. handles is replaced by the handles of the electrons after combing
+    {
+        if(handles.size()<=comber.target_number)
+        {
+            return;
+        }
+
+        comb_weights.clear();
+        for(size_t handle : handles)
+        {
+            comb_weights.push_back(electron_store_.weight[handle]);
+        }
+        double new_weight=comber.comb(comb_weights, comb_teeth, next_comb_time);
+        print("  combing", handles.size(), "electrons at", next_comb_time);
+
+        comb_handles.swap(handles);
+        handles.clear();
+        for(size_t i=0; i<comb_handles.size(); i++)
+        {
+            size_t handle=comb_handles[i];
+            electron_store_.load(handle, &working_electron);
+            record_comb(&working_electron, comb_teeth[i], new_weight);
+            if(comb_teeth[i]==0)
+            {
+                electron_store_.remove(handle);
+                continue;
+            }
+
+            for(size_t copy_i=1; copy_i<comb_teeth[i]; copy_i++)
+            {
+                electron_T copy=working_electron;
+                split_electron(&working_electron, &copy);
+                handles.push_back( electron_store_.add(&copy) );
+            }
+            electron_store_.save_kinematics(handle, &working_electron);
+            handles.push_back(handle);
+        }
+    }
+
     void run()
     {
+        electron_T* spare_electron=electron_pool.create(); //the next new electron
 
         int i=0;
         while(true)
@@ -246,125 +996,388 @@ public:
             if(current_electron->current_time>max_t)
             {
                 print("no more time. Ending at", i);
+                electrons.insert(current_electron->current_time, current_electron); //so that it is counted below
                 break;
             } //if no more electrons, or out of time
 
+            if(comb_interval>0 and current_electron->current_time>=next_comb_time)
+            {
+                electrons.insert(current_electron->current_time, current_electron);
+                comb_population();
+                continue;
+            }
+
             if((i%5000)==0){ print("  ",i, current_electron->current_time); }
 
 
-        /////solve equations of motion////
-            double old_energy=current_electron->energy;
+            bool made_secondary;
+            bool keep=step_electron(current_electron, spare_electron, made_secondary);
 
-            force_engine.charged_particle_RungeKuttaDP(current_electron);
-            current_electron->update_energy();
+            if(made_secondary)
+            {
+                electrons.insert(spare_electron->current_time, spare_electron);
+                spare_electron=electron_pool.create();
+            }
 
-            double pre_E=current_electron->energy;
-            double pre_TS=current_electron->timestep;
+            size_t num_copies= keep ? control_population(current_electron) : 0;
+            for(size_t copy_i=1; copy_i<num_copies; copy_i++)
+            {
+                electron_T* copy=electron_pool.create();
+                split_electron(current_electron, copy);
+                electrons.insert(copy->current_time, copy);
+            }
 
+            if(num_copies>0)
+            {
+                electrons.insert(current_electron->current_time, current_electron);
+            }
+            else
+            {
+                electrons.release(current_electron);
+            }
+        }
+        electrons.release(spare_electron);
 
+        //add all remaining electrons
+        auto current_electron=electrons.pop_first();
+        while(current_electron)
+        {
+            histogramer.remove_electron(current_electron);
+            electrons.release(current_electron);
+            current_electron=electrons.pop_first();
+        }
 
-            //remove particle if necisary
-            if(current_electron->energy < particle_removal_energy)
+    }
+
+    bool advance_stored_electron(size_t handle, double end_time, std::vector<size_t>& new_handles)
+    //step an electron in electron_store_ untill its time reaches end_time. New electrons are added to electron_store_, and their handles to new_handles.
+    //Returns false if the electron was removed
+    {
+        electron_store_.load(handle, &working_electron);
+        while(working_electron.current_time<end_time)
+        {
+            bool made_secondary;
+            bool keep=step_electron(&working_electron, &working_secondary, made_secondary);
+
+            if(made_secondary)
             {
-                save_data.remove_electron(0, current_electron);
-                histogramer.remove_electron(current_electron);
-                delete current_electron;
-                continue;
+                new_handles.push_back( electron_store_.add(&working_secondary) );
+                working_secondary.set_defaults();
+                working_secondary.ID=particle_ID_T::new_ID();
             }
 
+            size_t num_copies= keep ? control_population(&working_electron) : 0;
+            for(size_t copy_i=1; copy_i<num_copies; copy_i++)
+            {
+                electron_T copy=working_electron;
+                split_electron(&working_electron, &copy);
+                new_handles.push_back( electron_store_.add(&copy) );
+            }
 
-        //// scattering (moller only presently) ////
-            int interaction=-1;
-            double time_to_scatter=current_electron->timestep*2.0;
-            //print("Si:", current_electron->ID, old_energy*energy_units_kev, current_electron->energy*energy_units_kev);
-            int TS_halves=0;
-            while(true) //loop untill error is small enough
+            if(num_copies==0)
             {
-                //sample interaction rates
-                time_to_scatter=interaction_engine.sample(old_energy,  mom_to_KE(current_electron->interpolate_mom(0.5)),    current_electron->energy,     current_electron->timestep, interaction);
+                electron_store_.remove(handle);
+                return false;
+            }
+        }
+        electron_store_.save(handle, &working_electron);
+        return true;
+    }
 
-                //check error code
-                auto error_code=interaction_engine.get_error_flag();
-                if(error_code==2) //this timestep was too large, try halving it
-                {
-                    current_electron->reduce_timestep_to( current_electron->timestep*0.5 );
-                    current_electron->next_timestep*=0.5;
-                    TS_halves++;
+    void run_slabs(double slab_duration)
+    //advance every electron to the end of a time slab, then go to the next slab. Electrons do not interact, so within a slab they can be advanced in any order.
+    //an electron stops at the first timestep that ends past the slab boundary, so they are synchronized only to within one timestep.
+    //the number and weight of electrons at each boundary are recorded in slab_history. Electrons are kept in electron_store_. Starts with the electrons placed in the time tree by setup
+    {
+        start_slabs();
 
-                    //carry on as if nothing ever happened
-                    continue;
-                }
-                else if(error_code==1) //need to reduce the timestep size
-                {
-                    current_electron->next_timestep*=0.5;
-                    break;
-                }
-                else
+        working_secondary.set_defaults();
+        working_secondary.ID=particle_ID_T::new_ID();
+
+        double slab_end=0;
+        while(slab_end<max_t and slab_electrons.size()>0)
+        {
+            slab_end=std::min(slab_end+slab_duration, max_t);
+
+            next_slab_electrons.clear();
+            for(size_t i=0; i<slab_electrons.size(); i++) //new electrons are added to the end of slab_electrons, so are advanced in this slab too
+            {
+                size_t handle=slab_electrons[i];
+                if( advance_stored_electron(handle, slab_end, slab_electrons) )
                 {
-                    //no error
-                    break;
+                    next_slab_electrons.push_back(handle);
                 }
             }
+            slab_electrons.swap(next_slab_electrons);
 
-            timestep_hist.add_energy(pre_E);
-            timestep_hist.add_TS(pre_TS);
-            timestep_hist.add_halves(TS_halves);
+            end_slab(slab_end);
+        }
 
+        finish_slabs(slab_end);
+    }
 
+    void start_slabs()
+    //move the electrons placed in the time tree by setup into electron_store_ and slab_electrons
+    {
+        electron_store_.clear();
+        slab_electrons.clear();
+        auto seed_electron=electrons.pop_first();
+        while(seed_electron)
+        {
+            slab_electrons.push_back( electron_store_.add(seed_electron) );
+            electrons.release(seed_electron);
+            seed_electron=electrons.pop_first();
+        }
+    }
+
+    void end_slab(double slab_end)
+    //record the electrons in slab_electrons at the end of a slab, and comb them if needed
+    {
+        double total_weight=0;
+        for(size_t handle : slab_electrons)
+        {
+            total_weight+=electron_store_.weight[handle];
+        }
+        slab_history.add(slab_end, slab_electrons.size(), total_weight);
+        print("  slab ending at", slab_end, ":", slab_electrons.size(), "electrons");
 
-            //do the scattering
-            double energy_before_scattering=current_electron->energy;
-            if( (time_to_scatter <= current_electron->timestep) and interaction != -1)
+        if(comb_interval>0 and slab_end>=next_comb_time)
+        {
+            comb_stored_electrons(slab_electrons);
+            while(next_comb_time<=slab_end)
             {
-                //set electron values to time of interaction
-                current_electron->reduce_timestep_to( time_to_scatter );
+                next_comb_time+=comb_interval;
+            }
+        }
+    }
 
-                if(interaction==0) //moller scattering
-                {
-                    //print("interact");
+    void finish_slabs(double slab_end)
+    //count the electrons that are left after the last slab, and empty electron_store_
+    {
+        if(slab_electrons.size()==0)
+        {
+            print("no electrons. Ending at", slab_end);
+        }
+        else
+        {
+            print("no more time. Ending at", slab_end);
+        }
 
-                    //do interaction
-                    auto new_electron=moller_engine.single_interaction(current_electron->energy, current_electron);
+        //add all remaining electrons
+        for(size_t handle : slab_electrons)
+        {
+            electron_store_.load_kinematics(handle, &working_electron);
+            histogramer.remove_electron(&working_electron);
+        }
+        electron_store_.clear();
+    }
 
-                    if(new_electron)
-                    {
-                        save_data.new_electron(new_electron);
-                        histogramer.add_electron(new_electron);
-                        electrons.insert(new_electron->current_time, new_electron);
-                    }
-                }
+    void advance_parallel(transport_worker& worker, work_stealing_pool<parallel_electron*>::worker& tasks, parallel_electron* P, double end_time, unsigned long int slab_seed)
+    //step an electron untill its time reaches end_time, on a thread of run_parallel. The random numbers come from the generator of the worker, seeded
+    //from slab_seed and the key of the electron, so they do not depend on the thread. New electrons and copies are pushed to the pool as soon as they
+    //are made, so that other threads can steal them
+    {
+        gsl_rng_set(worker.rand.rand_, parallel_electron::mix_key(P->key, slab_seed));
+        electron_T& electron=P->electron;
 
+        size_t num_born=0;
+        bool keep=true;
+        while(keep and electron.current_time<end_time)
+        {
+            bool made_secondary;
+            keep=step_electron(&electron, &worker.working_secondary, made_secondary, worker.state);
+
+            if(made_secondary)
+            {
+                tasks.push( worker.new_electron(worker.working_secondary, P, num_born) );
+                worker.working_secondary.set_defaults();
+                worker.working_secondary.ID=worker.state.new_ID();
+                num_born++;
             }
 
-            //remove particle if necessary
-            if(current_electron->energy < particle_removal_energy)
+            size_t num_copies= keep ? control_population(&electron, worker.state) : 0;
+            for(size_t copy_i=1; copy_i<num_copies; copy_i++)
             {
-                save_data.remove_electron(0, current_electron);
-                histogramer.remove_electron(current_electron);
-                delete current_electron;
-                continue;
+                electron_T copy=electron;
+                split_electron(&electron, &copy, worker.state);
+                tasks.push( worker.new_electron(copy, P, num_born) );
+                num_born++;
             }
+            keep= num_copies>0;
+        }
+        P->kept=keep;
+    }
 
-    //// shielded coulomb scattering ////
-            coulomb_scattering_engine.scatter(energy_before_scattering, current_electron); //note that this only works if energy is relativly constant. Consider re-working this.
+    void start_parallel_slab(size_t num_threads)
+    //move the electrons in slab_electrons into slab_start_electrons, and make a task for each
+    {
+        slab_start_electrons.clear();
+        slab_start_electrons.reserve(slab_electrons.size()); //so the pointers in parallel_tasks stay valid
+        for(size_t handle : slab_electrons)
+        {
+            electron_store_.load(handle, &working_electron);
+            slab_start_electrons.emplace_back(working_electron, nullptr, 0);
+        }
+        electron_store_.clear();
 
+        parallel_tasks.clear();
+        for(parallel_electron& P : slab_start_electrons)
+        {
+            parallel_tasks.push_back(&P);
+        }
 
-            save_data.update_electron(current_electron);
-            electrons.insert(current_electron->current_time, current_electron);
+        for(size_t i=0; i<num_threads; i++)
+        {
+            transport_workers[i]->start_slab(i, num_threads);
         }
+    }
 
-        //add all remaining electrons
-        auto current_electron=electrons.pop_first();
-        while(current_electron)
+    void number_born(size_t num_threads)
+    //give IDs to the electrons made in the last slab of run_parallel, on this thread. The electrons with parents that started the slab are numbered first,
+    //in order of the ID of the parent and then of number. Then their children in the same way, and so on. So the IDs do not depend on the threads
+    {
+        born_electrons.clear();
+        for(size_t i=0; i<num_threads; i++)
         {
-            histogramer.remove_electron(current_electron);
-            delete current_electron;
-            current_electron=electrons.pop_first();
+            for(parallel_electron* P : transport_workers[i]->born)
+            {
+                if(P) born_electrons.push_back(P);
+            }
         }
+        std::sort(born_electrons.begin(), born_electrons.end(), [](parallel_electron* A, parallel_electron* B){ return A->generation<B->generation; });
+
+        auto begin=born_electrons.begin();
+        while(begin!=born_electrons.end())
+        {
+            size_t generation=(*begin)->generation;
+            auto end=std::find_if(begin, born_electrons.end(), [generation](parallel_electron* P){ return P->generation!=generation; });
 
+            //the parents are numbered already
+            std::sort(begin, end, [](parallel_electron* A, parallel_electron* B)
+                {
+                    return A->parent->electron.ID<B->parent->electron.ID or (A->parent->electron.ID==B->parent->electron.ID and A->number<B->number);
+                } );
+            for(auto P=begin; P!=end; P++)
+            {
+                (*P)->electron.ID=particle_ID_T::new_ID();
+            }
+            begin=end;
+        }
+    }
+
+    void end_parallel_slab(size_t num_threads)
+    //number the new electrons, write the output of the workers with the real IDs, and put the electrons that are kept into electron_store_ and slab_electrons
+    {
+        number_born(num_threads);
+
+        auto real_ID=[this, num_threads](int32_t ID) -> int32_t
+            {
+                if(ID>=0) return ID;
+                size_t index=engine_state::provisional_index(ID);
+                return transport_workers[index%num_threads]->born[index/num_threads]->electron.ID;
+            };
+        for(size_t i=0; i<num_threads; i++) //new electrons first, so that every electron is added before its other records
+        {
+            transport_workers[i]->new_electron_data.renumber(real_ID);
+            transport_workers[i]->new_electron_data.write_buffer();
+        }
+        for(size_t i=0; i<num_threads; i++)
+        {
+            transport_workers[i]->save_data.renumber(real_ID);
+            transport_workers[i]->save_data.write_buffer();
+        }
+
+        //in order of ID, so that combing does not depend on the threads
+        kept_electrons.clear();
+        for(parallel_electron& P : slab_start_electrons)
+        {
+            if(P.kept) kept_electrons.push_back(&P);
+        }
+        for(parallel_electron* P : born_electrons)
+        {
+            if(P->kept) kept_electrons.push_back(P);
+        }
+        std::sort(kept_electrons.begin(), kept_electrons.end(), [](parallel_electron* A, parallel_electron* B){ return A->electron.ID<B->electron.ID; });
+
+        slab_electrons.clear();
+        for(parallel_electron* P : kept_electrons)
+        {
+            slab_electrons.push_back( electron_store_.add(&P->electron) );
+        }
+    }
+
+    void run_parallel(double slab_duration, size_t num_threads)
+    //same as run_slabs, but the electrons in each slab are advanced by num_threads threads, that steal electrons from each other when they run out (see work_stealing_pool).
+    //The threads are started once, and wait between slabs. New electrons are pushed to the pool as soon as they are made, so other threads can take them.
+    //each thread has its own random number generator, interaction chooser, tallies, and output buffer (see transport_worker). The tallies are added to histogramer and timestep_hist at the end.
+    //New electrons have provisional IDs during the slab. When it ends they get their IDs on this thread, from the ID of their parent and the order in
+    //which the parent made them (see number_born), and the output of the threads is written with the real IDs. Each electron has its own random numbers
+    //(see advance_parallel), so the electrons do not depend on which thread advanced them, or on the number of threads. Only the order of the records in
+    //the output, and the order in which the tallies are added, do
+    {
+        while(transport_workers.size()<num_threads)
+        {
+            transport_workers.emplace_back( new transport_worker(moller_engine, &save_data, histogramer.max_t, histogramer.N_bins) );
+        }
+
+        start_slabs();
+
+        task_pool.start(num_threads,
+            [this](size_t worker_index)
+            {
+                rand_threadsafe::set_thread_rand(transport_workers[worker_index]->rand.rand_);
+            } );
+
+        double slab_end=0;
+        try
+        {
+            while(slab_end<max_t and slab_electrons.size()>0)
+            {
+                slab_end=std::min(slab_end+slab_duration, max_t);
+                unsigned long int slab_seed=gsl_rng_get(parallel_seeds.rand_);
+
+                start_parallel_slab(num_threads);
+
+                ID_allocator::begin_workers(num_threads); //no worker registers, so a worker that asks for a real ID throws
+                try
+                {
+                    task_pool.run_tasks(parallel_tasks,
+                        [this, slab_end, slab_seed](work_stealing_pool<parallel_electron*>::worker& tasks, parallel_electron*& P)
+                        {
+                            advance_parallel(*transport_workers[tasks.get_index()], tasks, P, slab_end, slab_seed);
+                        } );
+                }
+                catch(...)
+                {
+                    ID_allocator::end_workers();
+                    throw;
+                }
+                ID_allocator::end_workers();
+
+                end_parallel_slab(num_threads);
+                end_slab(slab_end);
+            }
+        }
+        catch(...)
+        {
+            task_pool.stop();
+            throw;
+        }
+        task_pool.stop();
+
+        for(size_t i=0; i<num_threads; i++)
+        {
+            histogramer.add(transport_workers[i]->histogramer);
+            transport_workers[i]->histogramer.reset();
+            timestep_hist.add(transport_workers[i]->timestep_hist);
+            low_energy_deposits.add(transport_workers[i]->low_energy_deposits);
+        }
+
+        finish_slabs(slab_end);
     }
 };
 
+#ifndef LEHTINEN1999_NO_MAIN //defined by algorithm_tests/thread_scaling_benchmark.cpp, which uses sim_cls
 int main()
 {
     double max_t=0.3;
@@ -374,6 +1387,7 @@ int main()
     int N_runs=20;
 
     sim_cls simulation(max_t, E_field, B_field);
+    //simulation.set_combing(0.01, 10000); //for long runs, keeps the number of electrons bounded
     arrays_output out;
 
     for(int run_i=0; run_i<N_runs; run_i++)
@@ -382,6 +1396,9 @@ int main()
         simulation.reset(max_t, E_field, B_field);
         simulation.setup(n_seeds);
         simulation.run();
+        //simulation.run_parallel(0.01, std::thread::hardware_concurrency()); //same, on all cores
+        simulation.force_engine.print_step_stats(); //for tuning RK_rel_err_tol against run time
+        simulation.evolve_fluid();
 
         if(run_i==0)
         {
@@ -391,19 +1408,15 @@ int main()
     }
     out.to_file("./Lehtinen1999_out");
     simulation.timestep_hist.save_data();
+    simulation.timestep_hist.print_summary(); //with force_engine.print_step_stats, to compare with predict_timesteps on
+    if(simulation.comb_interval>0)
+    {
+        simulation.comber.save_data("./Lehtinen1999_comb"); //of the last run
+    }
+    if(simulation.use_low_energy_fluid)
+    {
+        simulation.fluid.save_data("./Lehtinen1999_fluid"); //of the last run
+    }
 
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+#endif
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/apply_force.hpp"
+
+#define LEHTINEN1999_NO_MAIN
+#include "../Lehtinen1999.cpp"
+
+using namespace std;
+
+//// counts heap allocations made by one Runge-Kutta step, and by one step of the main loop of Lehtinen1999 ////
+// malloc and calloc are wrapped by the linker (see CMakeLists.txt), operator new goes through malloc.
+// The old gsl::vector kinematics are re-implemented here, so that the two can be compared.
+// Then the electrons of a short Lehtinen1999 run are stepped as in sim_cls::run, and only the allocations inside sim_cls::step_electron (the
+// force, the interactions, the scattering, the tallies and the output) are counted. The run is done twice, and only the second is counted, so
+// that buffers that are made once (the output file, the memory pools) are already there. Needs the tables, so run from where Lehtinen1999 runs.
+
+size_t num_allocations=0;
+
+extern "C"
+{
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t num, size_t size);
+
+    void* __wrap_malloc(size_t size)
+    {
+        num_allocations++;
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t num, size_t size)
+    {
+        num_allocations++;
+        return __real_calloc(num, size);
+    }
+}
+
+//Dormand-Prince tableau
+const double DP_c[7]={0.0, 1.0/5.0, 3.0/10.0, 4.0/5.0, 8.0/9.0, 1.0, 1.0};
+const double DP_a[7][6]={ {0,0,0,0,0,0},
+                          {1.0/5.0, 0,0,0,0,0},
+                          {3.0/40.0, 9.0/40.0, 0,0,0,0},
+                          {44.0/45.0, -56.0/15.0, 32.0/9.0, 0,0,0},
+                          {19372.0/6561.0, -25360.0/2187.0, 64448.0/6561.0, -212.0/729.0, 0,0},
+                          {9017.0/3168.0, -355.0/33.0, 46732.0/5247.0, 49.0/176.0, -5103.0/18656.0, 0},
+                          {35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0} };
+const double DP_b4[7]={5179.0/57600.0, 0.0, 7571.0/16695.0, 393.0/640.0, -92097.0/339200.0, 187.0/2100.0, 1.0/40.0};
+
+class legacy_kinematics
+//the old kinematics, where every vector is a gsl::vector
+{
+public:
+    apply_charged_force* engine;
+    gsl::vector E_value;
+    gsl::vector B_value;
+
+    legacy_kinematics(apply_charged_force* engine_, double Ez, double By)
+    {
+        engine=engine_;
+        E_value=gsl::vector({0, 0, Ez});
+        B_value=gsl::vector({0, By, 0});
+    }
+
+    double legacy_gamma(gsl::vector& momentum)
+    {
+        return sqrt(1+momentum.sum_of_squares());
+    }
+
+    gsl::vector force(gsl::vector& position, gsl::vector& momentum, double time, int charge)
+    {
+        double momentum_squared=momentum.sum_of_squares();
+        double momentum_magnitude=sqrt(momentum_squared);
+        double inv_gamma=1.0/sqrt(1+momentum_squared);
+
+        gsl::vector force=E_value*charge;
+        gsl::vector B=B_value*(charge*inv_gamma);
+        force+=cross(momentum, B);
+
+        double friction=engine->ionization.lookup(momentum_squared);
+        if(friction>0)
+        {
+            force[0]-=friction*momentum[0]/momentum_magnitude;
+            force[1]-=friction*momentum[1]/momentum_magnitude;
+            force[2]-=friction*momentum[2]/momentum_magnitude;
+        }
+        return force;
+    }
+
+    double step(gsl::vector& position, gsl::vector& momentum, double time, double timestep)
+    //one Dormand-Prince step, returns the error estimate
+    {
+        gsl::vector K_pos[7];
+        gsl::vector K_mom[7];
+        for(int stage=0; stage<7; stage++)
+        {
+            gsl::vector pos_step=position*1.0;
+            gsl::vector mom_step=momentum*1.0;
+            for(int k=0; k<stage; k++)
+            {
+                pos_step+=K_pos[k]*DP_a[stage][k];
+                mom_step+=K_mom[k]*DP_a[stage][k];
+            }
+
+            K_pos[stage]=mom_step*(1.0/legacy_gamma(mom_step));
+            K_mom[stage]=force(pos_step, mom_step, time+timestep*DP_c[stage], -1);
+            K_pos[stage]*=timestep;
+            K_mom[stage]*=timestep;
+        }
+
+        gsl::vector pos_O4=position*1.0;
+        gsl::vector mom_O4=momentum*1.0;
+        gsl::vector pos_O5=position*1.0;
+        gsl::vector mom_O5=momentum*1.0;
+        for(int k=0; k<7; k++)
+        {
+            pos_O4+=K_pos[k]*DP_b4[k];
+            mom_O4+=K_mom[k]*DP_b4[k];
+            pos_O5+=K_pos[k]*DP_a[6][k];
+            mom_O5+=K_mom[k]*DP_a[6][k];
+        }
+
+        double error=(mom_O5-mom_O4).sum_of_squares();
+        position=pos_O5;
+        momentum=mom_O5;
+        return error;
+    }
+};
+
+size_t count_step_allocations(sim_cls& simulation, size_t& num_steps)
+//run the electrons placed by setup like sim_cls::run, without combing or population control. Returns the allocations made in step_electron
+{
+    size_t step_allocations=0;
+    num_steps=0;
+    electron_T* spare_electron=simulation.electron_pool.create();
+    while(true)
+    {
+        electron_T* electron=simulation.electrons.pop_first();
+        if(not electron) break;
+        if(electron->current_time>simulation.max_t)
+        {
+            simulation.histogramer.remove_electron(electron);
+            simulation.electrons.release(electron);
+            continue;
+        }
+
+        bool made_secondary;
+        size_t before=num_allocations;
+        bool keep=simulation.step_electron(electron, spare_electron, made_secondary);
+        step_allocations+=num_allocations-before;
+        num_steps++;
+
+        if(made_secondary)
+        {
+            simulation.electrons.insert(spare_electron->current_time, spare_electron);
+            spare_electron=simulation.electron_pool.create();
+        }
+        if(keep)
+        {
+            simulation.electrons.insert(electron->current_time, electron);
+        }
+        else
+        {
+            simulation.electrons.release(electron);
+        }
+    }
+    simulation.electrons.release(spare_electron);
+    return step_allocations;
+}
+
+int main()
+{
+    const size_t num_steps=10000;
+    const double Ez=-(7.0E5)/E_field_units;
+    const double By=(1.0E-5)/B_field_units;
+    const double energy=1000.0/energy_units_kev;
+
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, Ez);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, By, 0);
+
+    apply_charged_force force_engine(&E_field, &B_field);
+    force_engine.set_max_timestep(1.0E-4);
+    force_engine.set_errorTol(1.0E-4);
+
+    double mom_Z=KE_to_mom(energy);
+
+    //// current kinematics ////
+    electron_T electron;
+    electron.set_position(0, 0, 0);
+    electron.set_momentum(0, 0, mom_Z);
+    electron.timestep=1.0E-4;
+    electron.next_timestep=1.0E-4;
+    electron.update_energy();
+
+    force_engine.charged_particle_RungeKuttaDP(&electron); //first step may initialize things
+    size_t num_steps_taken=0;
+    num_allocations=0;
+    clock_t start=clock();
+    for(size_t i=0; i<num_steps; i++)
+    {
+        force_engine.charged_particle_RungeKuttaDP(&electron);
+        num_steps_taken++;
+        if(electron.energy<lowest_physical_energy) break;
+    }
+    double vec3_time=double(clock()-start)/CLOCKS_PER_SEC;
+    size_t vec3_allocations=num_allocations;
+
+    //// legacy kinematics ////
+    legacy_kinematics legacy(&force_engine, Ez, By);
+    gsl::vector position({0, 0, 0});
+    gsl::vector momentum({0, 0, mom_Z});
+    double time=0;
+
+    num_allocations=0;
+    start=clock();
+    for(size_t i=0; i<num_steps_taken; i++)
+    {
+        legacy.step(position, momentum, time, 1.0E-4);
+        time+=1.0E-4;
+    }
+    double legacy_time=double(clock()-start)/CLOCKS_PER_SEC;
+    size_t legacy_allocations=num_allocations;
+
+    print(num_steps_taken, "steps");
+    print("vec3 kinematics:   ", double(vec3_allocations)/num_steps_taken, "allocations per step", vec3_time*1.0E6/num_steps_taken, "us per step");
+    print("gsl::vector legacy:", double(legacy_allocations)/num_steps_taken, "allocations per step", legacy_time*1.0E6/num_steps_taken, "us per step");
+
+    //// main loop of Lehtinen1999 ////
+    const double sim_max_t=0.02;
+    const int sim_seeds=10;
+    sim_cls simulation(sim_max_t, 8.0, 0.0);
+    size_t num_sim_steps;
+    size_t step_allocations;
+    for(int run_i=0; run_i<2; run_i++)
+    {
+        simulation.reset(sim_max_t, 8.0, 0.0);
+        simulation.setup(sim_seeds);
+        simulation.low_energy_deposits.reserve(1000000); //the deposits are kept untill the fluid is evolved, so they grow with the run
+        step_allocations=count_step_allocations(simulation, num_sim_steps);
+    }
+    print("sim_cls::step_electron:", num_sim_steps, "steps,", double(step_allocations)/num_sim_steps, "allocations per step");
+
+    bool good=true;
+    if(vec3_allocations!=0)
+    {
+        print("ERROR: Runge-Kutta step allocated memory");
+        good=false;
+    }
+    if(step_allocations!=0)
+    {
+        print("ERROR: step_electron allocated memory");
+        good=false;
+    }
+    return good ? 0 : 1;
+}
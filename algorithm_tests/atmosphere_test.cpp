@@ -0,0 +1,158 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/atmosphere.hpp"
+#include "../physics/apply_force.hpp"
+
+using namespace std;
+
+//// tests the density profiles of atmosphere.hpp, and the density scaling of apply_charged_force ////
+// A tabulated_density made from a few points of an exponential profile must match the exponential_density.
+// An electron is followed upward through an exponential atmosphere, and the density must not change by more than max_density_change in any step.
+// The friction at altitude must be the sea level friction times the density ratio. Also times the density look-ups.
+
+const double scale_height=7.2E3/distance_units; //about the atmosphere
+const double start_altitude=5.0E3/distance_units;
+
+bool check_tabulated(exponential_density& exponential, tabulated_density& tabulated)
+{
+    double max_error=0;
+    double max_scale_height_error=0;
+    for(int i=1; i<1000; i++) //inside the table, the density is constant outside
+    {
+        double Z=-start_altitude + i*(4*scale_height)/1000.0;
+        max_error=max(max_error, abs(tabulated.density_ratio(Z)/exponential.density_ratio(Z) - 1.0));
+        max_scale_height_error=max(max_scale_height_error, abs(tabulated.scale_height(Z)/scale_height - 1.0));
+    }
+    print("tabulated density: largest relative error", max_error, " in scale height", max_scale_height_error);
+    if(max_error>1.0E-3 or max_scale_height_error>1.0E-6)
+    {
+        print("ERROR: tabulated density does not match exponential density");
+        return false;
+    }
+    return true;
+}
+
+bool check_timestep(exponential_density& exponential)
+{
+    const double Ez=-(1.7E6)/E_field_units;
+
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, Ez);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, 0, 0);
+
+    const double max_change=0.02;
+    apply_charged_force_fields<uniform_field, uniform_field> force_engine(&E_field, &B_field);
+    force_engine.set_max_timestep(1.0);
+    force_engine.set_errorTol(1.0E-4);
+    force_engine.set_atmosphere(&exponential, max_change);
+
+    electron_T electron;
+    electron.set_momentum(0, 0, KE_to_mom(1000.0/energy_units_kev));
+    electron.update_energy();
+    electron.timestep=1.0E-4;
+    electron.next_timestep=1.0E-4;
+
+    double max_step_change=0;
+    int num_steps=0;
+    while(electron.position[2]<2*scale_height)
+    {
+        double old_ratio=exponential.density_ratio(electron.position[2]);
+        force_engine.charged_particle_step(&electron);
+        double new_ratio=exponential.density_ratio(electron.position[2]);
+        max_step_change=max(max_step_change, abs(new_ratio/old_ratio-1.0));
+        num_steps++;
+    }
+    print("electron went up two scale heights in", num_steps, "steps. largest change in density in one step:", max_step_change);
+
+    //the limit is on the density at the start of the step, so allow a little more
+    if(max_step_change>max_change*1.05)
+    {
+        print("ERROR: density changed too much in one step");
+        return false;
+    }
+    return true;
+}
+
+bool check_friction()
+//with no fields, the force is only friction, which needs to be proportional to density
+{
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, 0);
+
+    exponential_density exponential(scale_height, start_altitude);
+
+    apply_charged_force_fields<uniform_field, uniform_field> force_engine(&E_field, &E_field);
+    vec3 position(0, 0, 0);
+    vec3 momentum(0, 0, KE_to_mom(1000.0/energy_units_kev));
+    vec3 sea_level_force=force_engine.force(position, momentum, 0, -1);
+
+    force_engine.set_atmosphere(&exponential);
+    vec3 altitude_force=force_engine.force(position, momentum, 0, -1);
+
+    double error=abs(altitude_force[2]/sea_level_force[2] - exponential.density_ratio(0))/exponential.density_ratio(0);
+    print("friction at", start_altitude*distance_units, "m is", altitude_force[2]/sea_level_force[2], "times sea level. error:", error);
+    if(error>1.0E-14)
+    {
+        print("ERROR: friction is not scaled by density");
+        return false;
+    }
+    return true;
+}
+
+template<typename profile_T>
+void time_profile(const char* name, profile_T& profile)
+{
+    const size_t N=10000000;
+    double sum=0;
+    clock_t start=clock();
+    for(size_t i=0; i<N; i++)
+    {
+        sum+=profile.density_ratio(-start_altitude + (i%1000)*(4*scale_height)/1000.0);
+    }
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+    print(name, ":", time*1.0E9/N, "ns per look-up  (", sum, ")");
+}
+
+int main()
+{
+    exponential_density exponential(scale_height, start_altitude);
+
+    //a few points, like a table of a standard atmosphere
+    gsl::vector altitudes=make_vector(11, 0.0);
+    gsl::vector ratios=make_vector(11, 0.0);
+    for(int i=0; i<11; i++)
+    {
+        altitudes[i]=-start_altitude + i*(4*scale_height)/10.0;
+        ratios[i]=exponential.density_ratio(altitudes[i]);
+    }
+    tabulated_density tabulated(altitudes, ratios, 64);
+
+    bool good=check_tabulated(exponential, tabulated);
+    good=check_timestep(exponential) and good;
+    good=check_friction() and good;
+
+    time_profile("exponential_density", exponential);
+    time_profile("tabulated_density", tabulated);
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <string>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/electron_store.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/apply_force.hpp"
+
+using namespace std;
+
+//// compares apply_charged_force::charged_particle_RungeKuttaDP_batch to the scalar Runge-Kutta ////
+// The same electrons are stepped in two electron_stores, one electron at a time and W at a time, and the results need to be identical to the bit.
+// (If this fails after adding -march flags, the compiler is probably contracting to fused multiply-adds differently. Try -ffp-contract=off)
+// Prints electron-steps per second for each. Also steps the electrons one at a time with apply_charged_force_fields<uniform_field, uniform_field>,
+// which looks up the fields without virtual calls.
+
+const size_t num_electrons=4096;
+const size_t num_steps=200;
+
+void fill_store(electron_store& electrons)
+{
+    std::mt19937_64 rand(1234);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    electrons.clear();
+    for(size_t i=0; i<num_electrons; i++)
+    {
+        size_t handle=electrons.add();
+
+        double energy=(1000.0 + 9000.0*uniform(rand))/energy_units_kev;
+        double mom=KE_to_mom(energy);
+        double cos_theta=2*uniform(rand)-1;
+        double sin_theta=sqrt(1-cos_theta*cos_theta);
+        double phi=2*PI*uniform(rand);
+        electrons.set_momentum(handle, mom*sin_theta*cos(phi), mom*sin_theta*sin(phi), mom*cos_theta);
+        electrons.update_energy(handle);
+        electrons.timestep[handle]=1.0E-4;
+        electrons.next_timestep[handle]=1.0E-4*(0.1+uniform(rand));
+    }
+}
+
+bool same_bits(double A, double B)
+{
+    return memcmp(&A, &B, sizeof(double))==0;
+}
+
+size_t count_differences(electron_store& A, electron_store& B)
+{
+    size_t num_different=0;
+    for(size_t handle=0; handle<A.size(); handle++)
+    {
+        bool same= same_bits(A.pos_x[handle], B.pos_x[handle]) and same_bits(A.pos_y[handle], B.pos_y[handle]) and same_bits(A.pos_z[handle], B.pos_z[handle]) and
+                   same_bits(A.mom_x[handle], B.mom_x[handle]) and same_bits(A.mom_y[handle], B.mom_y[handle]) and same_bits(A.mom_z[handle], B.mom_z[handle]) and
+                   same_bits(A.current_time[handle], B.current_time[handle]) and same_bits(A.timestep[handle], B.timestep[handle]) and
+                   same_bits(A.next_timestep[handle], B.next_timestep[handle]) and same_bits(A.interpolant_timestep[handle], B.interpolant_timestep[handle]) and
+                   A.has_interpolant(handle)==B.has_interpolant(handle);
+
+        if(same and A.has_interpolant(handle))
+        {
+            const double* coefs_A=&A.interpolant[A.interpolant_block[handle]*electron_store::interpolant_stride];
+            const double* coefs_B=&B.interpolant[B.interpolant_block[handle]*electron_store::interpolant_stride];
+            same= memcmp(coefs_A, coefs_B, electron_store::interpolant_stride*sizeof(double))==0;
+        }
+
+        if(not same) num_different++;
+    }
+    return num_different;
+}
+
+template<int W>
+bool run_batch(apply_charged_force& force_engine, electron_store& scalar_electrons, double scalar_time, std::vector<size_t>& handles)
+{
+    electron_store batch_electrons;
+    fill_store(batch_electrons);
+
+    clock_t start=clock();
+    for(size_t step=0; step<num_steps; step++)
+    {
+        force_engine.charged_particle_RungeKuttaDP_batch<W>(batch_electrons, handles);
+    }
+    double batch_time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    size_t num_different=count_differences(scalar_electrons, batch_electrons);
+    print("  batch of", W, ":", num_electrons*num_steps/batch_time, "electron-steps per second. speed-up:", scalar_time/batch_time);
+    if(num_different>0)
+    {
+        print("ERROR:", num_different, "electrons are different from the scalar Runge-Kutta");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const double Ez=-(7.0E5)/E_field_units;
+    const double By=(1.0E-5)/B_field_units;
+
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, Ez);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, By, 0);
+
+    apply_charged_force force_engine(&E_field, &B_field);
+    force_engine.set_max_timestep(1.0E-4);
+    force_engine.set_errorTol(1.0E-4);
+
+    electron_store scalar_electrons;
+    fill_store(scalar_electrons);
+    std::vector<size_t> handles;
+    for(size_t handle=0; handle<num_electrons; handle++)
+    {
+        handles.push_back(handle);
+    }
+
+    clock_t start=clock();
+    for(size_t step=0; step<num_steps; step++)
+    {
+        for(size_t handle : handles)
+        {
+            force_engine.charged_particle_RungeKuttaDP(scalar_electrons, handle);
+        }
+    }
+    double scalar_time=double(clock()-start)/CLOCKS_PER_SEC;
+    print(num_electrons, "electrons,", num_steps, "steps");
+    print("  scalar:", num_electrons*num_steps/scalar_time, "electron-steps per second");
+
+    apply_charged_force_fields<uniform_field, uniform_field> uniform_force_engine(&E_field, &B_field);
+    uniform_force_engine.set_max_timestep(1.0E-4);
+    uniform_force_engine.set_errorTol(1.0E-4);
+
+    electron_store uniform_electrons;
+    fill_store(uniform_electrons);
+    start=clock();
+    for(size_t step=0; step<num_steps; step++)
+    {
+        for(size_t handle : handles)
+        {
+            uniform_force_engine.charged_particle_RungeKuttaDP(uniform_electrons, handle);
+        }
+    }
+    double uniform_time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("  scalar, non-virtual fields:", num_electrons*num_steps/uniform_time, "electron-steps per second. speed-up:", scalar_time/uniform_time);
+
+    bool good=true;
+    size_t num_different=count_differences(scalar_electrons, uniform_electrons);
+    if(num_different>0)
+    {
+        print("ERROR:", num_different, "electrons are different with non-virtual fields");
+        good=false;
+    }
+
+    good=run_batch<4>(force_engine, scalar_electrons, scalar_time, handles) and good;
+    good=run_batch<8>(force_engine, scalar_electrons, scalar_time, handles) and good;
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <vector>
+#include <string>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/gridded_field.hpp"
+#include "../physics/apply_force.hpp"
+
+using namespace std;
+
+//// tests gridded_field ////
+// A linear field is interpolated exactly by trilinear interpolation, so the grid is filled with a linear field, written to a file, read back,
+// and compared to the exact field at random points, for double and float storage, and for an axisymmetric grid. evaluate_batch must give the
+// same bits as evaluate. Then times evaluate and evaluate_batch on a large grid, and checks that apply_charged_force_fields<gridded_field<float>, ...>
+// follows an electron the same as with uniform_field, when the grid holds a uniform field.
+
+const int Nx=150;
+const int Ny=120;
+const int Nz=100;
+const vec3 grid_origin(-1.5, -1.2, 0.0);
+const vec3 grid_spacing(0.02, 0.02, 0.03);
+
+vec3 linear_field(double X, double Y, double Z)
+{
+    return vec3(1.0 + 2.0*X - 0.5*Y + 0.25*Z,  -3.0 + X + Y - Z,  0.5 - 0.1*X + 4.0*Y + 2.0*Z);
+}
+
+template<typename storage_T>
+void fill_linear(gridded_field<storage_T>& grid)
+{
+    grid.set_grid(grid_origin, grid_spacing, Nx, Ny, Nz);
+    for(int i=0; i<Nx; i++)
+    for(int j=0; j<Ny; j++)
+    for(int k=0; k<Nz; k++)
+    {
+        vec3 F=linear_field(grid_origin[0]+i*grid_spacing[0], grid_origin[1]+j*grid_spacing[1], grid_origin[2]+k*grid_spacing[2]);
+        grid.set_node(i, j, k, F[0], F[1], F[2]);
+    }
+}
+
+class random_points
+{
+public:
+    vector<double> X;
+    vector<double> Y;
+    vector<double> Z;
+    vector<double> T;
+
+    random_points(size_t N, double extra)
+    //points in the grid, and some that are up to extra outside of it
+    {
+        mt19937_64 rand(1234);
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        for(size_t i=0; i<N; i++)
+        {
+            X.push_back(grid_origin[0] - extra + uniform(rand)*((Nx-1)*grid_spacing[0] + 2*extra));
+            Y.push_back(grid_origin[1] - extra + uniform(rand)*((Ny-1)*grid_spacing[1] + 2*extra));
+            Z.push_back(grid_origin[2] - extra + uniform(rand)*((Nz-1)*grid_spacing[2] + 2*extra));
+            T.push_back(0);
+        }
+    }
+};
+
+bool inside_grid(double X, double Y, double Z)
+{
+    return X>=grid_origin[0] and X<=grid_origin[0]+(Nx-1)*grid_spacing[0] and
+           Y>=grid_origin[1] and Y<=grid_origin[1]+(Ny-1)*grid_spacing[1] and
+           Z>=grid_origin[2] and Z<=grid_origin[2]+(Nz-1)*grid_spacing[2];
+}
+
+template<typename storage_T>
+bool check_linear(string name, gridded_field<storage_T>& grid, double tolerance)
+{
+    random_points points(10000, 0.1);
+    size_t N=points.X.size();
+    vector<double> out_X(N), out_Y(N), out_Z(N);
+    grid.evaluate_batch(&points.X[0], &points.Y[0], &points.Z[0], &points.T[0], &out_X[0], &out_Y[0], &out_Z[0], N);
+
+    double max_error=0;
+    size_t num_batch_different=0;
+    for(size_t i=0; i<N; i++)
+    {
+        vec3 F;
+        grid.evaluate(vec3(points.X[i], points.Y[i], points.Z[i]), 0, F);
+        if(F[0]!=out_X[i] or F[1]!=out_Y[i] or F[2]!=out_Z[i]) num_batch_different++;
+
+        vec3 exact(0,0,0);
+        if(inside_grid(points.X[i], points.Y[i], points.Z[i]))
+        {
+            exact=linear_field(points.X[i], points.Y[i], points.Z[i]);
+        }
+        max_error=max(max_error, (F-exact).norm()/(exact.norm()+1.0));
+    }
+
+    print(name, ": largest error", max_error);
+    if(max_error>tolerance or num_batch_different>0)
+    {
+        print("ERROR:", name, "error is too large, or", num_batch_different, "points are different with evaluate_batch");
+        return false;
+    }
+    return true;
+}
+
+bool check_axisymmetric()
+//field of a line charge along Z, which is linear in r, plus a linear Z component
+{
+    gridded_field<double> grid(vec3(0, 0, -1), vec3(0.05, 1, 0.05), 41, 1, 41, true);
+    for(int i=0; i<41; i++)
+    for(int k=0; k<41; k++)
+    {
+        double R=i*0.05;
+        double Z=-1+k*0.05;
+        grid.set_node(i, 0, k, 3.0*R, 0.5*R, 1.0+Z);
+    }
+    grid.write_out("./gridded_field_test_axisymmetric");
+    gridded_field<double> loaded("./gridded_field_test_axisymmetric");
+
+    mt19937_64 rand(5678);
+    uniform_real_distribution<double> uniform(-1.0, 1.0);
+    double max_error=0;
+    for(int n=0; n<10000; n++)
+    {
+        double X=uniform(rand)*1.4;
+        double Y=uniform(rand)*1.4;
+        double Z=uniform(rand);
+        vec3 F;
+        loaded.evaluate(vec3(X, Y, Z), 0, F);
+
+        vec3 exact(3.0*X - 0.5*Y, 3.0*Y + 0.5*X, 1.0+Z); //(r, phi) components (3r, 0.5r) in cartesian
+        max_error=max(max_error, (F-exact).norm()/(exact.norm()+1.0));
+    }
+    print("axisymmetric: largest error", max_error);
+    if(max_error>1.0E-12)
+    {
+        print("ERROR: axisymmetric error is too large");
+        return false;
+    }
+    return true;
+}
+
+template<typename field_T>
+void time_field(string name, field_T& field)
+{
+    random_points points(1000000, 0.0);
+    size_t N=points.X.size();
+    vector<double> out_X(N), out_Y(N), out_Z(N);
+
+    //particles move a little between look-ups, so follow a random walk instead of jumping through memory
+    mt19937_64 rand(42);
+    normal_distribution<double> step(0.0, grid_spacing[0]);
+    for(size_t i=1; i<N; i++)
+    {
+        points.X[i]=points.X[i-1]+step(rand);
+        points.Y[i]=points.Y[i-1]+step(rand);
+        points.Z[i]=points.Z[i-1]+step(rand);
+        if(not inside_grid(points.X[i], points.Y[i], points.Z[i]))
+        {
+            points.X[i]=points.X[0];
+            points.Y[i]=points.Y[0];
+            points.Z[i]=points.Z[0];
+        }
+    }
+
+    clock_t start=clock();
+    double sum=0;
+    for(size_t i=0; i<N; i++)
+    {
+        vec3 F;
+        field.evaluate(vec3(points.X[i], points.Y[i], points.Z[i]), 0, F);
+        sum+=F[0];
+    }
+    double scalar_time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    start=clock();
+    for(size_t i=0; i<N; i+=8)
+    {
+        field.evaluate_batch(&points.X[i], &points.Y[i], &points.Z[i], &points.T[i], &out_X[i], &out_Y[i], &out_Z[i], 8);
+    }
+    double batch_time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    print(name, ":", scalar_time*1.0E9/N, "ns per point,", batch_time*1.0E9/N, "ns per point in batches of 8  (", sum+out_X[N-1], ")");
+}
+
+bool check_force()
+{
+    const double Ez=-(7.0E5)/E_field_units;
+    const double By=(1.0E-5)/B_field_units;
+
+    uniform_field E_uniform;
+    E_uniform.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_uniform.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_uniform.set_value(0, 0, Ez);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, By, 0);
+
+    gridded_field<float> E_grid(vec3(-1, -1, -1), vec3(0.1, 0.1, 0.1), 21, 21, 21);
+    for(int i=0; i<21; i++)
+    for(int j=0; j<21; j++)
+    for(int k=0; k<21; k++)
+    {
+        E_grid.set_node(i, j, k, 0, 0, Ez);
+    }
+
+    apply_charged_force_fields<uniform_field, uniform_field> uniform_engine(&E_uniform, &B_field);
+    apply_charged_force_fields<gridded_field<float>, uniform_field> grid_engine(&E_grid, &B_field);
+    uniform_engine.set_max_timestep(1.0E-3);
+    uniform_engine.set_errorTol(1.0E-4);
+    grid_engine.set_max_timestep(1.0E-3);
+    grid_engine.set_errorTol(1.0E-4);
+
+    electron_T uniform_electron;
+    uniform_electron.set_momentum(0, 0, KE_to_mom(1000.0/energy_units_kev));
+    uniform_electron.timestep=1.0E-4;
+    uniform_electron.next_timestep=1.0E-4;
+    electron_T grid_electron=uniform_electron;
+
+    for(int i=0; i<100; i++)
+    {
+        uniform_engine.charged_particle_RungeKuttaDP(&uniform_electron);
+        grid_engine.charged_particle_RungeKuttaDP(&grid_electron);
+    }
+
+    double position_error=(uniform_electron.position-grid_electron.position).norm()/uniform_electron.position.norm();
+    print("electron in gridded uniform field: relative difference in position", position_error);
+    if(position_error>1.0E-6) //float storage
+    {
+        print("ERROR: electron does not follow the same path in gridded_field");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    gridded_field<double> double_grid;
+    fill_linear(double_grid);
+    double_grid.write_out("./gridded_field_test_double");
+    gridded_field<double> double_loaded("./gridded_field_test_double");
+
+    gridded_field<float> float_grid;
+    fill_linear(float_grid);
+    float_grid.write_out("./gridded_field_test_float");
+    gridded_field<float> float_loaded("./gridded_field_test_float");
+
+    bool good=check_linear("double storage", double_loaded, 1.0E-12);
+    good=check_linear("float storage", float_loaded, 1.0E-6) and good;
+    good=check_axisymmetric() and good;
+    good=check_force() and good;
+
+    print(Nx*Ny*Nz, "nodes");
+    time_field("  double storage", double_loaded);
+    time_field("  float storage", float_loaded);
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/relativistic_formulas.hpp"
+#include "../physics/apply_force.hpp"
+#include "../physics/CSDA_table.hpp"
+
+#define LEHTINEN1999_NO_MAIN
+#include "../Lehtinen1999.cpp"
+
+using namespace std;
+
+//// first timestep of new and scattered electrons ////
+// Electrons at random energies (2 keV to 20 MeV) and directions, in the fields of Lehtinen1999, are followed for a short time starting from
+//   the default timestep of a new electron (electron_T::set_defaults),
+//   the timestep of a 1 MeV primary, which is what moller secondaries had before,
+//   and CSDA_table::initial_timestep.
+// For each, prints the number of accepted and rejected Runge-Kutta steps, and how many first steps change the energy by more than 4.5%. This is
+// only a stand-in for the timestep halvings of sim_cls::step_electron: about where interaction_chooser_quadratic starts halving the timestep
+// (the energy_fraction of the prediction is 3%).
+// Then a short run of Lehtinen1999 is done with sim_cls::predict_timesteps off and on, and the real halvings (timestep_halving_histogramer::print_summary)
+// and Runge-Kutta steps are printed for both. This part needs the tables, so run from where Lehtinen1999 runs.
+
+const double E_field=8*21.7; //same as Lehtinen1999
+const double min_energy=2.0/energy_units_kev;
+const double rel_tol=0.001;
+const double max_timestep=0.01;
+
+enum start_method {DEFAULT_TIMESTEP, PARENT_TIMESTEP, PREDICTED_TIMESTEP};
+
+class electron_sample
+{
+public:
+    std::vector<double> energy;
+    std::vector<vec3> direction;
+
+    electron_sample(size_t N)
+    {
+        mt19937_64 rand(1234);
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        for(size_t i=0; i<N; i++)
+        {
+            energy.push_back( min_energy*std::pow(1.0E4, uniform(rand)) );
+            double cos_theta=2*uniform(rand)-1;
+            double phi=2*PI*uniform(rand);
+            double sin_theta=std::sqrt(1-cos_theta*cos_theta);
+            direction.push_back( vec3(sin_theta*std::cos(phi), sin_theta*std::sin(phi), cos_theta) );
+        }
+    }
+};
+
+double parent_timestep(apply_charged_force& force_engine)
+//timestep of a 1 MeV electron after a few steps
+{
+    electron_T parent;
+    parent.set_momentum(0, 0, KE_to_mom(1000.0/energy_units_kev));
+    for(int i=0; i<20; i++)
+    {
+        force_engine.charged_particle_RungeKuttaDP(&parent);
+    }
+    return parent.next_timestep;
+}
+
+void follow(string name, apply_charged_force& force_engine, CSDA_table& CSDA, electron_sample& sample, start_method method, double duration)
+{
+    double inherited_timestep=parent_timestep(force_engine);
+    force_engine.reset_step_counters();
+
+    size_t num_large_changes=0;
+    clock_t start=clock();
+    for(size_t i=0; i<sample.energy.size(); i++)
+    {
+        electron_T electron;
+        electron.set_momentum(0, 0, 0);
+        electron.momentum.mult_add(sample.direction[i], KE_to_mom(sample.energy[i]));
+        electron.update_energy();
+        electron.keep_interpolant=false;
+        if(method==PARENT_TIMESTEP)
+        {
+            electron.next_timestep=inherited_timestep;
+        }
+        else if(method==PREDICTED_TIMESTEP)
+        {
+            electron.next_timestep=CSDA.initial_timestep(electron.energy);
+        }
+
+        bool first=true;
+        while(electron.current_time<duration and electron.energy>min_energy)
+        {
+            double old_energy=electron.energy;
+            force_engine.charged_particle_RungeKuttaDP(&electron);
+            electron.update_energy();
+            if(first and std::abs(electron.energy-old_energy)>0.045*old_energy)
+            {
+                num_large_changes++;
+            }
+            first=false;
+        }
+    }
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    size_t accepted=force_engine.num_accepted_steps;
+    size_t rejected=force_engine.num_rejected_steps;
+    print("  ", name, ":", accepted, "accepted steps,", rejected, "rejected.", num_large_changes, "first steps change the energy by more than 4.5%.", time, "s");
+}
+
+int main()
+{
+    uniform_field E;
+    E.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E.set_maximum(INFINITY, INFINITY, INFINITY);
+    E.set_value(0, 0, -E_field);
+
+    uniform_field B;
+    B.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B.set_maximum(INFINITY, INFINITY, INFINITY);
+
+    apply_charged_force force_engine(min_energy, &E, &B);
+    force_engine.set_max_timestep(max_timestep);
+    force_engine.set_errorTol(rel_tol);
+
+    CSDA_table CSDA(force_engine.ionization, min_energy, 1.0E5/energy_units_kev);
+    print("CSDA range of a 1 MeV electron:", CSDA.range(1000.0/energy_units_kev)*distance_units, "m");
+
+    electron_sample sample(10000);
+    const double duration=2.0E-4; //a few steps of a 1 MeV electron
+
+    for(double B_field : {0.0, 2*E_field})
+    {
+        B.set_value(B_field, 0, 0);
+        CSDA.set_timestep_prediction(E_field, B_field, rel_tol, max_timestep);
+        print("B field:", B_field);
+        follow("default timestep  ", force_engine, CSDA, sample, DEFAULT_TIMESTEP, duration);
+        follow("parent's timestep ", force_engine, CSDA, sample, PARENT_TIMESTEP, duration);
+        follow("predicted timestep", force_engine, CSDA, sample, PREDICTED_TIMESTEP, duration);
+    }
+
+    //the real halvings, in a short run of Lehtinen1999
+    const double run_time=0.02;
+    const int num_seeds=10;
+    sim_cls simulation(run_time, 8.0, 0.0);
+    for(bool predict : {false, true})
+    {
+        print();
+        print("Lehtinen1999 with predict_timesteps", predict ? "on" : "off");
+        simulation.predict_timesteps=predict;
+        simulation.timestep_hist.reset();
+        simulation.reset(run_time, 8.0, 0.0);
+        simulation.setup(num_seeds);
+        simulation.run();
+        simulation.timestep_hist.print_summary();
+        simulation.force_engine.print_step_stats();
+    }
+}
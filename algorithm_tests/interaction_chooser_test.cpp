@@ -0,0 +1,222 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "rand.hpp"
+#include "root_finding.hpp"
+
+#include "../physics/interaction_chooser.hpp"
+
+using namespace std;
+
+//// tests the interaction times of interaction_chooser_quadratic ////
+// sample takes the time of the first interaction directly, from an exponential number of expected interactions. Before, it drew a Poisson number
+// of interactions, took the smallest of that many uniform numbers, and found the time with brent at 1E-4 (old_chooser, below). Both are sampled
+// many times for two interactions with rates that change over the timestep, and compared to the exact distributions of a Poisson process:
+// the probability of an interaction, the fraction of each type, and the distribution of the time of the first interaction (with a Kolmogorov-Smirnov
+// test). Also times both.
+
+class test_interaction : public physical_interaction
+{
+public:
+    double scale;
+    double power;
+
+    test_interaction(double scale_, double power_)
+    {
+        scale=scale_;
+        power=power_;
+    }
+
+    double rate(double energy)
+    {
+        return scale*std::pow(energy, power);
+    }
+};
+
+class interaction_cubic
+//same as interaction_chooser_quadratic::interaction_time_finder
+{
+public:
+    double constant;
+    double A;
+    double B;
+    double C;
+
+    double operator()(double t_bar)
+    {
+        return ((C*t_bar + B)*t_bar + A)*t_bar + constant;
+    }
+};
+
+class old_chooser
+//interaction_chooser_quadratic::sample before sampling the first interaction directly, without the error checks
+{
+public:
+    rand_threadsafe rand;
+    test_interaction* interactions[2];
+
+    double sample(double initial_energy, double middle_energy, double final_energy, double timestep_size, int& interaction_chosen)
+    {
+        double num_interactions_in_timestep[2];
+        double total_A=0;
+        double total_B=0;
+        double total_C=0;
+        for(int i=0; i<2; i++)
+        {
+            double initial_rate=interactions[i]->rate(initial_energy);
+            double middle_rate =interactions[i]->rate(middle_energy);
+            double final_rate  =interactions[i]->rate(final_energy);
+            double Ai=initial_rate;
+            double Bi=4.0*middle_rate - final_rate - 3.0*Ai;
+            double Ci=final_rate - Ai - Bi;
+            total_A+=Ai;
+            total_B+=Bi;
+            total_C+=Ci;
+            num_interactions_in_timestep[i]=(Ai + 0.5*Bi + Ci/3.0)*timestep_size;
+        }
+
+        double total_expected=(total_A + 0.5*total_B + total_C/3.0)*timestep_size;
+        int total_actuall_interactions=rand.poisson(total_expected);
+        if(total_actuall_interactions==0)
+        {
+            interaction_chosen=-1;
+            return 2.0*timestep_size;
+        }
+
+        double interaction_sample=rand.uniform()*total_expected;
+        interaction_chosen= interaction_sample<num_interactions_in_timestep[0] ? 0 : 1;
+
+        double min_interaction_time_rand=2.0;
+        for(int i=0; i<total_actuall_interactions; i++)
+        {
+            double U=rand.uniform();
+            if(U<min_interaction_time_rand)
+            {
+                min_interaction_time_rand=U;
+            }
+        }
+
+        double denom=total_A + 0.5*total_B + total_C/3.0;
+        interaction_cubic finder;
+        finder.constant=-min_interaction_time_rand;
+        finder.A=total_A/denom;
+        finder.B=0.5*total_B/denom;
+        finder.C=total_C/(3.0*denom);
+        return brent_root(finder, 0.0, 1.0, 0.0001, 0.0001, 1000)*timestep_size;
+    }
+};
+
+//the step. Rates change by about 20% over it, and there are about two interactions in it
+const double initial_energy=1.0;
+const double final_energy=0.8;
+const double middle_energy=0.5*(initial_energy+final_energy);
+const double timestep=1.0;
+
+class sample_set
+{
+public:
+    vector<double> times;
+    size_t num_samples;
+    size_t num_first_type;
+    double time_per_sample;
+};
+
+template<typename chooser_T>
+sample_set run(chooser_T& chooser, size_t num_samples)
+{
+    sample_set out;
+    out.times.reserve(num_samples);
+    out.num_samples=num_samples;
+    out.num_first_type=0;
+    clock_t start=clock();
+    for(size_t i=0; i<num_samples; i++)
+    {
+        int interaction;
+        double time=chooser.sample(initial_energy, middle_energy, final_energy, timestep, interaction);
+        if(interaction!=-1)
+        {
+            out.times.push_back(time);
+            if(interaction==0) out.num_first_type++;
+        }
+    }
+    out.time_per_sample=double(clock()-start)/CLOCKS_PER_SEC*1.0E9/num_samples;
+    return out;
+}
+
+bool check(string name, sample_set& samples, test_interaction& first, test_interaction& second)
+{
+    //exact expected number of interactions until each time, from the same quadratic rates as the chooser
+    double A=0, B=0, C=0;
+    double first_expected=0;
+    test_interaction* interactions[2]={&first, &second};
+    for(int i=0; i<2; i++)
+    {
+        double initial_rate=interactions[i]->rate(initial_energy);
+        double middle_rate=interactions[i]->rate(middle_energy);
+        double final_rate=interactions[i]->rate(final_energy);
+        double Bi=4.0*middle_rate - final_rate - 3.0*initial_rate;
+        double Ci=final_rate - initial_rate - Bi;
+        A+=initial_rate;
+        B+=Bi;
+        C+=Ci;
+        if(i==0) first_expected=(initial_rate + 0.5*Bi + Ci/3.0)*timestep;
+    }
+    auto expected_number=[&](double t){ double T=t/timestep; return ((C*T/3.0 + 0.5*B)*T + A)*T*timestep; };
+    double total_expected=expected_number(timestep);
+    double interaction_probability=1-std::exp(-total_expected);
+
+    double N=samples.num_samples;
+    double num_interactions=samples.times.size();
+    double probability_sigmas=(num_interactions/N - interaction_probability)/std::sqrt(interaction_probability*(1-interaction_probability)/N);
+    double type_fraction=first_expected/total_expected;
+    double type_sigmas=(samples.num_first_type/num_interactions - type_fraction)/std::sqrt(type_fraction*(1-type_fraction)/num_interactions);
+
+    //Kolmogorov-Smirnov against the distribution of the first interaction, given that there is one
+    sort(samples.times.begin(), samples.times.end());
+    double KS_distance=0;
+    for(size_t i=0; i<samples.times.size(); i++)
+    {
+        double CDF=(1-std::exp(-expected_number(samples.times[i])))/interaction_probability;
+        KS_distance=max(KS_distance, max(abs(CDF - i/num_interactions), abs(CDF - (i+1)/num_interactions)));
+    }
+    double KS_critical=1.95/std::sqrt(num_interactions); //0.1% chance to fail
+
+    print(name, ":", samples.time_per_sample, "ns per sample");
+    print("   probability of interaction off by", probability_sigmas, "sigma, fraction of first type off by", type_sigmas, "sigma");
+    print("   Kolmogorov-Smirnov distance of the time", KS_distance, "( critical", KS_critical, ")");
+    if(abs(probability_sigmas)>4 or abs(type_sigmas)>4 or KS_distance>KS_critical)
+    {
+        print("ERROR:", name, "does not sample a Poisson process");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const size_t num_samples=2000000;
+
+    test_interaction first(1.5, -1.0);
+    test_interaction second(0.5, 0.5);
+
+    interaction_chooser_quadratic<2> chooser(first, second);
+    old_chooser old;
+    old.interactions[0]=&first;
+    old.interactions[1]=&second;
+
+    sample_set new_samples=run(chooser, num_samples);
+    sample_set old_samples=run(old, num_samples);
+
+    bool good=check("first interaction sampled directly", new_samples, first, second);
+    good=check("Poisson number and minimum of uniforms", old_samples, first, second) and good;
+    print("speed-up:", old_samples.time_per_sample/new_samples.time_per_sample);
+
+    return good ? 0 : 1;
+}
@@ -161,15 +161,15 @@ int main()
     ////test the implemented beth table
     electron_ionization_table test_table(false);
 
-    lower_val=test_table.electron_mom_sq[0];
-	upper_val=test_table.electron_mom_sq[test_table.electron_mom_sq.size()-1];
+    lower_val=test_table.table_mom_sq[0];
+	upper_val=test_table.table_mom_sq[test_table.table_mom_sq.size()-1];
 
 
 	start=time(NULL);
     for(int i=0; i<num_tests; i++)
     {
         double V=gen.uniform(lower_val, upper_val);
-        search_sorted_exponential(test_table.electron_mom_sq, V);
+        search_sorted_exponential(test_table.table_mom_sq, V);
     }
 	stop=time(NULL);
 	cout<< "exponential lookup on bethe interped: "<<difftime(stop, start)<<endl;
@@ -178,7 +178,7 @@ int main()
     for(int i=0; i<num_tests; i++)
     {
         double V=gen.uniform(lower_val, upper_val);
-        search_sorted_d(test_table.electron_mom_sq, V);
+        search_sorted_d(test_table.table_mom_sq, V);
     }
 	stop=time(NULL);
 	cout<< "normal lookup on bethe interped: "<<difftime(stop, start)<<endl;
@@ -187,7 +187,7 @@ int main()
     for(int i=0; i<num_tests; i++)
     {
         double V=gen.uniform(lower_val, upper_val);
-        search_sorted_linear(test_table.electron_mom_sq, V);
+        search_sorted_linear(test_table.table_mom_sq, V);
     }
 	stop=time(NULL);
 	cout<< "linear lookup on bethe interped: "<<difftime(stop, start)<<endl;
@@ -196,7 +196,7 @@ int main()
     for(int i=0; i<5; i++)
     {
         double V=gen.uniform(lower_val, upper_val);
-        search_sorted_exponential_test(test_table.electron_mom_sq, V);
+        search_sorted_exponential_test(test_table.table_mom_sq, V);
         print();
     }
     print();
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/low_energy_fluid.hpp"
+
+using namespace std;
+
+//// tests low_energy_fluid ////
+// Electrons are deposited in the center of the grid, and the fluid is evolved. With no attachment, the number of electrons must not change,
+// the mean position must move with -mobility*E, and the variance must grow by 2*D*t in each direction. With attachment, the number must decay
+// exponentially. The total current must be mobility*E times the number of electrons. Also times the fluid steps.
+
+const double cell_size=1.0;
+const int N_cells=60;
+const double mobility=0.01;
+const double diffusion=0.05;
+const double duration=50; //short enough that nothing reaches the edge of the grid
+
+void moments(low_energy_fluid& fluid, double& total, vec3& mean, vec3& variance)
+{
+    total=0;
+    mean.set(0, 0, 0);
+    variance.set(0, 0, 0);
+    for(int i=0; i<N_cells; i++)
+    for(int j=0; j<N_cells; j++)
+    for(int k=0; k<N_cells; k++)
+    {
+        double N=fluid.density[fluid.cell_index(i, j, k)];
+        vec3 center(fluid.origin[0]+(i+0.5)*cell_size, fluid.origin[1]+(j+0.5)*cell_size, fluid.origin[2]+(k+0.5)*cell_size);
+        total+=N;
+        mean.mult_add(center, N);
+        for(int d=0; d<3; d++)
+        {
+            variance[d]+=N*center[d]*center[d];
+        }
+    }
+    mean/=total;
+    for(int d=0; d<3; d++)
+    {
+        variance[d]=variance[d]/total - mean[d]*mean[d];
+    }
+}
+
+bool check_transport(uniform_field& E_field)
+{
+    low_energy_fluid fluid(vec3(-0.5, -0.5, -0.5)*N_cells*cell_size, cell_size, N_cells, N_cells, N_cells);
+    fluid.set_transport(&E_field, mobility, diffusion, 0, 1);
+
+    fluid_deposits deposits;
+    deposits.add(0, vec3(0.1, 0.1, 0.1), 1000, 0);
+    clock_t start=clock();
+    fluid.evolve(deposits, duration, duration/10);
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    double total;
+    vec3 mean;
+    vec3 variance;
+    moments(fluid, total, mean, variance);
+
+    vec3 expected_mean=E_field.value*(-mobility*duration) + vec3(0.5, 0.5, 0.5)*cell_size; //deposited at the center of the cell
+    double mean_error=(mean-expected_mean).norm()/cell_size;
+    //donor-cell advection adds numerical diffusion of |v|*(cell size - |v|*dt)/2, so only check the direction with no drift
+    double variance_error=std::abs(variance[0]/(2*diffusion*duration) - 1.0);
+    double current_error=(fluid.total_current.back()-E_field.value*(mobility*total)).norm()/(mobility*total*E_field.value.norm());
+
+    print("transport: number", total, " mean Z", mean[2], " variance X", variance[0], " ", fluid.output_times.size(), "outputs,", time, "s");
+    print("  error in: number", std::abs(total/1000-1), " mean (cells)", mean_error, " variance in X", variance_error, " current", current_error);
+    if(std::abs(total/1000-1)>1.0E-10 or mean_error>1.0E-6 or variance_error>1.0E-6 or current_error>1.0E-10)
+    {
+        print("ERROR: fluid transport is wrong");
+        return false;
+    }
+    return true;
+}
+
+bool check_attachment(uniform_field& E_field)
+{
+    const double attachment_rate=0.01;
+    low_energy_fluid fluid(vec3(-0.5, -0.5, -0.5)*N_cells*cell_size, cell_size, N_cells, N_cells, N_cells);
+    fluid.set_transport(&E_field, mobility, diffusion, attachment_rate, 1);
+
+    fluid_deposits deposits;
+    deposits.add(0, vec3(0, 0, 0), 1000, 0);
+    deposits.add(duration/2, vec3(0, 0, 0), 1000, 0);
+    fluid.evolve(deposits, duration, duration/10);
+
+    double expected=1000*(std::exp(-attachment_rate*duration) + std::exp(-attachment_rate*duration/2));
+    double error=std::abs(fluid.total_electrons.back()/expected - 1.0);
+    print("attachment: number", fluid.total_electrons.back(), "expected", expected, " error", error);
+    if(error>1.0E-10)
+    {
+        print("ERROR: attachment is wrong");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, -5.0);
+
+    bool good=check_transport(E_field);
+    good=check_attachment(E_field) and good;
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <cstdio>
+
+#include "GSL_utils.hpp"
+#include "vector.hpp"
+#include "constants.hpp"
+#include "rand.hpp"
+
+#include "../physics/bethe_eq.hpp"
+
+using namespace std;
+
+//// tests the moller loss table of electron_ionization_table ////
+// Stopping powers with a variable minimum energy, from the table, are compared to the calculated moller losses, at random momenta (in the
+// stopping power table) and minimum energies (in the moller loss table). The error is relative to the stopping power without moller removal.
+// The table is saved and loaded, and must give the same stopping powers, and a positron table must refuse it. Also times the lookups with a constant minimum energy, and with a
+// variable minimum energy with and without the table.
+
+const double lowest_min_energy=1.0/energy_units_kev;
+const double highest_min_energy=100.0/energy_units_kev;
+
+int main()
+{
+    const int num_tests=2000000;
+    const int num_energies=20;
+
+    electron_ionization_table table;
+    electron_ionization_table constant_table(10.0/energy_units_kev);
+    double lower_val=table.table_mom_sq[0];
+    double upper_val=table.table_mom_sq[table.table_mom_sq.size()-1];
+
+    rand_gen gen(true);
+    vector<double> mom_sq(num_tests);
+    for(int i=0; i<num_tests; i++)
+    {
+        mom_sq[i]=std::exp(gen.uniform(std::log(lower_val), std::log(upper_val)));
+    }
+    vector<removal_energy_T> calculated(num_energies);
+    for(int j=0; j<num_energies; j++)
+    {
+        double min_energy=std::exp(gen.uniform(std::log(lowest_min_energy), std::log(highest_min_energy)));
+        calculated[j]=table.removal_energy(min_energy); //no table yet
+    }
+
+    clock_t start=clock();
+    table.make_loss_table(lowest_min_energy, highest_min_energy);
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("made moller loss table of", table.num_loss_points, "by", table.num_loss_energies, "in", time, "s");
+
+    vector<removal_energy_T> tabulated(num_energies);
+    for(int j=0; j<num_energies; j++)
+    {
+        tabulated[j]=table.removal_energy(calculated[j].energy);
+    }
+
+    //accuracy
+    double max_error=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        int j=i%num_energies;
+        double exact=table.lookup_variable_RML(mom_sq[i], calculated[j]);
+        double error=std::abs(table.lookup_variable_RML(mom_sq[i], tabulated[j])-exact)/table.table_stopping_power(mom_sq[i]);
+        max_error=std::max(max_error, error);
+    }
+    print("largest error, relative to stopping power:", max_error);
+
+    //save and load
+    const char* fname="./moller_loss_table_test";
+    table.save_loss_table(fname);
+    electron_ionization_table loaded_table;
+    bool loaded=loaded_table.load_loss_table(fname);
+    positron_ionization_table positron_table;
+    bool loaded_as_positron=positron_table.load_loss_table(fname); //moller losses are not bhabha losses
+    std::remove(fname);
+    int num_different=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        int j=i%num_energies;
+        if(loaded_table.lookup_variable_RML(mom_sq[i], loaded_table.removal_energy(calculated[j].energy))
+           != table.lookup_variable_RML(mom_sq[i], tabulated[j]))
+        {
+            num_different++;
+        }
+    }
+    print("loaded table:", loaded ? "loaded," : "NOT loaded,", num_different, "stopping powers differ");
+
+    //timing
+    double sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=constant_table.lookup(mom_sq[i]);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("constant minimum energy:          ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=table.lookup_variable_RML(mom_sq[i], calculated[i%num_energies]);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("variable minimum energy, calculated:", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=table.lookup_variable_RML(mom_sq[i], tabulated[i%num_energies]);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("variable minimum energy, table:     ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    bool good=true;
+    if(max_error>1.0E-4)
+    {
+        print("ERROR: moller loss table is not accurate");
+        good=false;
+    }
+    if(not loaded or num_different>0)
+    {
+        print("ERROR: saved moller loss table is different");
+        good=false;
+    }
+    if(loaded_as_positron)
+    {
+        print("ERROR: moller loss table was loaded into a positron table");
+        good=false;
+    }
+    return good ? 0 : 1;
+}
@@ -47,6 +47,11 @@ void read_remove_electron(binary_input& fin)
     double mom_2=fin.in_double();
 }
 
+void read_electron_weight(binary_input& fin)
+{
+    double weight=fin.in_double();
+}
+
 int main()
 {
     string fname="output";
@@ -71,6 +76,10 @@ int main()
         {
             read_remove_electron(fin);
         }
+        else if(command==5)
+        {
+            read_electron_weight(fin);
+        }
         else if(command==4)
         {
             print("done reading!");
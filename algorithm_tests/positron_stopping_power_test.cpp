@@ -0,0 +1,217 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+#include "rand.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/relativistic_formulas.hpp"
+#include "../physics/bethe_eq.hpp"
+#include "../physics/apply_force.hpp"
+
+using namespace std;
+
+//// tests the positron stopping power (positron_ionization_table) and apply_charged_force_fields with positron_species ////
+// bhabha_losses must match a numerical integral of the energy transfer over the bhabha cross section. The positron table with a constant minimum energy
+// must be the table without removal minus the bhabha losses, and the batched lookup must give the same stopping powers as the scalar one.
+// Then a positron and an electron are stepped in the same field by force engines of their species: they must be pushed in opposite directions, and
+// a force engine must refuse a particle of the other species. Also times the Runge-Kutta steps of both.
+
+const double min_energy=2.0/energy_units_kev;
+
+double integrated_bhabha_losses(double mom_sq, double min_energy_)
+//midpoint rule in log(epsilon) of epsilon*d(sigma)/d(epsilon), where epsilon is the fraction of the kinetic energy given to the electron
+{
+    double gamma_=std::sqrt(1+mom_sq);
+    double beta_sq=mom_sq/(1+mom_sq);
+    double y=1.0/(gamma_+1);
+    double B1=2-y*y;
+    double B2=(1-2*y)*(3+y*y);
+    double B4=(1-2*y)*(1-2*y)*(1-2*y);
+    double B3=B4+(1-2*y)*(1-2*y);
+
+    const int N=100000;
+    double log_delta=std::log(min_energy_/(gamma_-1));
+    double step=-log_delta/N;
+    double sum=0;
+    for(int i=0; i<N; i++)
+    {
+        double epsilon=std::exp(log_delta + (i+0.5)*step);
+        //epsilon * cross section * epsilon (from d epsilon=epsilon*d log(epsilon))
+        sum+=1.0/beta_sq - B1*epsilon + B2*epsilon*epsilon - B3*epsilon*epsilon*epsilon + B4*epsilon*epsilon*epsilon*epsilon;
+    }
+    return sum*step;
+}
+
+bool check_bhabha()
+{
+    double max_error=0;
+    double energies[]={5.0, 20.0, 300.0, 1000.0, 2.0E4};
+    for(double energy_kev : energies)
+    {
+        double momentum=KE_to_mom(energy_kev/energy_units_kev);
+        double exact=integrated_bhabha_losses(momentum*momentum, min_energy);
+        max_error=std::max(max_error, std::abs(bhabha_losses(momentum*momentum, min_energy)/exact - 1.0));
+    }
+    print("bhabha losses: largest relative error", max_error);
+    if(max_error>1.0E-6)
+    {
+        print("ERROR: bhabha losses do not match the cross section");
+        return false;
+    }
+    return true;
+}
+
+bool check_table()
+{
+    positron_ionization_table table;
+    positron_ionization_table removed_table(min_energy);
+    bool good=true;
+
+    //the formula has no density effect, so it is a little above the table at the top
+    double top_mom_sq=table.table_mom_sq[table.table_size-1];
+    print("positron table at", (std::sqrt(1+top_mom_sq)-1)*energy_units_kev, "keV: relative difference from the formula",
+          table.lookup(top_mom_sq)/positron_bethe_formula(top_mom_sq) - 1.0);
+
+    //away from where the losses start, the removed table is the table minus the bhabha losses
+    double start_mom_sq=positron_species::losses_start_mom_sq(min_energy);
+    double max_error=0;
+    for(int i=0; i<10000; i++)
+    {
+        double mom_sq=std::exp(std::log(10*start_mom_sq) + i*std::log(top_mom_sq/(10*start_mom_sq))/10000);
+        double SP=table.lookup(mom_sq);
+        max_error=std::max(max_error, std::abs(SP-removed_table.lookup(mom_sq)-bhabha_losses(mom_sq, min_energy))/SP);
+    }
+    print("bhabha removal: largest error, relative to stopping power:", max_error);
+    if(max_error>1.0E-3)
+    {
+        print("ERROR: positron table does not remove the bhabha losses");
+        good=false;
+    }
+
+    rand_gen gen(true);
+    const int num_tests=100000;
+    vector<double> mom_sq(num_tests);
+    for(int i=0; i<num_tests; i++)
+    {
+        mom_sq[i]=std::exp(gen.uniform(std::log(table.table_mom_sq[0])-1, std::log(top_mom_sq)+1));
+    }
+    vector<double> stopping_power(num_tests);
+    removed_table.lookup(&mom_sq[0], &stopping_power[0], num_tests);
+    int num_different=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        if(stopping_power[i]!=removed_table.lookup(mom_sq[i])) num_different++;
+    }
+    if(num_different>0)
+    {
+        print("ERROR:", num_different, "batched positron lookups differ from the scalar lookup");
+        good=false;
+    }
+    return good;
+}
+
+template<typename engine_T>
+double time_steps(engine_T& engine, int charge, double& mom_z)
+//time of one Runge-Kutta step of a 1 MeV particle, and its momentum along z after
+{
+    const int num_steps=100000;
+    electron_T particle;
+    particle.charge=charge;
+    double start_momentum=KE_to_mom(1000/energy_units_kev);
+
+    double time=0;
+    mom_z=0;
+    for(int i=0; i<num_steps; i++)
+    {
+        if(i%100==0)
+        {
+            particle.set_position(0, 0, 0);
+            particle.set_momentum(start_momentum, 0, 0);
+            particle.current_time=0;
+            particle.next_timestep=1.0E-4;
+        }
+        clock_t start=clock();
+        engine.charged_particle_RungeKuttaDP(&particle);
+        time+=double(clock()-start)/CLOCKS_PER_SEC;
+    }
+    mom_z=particle.momentum[2];
+    return time*1.0E9/num_steps;
+}
+
+bool check_engines()
+{
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, -8*21.7);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, 0, 0);
+
+    apply_charged_force_fields<uniform_field, uniform_field> electron_engine(min_energy, &E_field, &B_field);
+    apply_charged_force_fields<uniform_field, uniform_field, positron_species> positron_engine(min_energy, &E_field, &B_field);
+    electron_engine.set_max_timestep(1.0E-3);
+    electron_engine.set_errorTol(1.0E-4);
+    positron_engine.set_max_timestep(1.0E-3);
+    positron_engine.set_errorTol(1.0E-4);
+
+    double electron_mom_z;
+    double positron_mom_z;
+    double electron_time=time_steps(electron_engine, -1, electron_mom_z);
+    double positron_time=time_steps(positron_engine, 1, positron_mom_z);
+    print("electron step:", electron_time, "ns, momentum along Z", electron_mom_z);
+    print("positron step:", positron_time, "ns, momentum along Z", positron_mom_z);
+
+    bool good=true;
+    if(not (electron_mom_z>0 and positron_mom_z<0))
+    {
+        print("ERROR: electron and positron are not pushed in opposite directions");
+        good=false;
+    }
+
+    int num_refused=0;
+    electron_T electron;
+    electron.set_momentum(1, 0, 0);
+    electron.next_timestep=1.0E-4;
+    try
+    {
+        positron_engine.charged_particle_RungeKuttaDP(&electron);
+    }
+    catch(gen_exception& error)
+    {
+        num_refused++;
+    }
+    electron.charge=1;
+    try
+    {
+        electron_engine.charged_particle_RungeKuttaDP(&electron);
+    }
+    catch(gen_exception& error)
+    {
+        num_refused++;
+    }
+    if(num_refused!=2)
+    {
+        print("ERROR: force engine stepped a particle of the other species");
+        good=false;
+    }
+    return good;
+}
+
+int main()
+{
+    bool good=check_bhabha();
+    good=check_table() and good;
+    good=check_engines() and good;
+    return good ? 0 : 1;
+}
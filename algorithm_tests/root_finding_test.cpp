@@ -0,0 +1,165 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "rand.hpp"
+#include "functor.hpp"
+#include "root_finding.hpp"
+
+using namespace std;
+
+//// tests the templated root finders of root_finding.hpp ////
+// brent_root, itp_root, newton_root and cubic_root find where the cumulative number of interactions of interaction_chooser_quadratic
+// (a cubic in the time) reaches a random number, for random rates. They are compared to a brent_root with no tolerance, and must be within
+// their tolerance. brent_root must take the same steps as the GSL brent solver, so gives the same roots. They are also checked on exp(x)-2.
+// Also times each, and the GSL solver through a functor_1D, which is what interaction_chooser_quadratic used before.
+
+class interaction_cubic : public functor_1D
+//same as interaction_chooser_quadratic::interaction_time_finder
+{
+public:
+    double constant;
+    double A;
+    double B;
+    double C;
+
+    double call(double t_bar)
+    {
+        return ((C*t_bar + B)*t_bar + A)*t_bar + constant;
+    }
+
+    double derivative(double t_bar)
+    {
+        return (3*C*t_bar + 2*B)*t_bar + A;
+    }
+};
+
+double gsl_brent(interaction_cubic& cubic, double epsabs, double epsrel)
+//the GSL solver, through a functor_1D
+{
+    gsl_function F=cubic.get_gsl_func();
+    return root_finder_brent(F, 1.0, 0.0, epsabs, epsrel, 1000);
+}
+
+int main()
+{
+    const int num_tests=200000;
+    const double tolerance=0.0001; //what interaction_chooser_quadratic uses
+
+    //random cubics, where the rate changes by up to 50% over the timestep, and can be quadratic
+    rand_gen gen(true);
+    vector<interaction_cubic> cubics(num_tests);
+    vector<double> exact(num_tests);
+    for(int i=0; i<num_tests; i++)
+    {
+        double initial_rate=1.0;
+        double final_rate=gen.uniform(0.5, 1.5);
+        double middle_rate=0.5*(initial_rate+final_rate)*gen.uniform(0.95, 1.05);
+        double A=initial_rate;
+        double B=4.0*middle_rate - final_rate - 3.0*A;
+        double C=final_rate - A - B;
+        double denom=A + 0.5*B + C/3.0;
+
+        cubics[i].constant=-gen.uniform();
+        cubics[i].A=A/denom;
+        cubics[i].B=0.5*B/denom;
+        cubics[i].C=C/(3.0*denom);
+        exact[i]=brent_root(cubics[i], 0.0, 1.0, 0.0, 4*DBL_EPSILON, 1000);
+    }
+
+    bool good=true;
+    double max_errors[5]={0, 0, 0, 0, 0};
+    int num_different_from_GSL=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        interaction_cubic& cubic=cubics[i];
+        auto derivative=[&cubic](double t){ return cubic.derivative(t); };
+        double brent=brent_root(cubic, 0.0, 1.0, tolerance, tolerance, 1000);
+        max_errors[0]=max(max_errors[0], abs(brent-exact[i]));
+        max_errors[1]=max(max_errors[1], abs(itp_root(cubic, 0.0, 1.0, tolerance)-exact[i]));
+        max_errors[2]=max(max_errors[2], abs(newton_root(cubic, derivative, -cubic.constant, 0.0, 1.0, tolerance, tolerance, 1000)-exact[i]));
+        max_errors[3]=max(max_errors[3], abs(cubic_root(cubic.constant, cubic.A, cubic.B, cubic.C, 0.0, 1.0)-exact[i]));
+        if(brent!=gsl_brent(cubic, tolerance, tolerance)) num_different_from_GSL++;
+    }
+    print("largest errors in the interaction time: brent", max_errors[0], " ITP", max_errors[1], " newton", max_errors[2], " cubic", max_errors[3]);
+    print(num_different_from_GSL, "brent roots differ from GSL");
+    if(max_errors[0]>2*tolerance or max_errors[1]>tolerance or max_errors[2]>2*tolerance or max_errors[3]>1.0E-12)
+    {
+        print("ERROR: root is not within tolerance");
+        good=false;
+    }
+    if(num_different_from_GSL>0)
+    {
+        print("ERROR: brent_root is different from the GSL solver");
+        good=false;
+    }
+
+    //a function that is not a polynomial
+    auto exponential=[](double x){ return std::exp(x)-2.0; };
+    auto exponential_derivative=[](double x){ return std::exp(x); };
+    double root=std::log(2.0);
+    double brent_error=abs(brent_root(exponential, 0.0, 2.0, 1.0E-10, 0.0, 1000)-root);
+    double itp_error=abs(itp_root(exponential, 0.0, 2.0, 1.0E-10)-root);
+    double newton_error=abs(newton_root(exponential, exponential_derivative, 1.0, 0.0, 2.0, 1.0E-10, 0.0, 1000)-root);
+    print("exp(x)=2: errors brent", brent_error, " ITP", itp_error, " newton", newton_error);
+    if(brent_error>1.0E-10 or itp_error>1.0E-10 or newton_error>1.0E-10)
+    {
+        print("ERROR: root of exp(x)-2 is not within tolerance");
+        good=false;
+    }
+
+    //timing
+    double sum=0;
+    clock_t start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=gsl_brent(cubics[i], tolerance, tolerance);
+    }
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("GSL brent:       ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=brent_root(cubics[i], 0.0, 1.0, tolerance, tolerance, 1000);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("templated brent: ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=itp_root(cubics[i], 0.0, 1.0, tolerance);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("ITP:             ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        interaction_cubic& cubic=cubics[i];
+        auto derivative=[&cubic](double t){ return cubic.derivative(t); };
+        sum+=newton_root(cubic, derivative, -cubic.constant, 0.0, 1.0, tolerance, tolerance, 1000);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("newton:          ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=cubic_root(cubics[i].constant, cubics[i].A, cubics[i].B, cubics[i].C, 0.0, 1.0);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("closed form:     ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    return good ? 0 : 1;
+}
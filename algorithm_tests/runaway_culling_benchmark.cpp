@@ -0,0 +1,215 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/relativistic_formulas.hpp"
+#include "../physics/apply_force.hpp"
+#include "../physics/CSDA_table.hpp"
+#include "../physics/moller_scattering.hpp"
+#include "../physics/interaction_chooser.hpp"
+
+using namespace std;
+
+//// culling of electrons that cannot run away (sim_cls::cull_electron in Lehtinen1999.cpp) ////
+// Checks that the stopping power is larger than the electric force below CSDA_table::runaway_threshold, and smaller just above it.
+// Then electrons below the culling threshold, in the field of Lehtinen1999, are followed to the removal energy like sim_cls::step_electron does:
+// the Runge-Kutta with the stopping power that has moller losses removed, and moller scattering above the removal energy. Their secondaries are
+// followed too. There is no coulomb scattering here, so instead the direction is made random after every step, which is kept short.
+// The mean lifetime of the primaries is compared to the mean of the CSDA times that culling counts, which use the stopping power without moller
+// losses removed. The CSDA times of the stopping power with the losses removed (what culling used before) are printed too. The time the secondaries
+// live is not counted by culling, so is printed as the bias of culling. Also compares the time taken to follow the electrons to the time to cull them.
+// The run fails if the lifetime error is larger than lifetime_tolerance. This has not been calibrated against the real moller tables yet: run this
+// with them, and set lifetime_tolerance a little above the error that is printed.
+
+const double E_field=8*21.7; //same as Lehtinen1999
+const double min_energy=2.0/energy_units_kev;
+const double culling_margin=2.0;
+const double rel_tol=0.001;
+const double max_timestep=1.0E-6; //about 1/50 of the lifetime of a 5 keV electron
+const double lifetime_tolerance=0.05; //largest allowed relative error of the culled lifetime, see above
+
+bool check_threshold(CSDA_table& CSDA, double electric_force)
+{
+    double threshold=CSDA.runaway_threshold(electric_force);
+    print("runaway threshold for force", electric_force, ":", threshold*energy_units_kev, "keV");
+    if(threshold<=CSDA.lowest_energy or threshold>=CSDA.energies[CSDA.minimum_index])
+    {
+        return true;
+    }
+
+    bool good=true;
+    for(double energy=CSDA.lowest_energy; energy<threshold*0.99; energy*=1.01)
+    {
+        if(CSDA.stopping_power(energy)<=electric_force)
+        {
+            print("ERROR: stopping power at", energy*energy_units_kev, "keV is less than the electric force");
+            good=false;
+            break;
+        }
+    }
+    if(CSDA.stopping_power(threshold*1.01)>=electric_force)
+    {
+        print("ERROR: stopping power just above the threshold is larger than the electric force");
+        good=false;
+    }
+    return good;
+}
+
+double follow_electron(electron_T& electron, apply_charged_force& force_engine, CSDA_table& CSDA, moller_table& moller,
+                       interaction_chooser_quadratic<1>& chooser, mt19937_64& rand, std::vector<electron_T>& secondaries, size_t& num_steps)
+//follow an electron untill it is below min_energy, like sim_cls::step_electron, and return how long it lived. New electrons are added to secondaries
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    double start_time=electron.current_time;
+    double old_energy=electron.energy;
+    while(true)
+    {
+        double cos_theta=2*uniform(rand)-1;
+        double phi=2*PI*uniform(rand);
+        double sin_theta=std::sqrt(1-cos_theta*cos_theta);
+        double momentum=electron.momentum.norm();
+        electron.set_momentum(momentum*sin_theta*std::cos(phi), momentum*sin_theta*std::sin(phi), momentum*cos_theta);
+
+        old_energy=electron.energy;
+        force_engine.charged_particle_RungeKuttaDP(&electron);
+        electron.update_energy();
+        num_steps++;
+        if(electron.energy<min_energy)
+        {
+            //time when the energy crossed min_energy, in the last step
+            return electron.current_time - electron.timestep*(min_energy-electron.energy)/(old_energy-electron.energy) - start_time;
+        }
+
+        int interaction=-1;
+        double time_to_scatter;
+        while(true)
+        {
+            time_to_scatter=chooser.sample(old_energy, mom_to_KE(electron.interpolate_mom(0.5)), electron.energy, electron.timestep, interaction);
+            int error_code=chooser.get_error_flag();
+            if(error_code==2)
+            {
+                electron.reduce_timestep_to(electron.timestep*0.5);
+                electron.next_timestep*=0.5;
+                continue;
+            }
+            else if(error_code==1)
+            {
+                electron.next_timestep*=0.5;
+            }
+            break;
+        }
+
+        if(interaction==0 and time_to_scatter<=electron.timestep)
+        {
+            electron.reduce_timestep_to(time_to_scatter);
+            electron_T secondary;
+            if(moller.single_interaction(electron.energy, &electron, &secondary))
+            {
+                secondary.next_timestep=CSDA.initial_timestep(secondary.energy);
+                secondaries.push_back(secondary);
+            }
+            electron.next_timestep=CSDA.initial_timestep(electron.energy);
+            if(electron.energy<min_energy)
+            {
+                return electron.current_time-start_time;
+            }
+        }
+    }
+}
+
+int main()
+{
+    uniform_field E;
+    E.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E.set_maximum(INFINITY, INFINITY, INFINITY);
+    E.set_value(0, 0, -E_field);
+
+    uniform_field B;
+    B.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B.set_maximum(INFINITY, INFINITY, INFINITY);
+    B.set_value(0, 0, 0);
+
+    apply_charged_force force_engine(min_energy, &E, &B);
+    force_engine.set_max_timestep(max_timestep);
+    force_engine.set_errorTol(rel_tol);
+
+    CSDA_table CSDA(force_engine.ionization, min_energy, 1.0E5/energy_units_kev);
+    CSDA.set_timestep_prediction(E_field, 0, rel_tol, max_timestep);
+    electron_ionization_table full_ionization;
+    CSDA_table lifetime_CSDA(full_ionization, min_energy, 1.0E5/energy_units_kev);
+
+    moller_table moller(min_energy, 1.0E3/energy_units_kev, 200);
+    interaction_chooser_quadratic<1> chooser(moller);
+
+    bool good=check_threshold(CSDA, E_field);
+    good=check_threshold(CSDA, culling_margin*E_field) and good;
+
+    double culling_energy=CSDA.runaway_threshold(culling_margin*E_field);
+    const size_t N=10000;
+    mt19937_64 rand(1234);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    double followed_lifetime=0;
+    double secondary_lifetime=0;
+    size_t num_secondaries=0;
+    double CSDA_lifetime=0;
+    double removed_CSDA_lifetime=0;
+    size_t num_steps=0;
+    double follow_time=0;
+    double cull_time=0;
+    std::vector<electron_T> secondaries;
+    for(size_t i=0; i<N; i++)
+    {
+        double energy=min_energy*std::pow(culling_energy/min_energy, uniform(rand));
+
+        electron_T electron;
+        electron.set_momentum(0, 0, KE_to_mom(energy));
+        electron.update_energy();
+        electron.next_timestep=CSDA.initial_timestep(electron.energy);
+
+        clock_t start=clock();
+        followed_lifetime+=follow_electron(electron, force_engine, CSDA, moller, chooser, rand, secondaries, num_steps);
+        while(secondaries.size()>0)
+        {
+            electron_T secondary=secondaries.back();
+            secondaries.pop_back();
+            num_secondaries++;
+            secondary_lifetime+=follow_electron(secondary, force_engine, CSDA, moller, chooser, rand, secondaries, num_steps);
+        }
+        follow_time+=double(clock()-start)/CLOCKS_PER_SEC;
+
+        start=clock();
+        CSDA_lifetime+=lifetime_CSDA.stopping_time(energy)-lifetime_CSDA.stopping_time(min_energy);
+        cull_time+=double(clock()-start)/CLOCKS_PER_SEC;
+        removed_CSDA_lifetime+=CSDA.stopping_time(energy)-CSDA.stopping_time(min_energy);
+    }
+
+    double lifetime_error=CSDA_lifetime/followed_lifetime - 1.0;
+    print("culling below", culling_energy*energy_units_kev, "keV");
+    print("  followed:", followed_lifetime/N, "mean lifetime,", double(num_steps)/N, "steps per electron (with secondaries),", follow_time*1.0E9/N, "ns per electron");
+    print("  culled:  ", CSDA_lifetime/N, "mean lifetime,", cull_time*1.0E9/N, "ns per electron (mostly the clock)");
+    print("  gain: culling is", follow_time/std::max(cull_time, 1.0E-9), "times faster than following (at least, the clock is most of the culling time)");
+    print("  relative error in the total lifetime:", lifetime_error, "( tolerance", lifetime_tolerance, ")");
+    print("  with moller losses removed from the stopping power, the relative error would be", removed_CSDA_lifetime/followed_lifetime - 1.0);
+    print("  secondaries:", double(num_secondaries)/N, "per electron, living", secondary_lifetime/followed_lifetime,
+          "of the time of the primaries. Culling does not count these");
+    print("  bias: culled electrons count", (CSDA_lifetime-followed_lifetime-secondary_lifetime)/(followed_lifetime+secondary_lifetime),
+          "of the time that they and their secondaries live");
+    if(std::abs(lifetime_error)>lifetime_tolerance)
+    {
+        print("ERROR: CSDA time is not a good estimate of the lifetime");
+        good=false;
+    }
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <random>
+#include <ctime>
+#include <string>
+
+#include "gen_ex.hpp"
+#include "time_tree.hpp"
+#include "time_heap.hpp"
+#include "calendar_queue.hpp"
+
+using namespace std;
+
+//// compares time_tree, time_heap, and calendar_queue ////
+// Uses the "hold" model, which is what sim_cls::run does: pop the first particle, advance its time, and insert it again.
+// Each particle advances by a random timestep, with a spread of timesteps like the electrons have.
+
+class particle
+{
+public:
+    double time;
+};
+
+template<typename scheduler_T>
+void hold_benchmark(string name, size_t num_particles, size_t num_holds)
+{
+    std::mt19937_64 rand(1234);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    object_pool<particle> pool;
+    scheduler_T scheduler;
+    scheduler.set_pool(&pool);
+
+    for(size_t i=0; i<num_particles; i++)
+    {
+        double time=uniform(rand)*1.0E-3;
+        particle* P=scheduler.emplace(time);
+        P->time=time;
+    }
+
+    //check order, and warm up
+    double last_time=0;
+    for(size_t i=0; i<num_particles; i++)
+    {
+        particle* P=scheduler.pop_first();
+        if(P->time<last_time)
+        {
+            throw gen_exception(name, " is out of order");
+        }
+        last_time=P->time;
+        P->time+=1.0E-4*(0.1+uniform(rand));
+        scheduler.insert(P->time, P);
+    }
+
+    clock_t start=clock();
+    for(size_t i=0; i<num_holds; i++)
+    {
+        particle* P=scheduler.pop_first();
+        P->time+=1.0E-4*(0.1+uniform(rand));
+        scheduler.insert(P->time, P);
+    }
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+
+    cout<<"  "<<name<<": "<<time*1.0E9/num_holds<<" ns per step"<<endl;
+}
+
+int main()
+{
+    const size_t num_holds=2000000;
+    for(size_t num_particles=1000; num_particles<=10000000; num_particles*=10)
+    {
+        cout<<num_particles<<" particles"<<endl;
+        hold_benchmark< time_tree<particle> >("time_tree", num_particles, num_holds);
+        hold_benchmark< time_heap<particle> >("time_heap", num_particles, num_holds);
+        hold_benchmark< calendar_queue<particle> >("calendar_queue", num_particles, num_holds);
+    }
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#include "GSL_utils.hpp"
+#include "vector.hpp"
+#include "constants.hpp"
+#include "rand.hpp"
+
+#include "../physics/bethe_eq.hpp"
+#include "../physics/relativistic_formulas.hpp"
+
+using namespace std;
+
+//// speed and accuracy of electron_ionization_table lookups ////
+// Compares the per-bin cubics of electron_ionization_table::lookup to the power laws they replace (search_sorted_exponential and std::pow),
+// for accuracy and for speed, and checks that the batched lookup gives exactly the same stopping powers as the scalar one.
+// Momenta are random in log, over the table and a little outside it.
+
+double power_law_lookup(electron_ionization_table& table, double mom_sq)
+//the lookup inside the table before the cubics
+{
+    size_t index=search_sorted_exponential(table.table_mom_sq, mom_sq);
+    return table.interp_factors[index]*std::pow(mom_sq, table.interp_powers[index]);
+}
+
+int main()
+{
+    const int num_tests=10000000;
+    const int batch_size=64; //about what apply_charged_force uses
+
+    electron_ionization_table table(2.0/energy_units_kev);
+    double lower_val=table.table_mom_sq[0];
+    double upper_val=table.table_mom_sq[table.table_mom_sq.size()-1];
+
+    rand_gen gen(true);
+    vector<double> inside_mom_sq(num_tests);
+    vector<double> mom_sq(num_tests);
+    for(int i=0; i<num_tests; i++)
+    {
+        inside_mom_sq[i]=std::exp(gen.uniform(std::log(lower_val), std::log(upper_val)));
+        mom_sq[i]=std::exp(gen.uniform(std::log(lower_val)-1, std::log(upper_val)+1));
+    }
+    vector<double> stopping_power(num_tests);
+
+    //accuracy. The power laws are very steep below 0.04 keV, which is far below any energy that is followed
+    const double accurate_momentum=KE_to_mom(0.1/energy_units_kev);
+    const double accurate_mom_sq=accurate_momentum*accurate_momentum;
+    double max_error=0;
+    double max_low_error=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        double error=std::abs(table.lookup(inside_mom_sq[i])/power_law_lookup(table, inside_mom_sq[i]) - 1.0);
+        if(inside_mom_sq[i]>accurate_mom_sq)
+        {
+            max_error=std::max(max_error, error);
+        }
+        else
+        {
+            max_low_error=std::max(max_low_error, error);
+        }
+    }
+    print("largest relative difference from the power laws: above 0.1 keV", max_error, " below", max_low_error);
+
+    //timing
+    double sum=0;
+    clock_t start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=power_law_lookup(table, inside_mom_sq[i]);
+    }
+    double time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("power law lookup:", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    sum=0;
+    start=clock();
+    for(int i=0; i<num_tests; i++)
+    {
+        sum+=table.lookup(inside_mom_sq[i]);
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("cubic lookup:    ", time*1.0E9/num_tests, "ns   (", sum, ")");
+
+    start=clock();
+    for(int i=0; i<num_tests; i+=batch_size)
+    {
+        table.lookup(&inside_mom_sq[i], &stopping_power[i], std::min(batch_size, num_tests-i));
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("batched lookup:  ", time*1.0E9/num_tests, "ns");
+
+    start=clock();
+    for(int i=0; i<num_tests; i+=batch_size)
+    {
+        table.lookup(&mom_sq[i], &stopping_power[i], std::min(batch_size, num_tests-i));
+    }
+    time=double(clock()-start)/CLOCKS_PER_SEC;
+    print("batched lookup, some outside the table:", time*1.0E9/num_tests, "ns");
+
+    //batched needs to be the same as scalar, so the Runge-Kutta lanes match (see batched_RK_benchmark)
+    int num_different=0;
+    for(int i=0; i<num_tests; i++)
+    {
+        if(stopping_power[i]!=table.lookup(mom_sq[i])) num_different++;
+    }
+
+    bool good=true;
+    if(num_different>0)
+    {
+        print("ERROR:", num_different, "batched lookups differ from the scalar lookup");
+        good=false;
+    }
+    if(max_error>1.0E-5 or max_low_error>1.0E-3)
+    {
+        print("ERROR: cubics are too far from the power laws");
+        good=false;
+    }
+    return good ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include "gen_ex.hpp"
+#include "work_stealing_pool.hpp"
+
+#define LEHTINEN1999_NO_MAIN
+#include "../Lehtinen1999.cpp"
+
+using namespace std;
+
+//// speed-up of work_stealing_pool, and of sim_cls::run_parallel, with the number of threads ////
+// First a synthetic kernel: each task is a particle that is pushed through a uniform electric and magnetic field with friction (RK4), and then makes a
+// random number of secondaries, so the work is very uneven between the starting particles.
+// The random numbers of each particle come from its own seed, so the total work is the same for every number of threads, and the
+// number of particles and the total energy are checked against the run with one thread. Per-thread tallies are added at the end.
+// Then the real transport: a short run of Lehtinen1999 (sim_cls::run_parallel, with the shared moller_table, diffusion_table and force engine).
+// The IDs and random numbers of the electrons do not depend on the threads, so the number of electrons at each slab boundary must be the same as
+// with one thread, and the tallies the same up to the order of the additions. Needs the tables, so run from where Lehtinen1999 runs.
+
+class particle
+{
+public:
+    uint64_t seed;
+    int generation;
+    double momentum[3];
+};
+
+class tally
+{
+public:
+    size_t num_particles;
+    double total_energy;
+};
+
+const int max_generation=12;
+const int steps_per_particle=4000;
+
+void push_particle(particle& P)
+//RK4 in uniform E and B fields, with a friction that depends on momentum
+{
+    const double E[3]={0, 0, -2.0};
+    const double B[3]={0.3, 0, 0};
+    const double dt=1.0E-3;
+
+    auto force=[&](const double* p, double* F)
+    {
+        double p_sq=p[0]*p[0]+p[1]*p[1]+p[2]*p[2];
+        double inverse_gamma=1.0/sqrt(1.0+p_sq);
+        double friction=0.5/(p_sq+0.1);
+        double p_mag=sqrt(p_sq)+1.0E-30;
+        F[0]=-E[0] - inverse_gamma*(p[1]*B[2]-p[2]*B[1]) - friction*p[0]/p_mag;
+        F[1]=-E[1] - inverse_gamma*(p[2]*B[0]-p[0]*B[2]) - friction*p[1]/p_mag;
+        F[2]=-E[2] - inverse_gamma*(p[0]*B[1]-p[1]*B[0]) - friction*p[2]/p_mag;
+    };
+
+    double* p=P.momentum;
+    for(int step=0; step<steps_per_particle; step++)
+    {
+        double K1[3], K2[3], K3[3], K4[3], tmp[3];
+        force(p, K1);
+        for(int i=0; i<3; i++) tmp[i]=p[i]+0.5*dt*K1[i];
+        force(tmp, K2);
+        for(int i=0; i<3; i++) tmp[i]=p[i]+0.5*dt*K2[i];
+        force(tmp, K3);
+        for(int i=0; i<3; i++) tmp[i]=p[i]+dt*K3[i];
+        force(tmp, K4);
+        for(int i=0; i<3; i++) p[i]+=dt*(K1[i]+2*K2[i]+2*K3[i]+K4[i])/6.0;
+    }
+}
+
+tally run_benchmark(size_t num_threads, size_t num_seeds, double& time)
+{
+    std::vector<particle> seeds(num_seeds);
+    for(size_t i=0; i<num_seeds; i++)
+    {
+        seeds[i].seed=i+1;
+        seeds[i].generation=0;
+        seeds[i].momentum[0]=0;
+        seeds[i].momentum[1]=0;
+        seeds[i].momentum[2]=1.0;
+    }
+
+    std::vector<tally> tallies(num_threads);
+
+    work_stealing_pool<particle> pool;
+    auto start=chrono::steady_clock::now();
+    pool.run(seeds, num_threads,
+        [&](size_t worker_index)
+        {
+            tallies[worker_index].num_particles=0;
+            tallies[worker_index].total_energy=0;
+        },
+        [&](work_stealing_pool<particle>::worker& W, particle& P)
+        {
+            push_particle(P);
+
+            tally& T=tallies[W.get_index()];
+            T.num_particles++;
+            T.total_energy+=sqrt(1.0 + P.momentum[0]*P.momentum[0] + P.momentum[1]*P.momentum[1] + P.momentum[2]*P.momentum[2]) - 1.0;
+
+            if(P.generation==max_generation) return;
+
+            mt19937_64 rand(P.seed);
+            uniform_int_distribution<int> num_secondaries(0, 3);
+            int N=num_secondaries(rand);
+            for(int i=0; i<N; i++)
+            {
+                particle secondary;
+                secondary.seed=rand();
+                secondary.generation=P.generation+1;
+                secondary.momentum[0]=P.momentum[0]*0.5;
+                secondary.momentum[1]=P.momentum[1]*0.5;
+                secondary.momentum[2]=P.momentum[2]*0.5 + 0.1*i;
+                W.push(secondary);
+            }
+        } );
+    time=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+    tally total={0, 0};
+    for(tally& T : tallies)
+    {
+        total.num_particles+=T.num_particles;
+        total.total_energy+=T.total_energy;
+    }
+
+    size_t num_stolen=0;
+    for(size_t i=0; i<num_threads; i++)
+    {
+        num_stolen+=pool.get_worker(i).num_stolen;
+    }
+    cout<<"    stolen: "<<num_stolen<<endl;
+
+    return total;
+}
+
+//// Lehtinen1999 ////
+const double transport_max_t=0.05;
+const int transport_seeds=100;
+const double transport_slab=0.01;
+
+double run_transport(sim_cls& simulation, size_t num_threads, std::vector<double>& num_electrons, double& total_count)
+//returns the time of run_parallel. num_electrons is the number of electrons at each slab boundary, and total_count is the sum of the tally
+{
+    //same IDs and slab seeds every run
+    ID_allocator::restart();
+    gsl_rng_set(simulation.parallel_seeds.rand_, 1);
+    simulation.reset(transport_max_t, 8.0, 0.0);
+    simulation.setup(transport_seeds);
+
+    auto start=chrono::steady_clock::now();
+    simulation.run_parallel(transport_slab, num_threads);
+    double time=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+    num_electrons.assign(simulation.slab_history.num_electrons.begin(), simulation.slab_history.num_electrons.end());
+    total_count=0;
+    for(size_t i=0; i<simulation.histogramer.n_particles.size(); i++)
+    {
+        total_count+=simulation.histogramer.n_particles[i];
+    }
+    return time;
+}
+
+std::vector<size_t> thread_counts(size_t max_threads)
+//2, 4, 8... up to max_threads, then max_threads if it is not a power of two
+{
+    std::vector<size_t> counts;
+    for(size_t num_threads=2; num_threads<=max_threads; num_threads*=2)
+    {
+        counts.push_back(num_threads);
+    }
+    if(max_threads>1 and counts.back()!=max_threads)
+    {
+        counts.push_back(max_threads);
+    }
+    return counts;
+}
+
+int main()
+{
+    size_t max_threads=thread::hardware_concurrency();
+    if(max_threads==0) max_threads=1;
+    const size_t num_seeds=16;
+
+    cout<<"synthetic kernel"<<endl;
+    double serial_time;
+    tally serial=run_benchmark(1, num_seeds, serial_time);
+    cout<<"1 thread: "<<serial.num_particles<<" particles, "<<serial_time<<" s"<<endl;
+
+    for(size_t num_threads : thread_counts(max_threads))
+    {
+        double time;
+        tally result=run_benchmark(num_threads, num_seeds, time);
+
+        if(result.num_particles!=serial.num_particles or abs(result.total_energy-serial.total_energy)>1.0E-9*abs(serial.total_energy))
+        {
+            throw gen_exception("results with ", num_threads, " threads do not match one thread");
+        }
+
+        double speedup=serial_time/time;
+        cout<<num_threads<<" threads: "<<time<<" s. speed-up: "<<speedup<<" efficiency: "<<speedup/num_threads<<endl;
+    }
+
+    cout<<endl<<"Lehtinen1999 transport"<<endl;
+    sim_cls simulation(transport_max_t, 8.0, 0.0);
+    std::vector<double> serial_electrons;
+    double serial_count;
+    serial_time=run_transport(simulation, 1, serial_electrons, serial_count);
+    cout<<"1 thread: "<<serial_electrons.back()<<" electrons at the end, "<<serial_time<<" s"<<endl;
+
+    for(size_t num_threads : thread_counts(max_threads))
+    {
+        std::vector<double> num_electrons;
+        double count;
+        double time=run_transport(simulation, num_threads, num_electrons, count);
+
+        if(num_electrons!=serial_electrons or abs(count-serial_count)>1.0E-9*abs(serial_count))
+        {
+            throw gen_exception("transport with ", num_threads, " threads does not match one thread");
+        }
+
+        double speedup=serial_time/time;
+        cout<<num_threads<<" threads: "<<time<<" s. speed-up: "<<speedup<<" efficiency: "<<speedup/num_threads<<endl;
+    }
+}
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <string>
+
+#include "vector.hpp"
+
+#include "GSL_utils.hpp"
+#include "constants.hpp"
+#include "vec3.hpp"
+
+#include "../physics/particles.hpp"
+#include "../physics/quasi_static_fields.hpp"
+#include "../physics/relativistic_formulas.hpp"
+#include "../physics/apply_force.hpp"
+
+using namespace std;
+
+//// cross-checks apply_charged_force::charged_particle_guiding_centre_step against charged_particle_RungeKuttaDP ////
+// An electron is followed for a fixed time in an electric field, in electric and magnetic fields, and in strong magnetic fields. The reference is the
+// Runge-Kutta with a very small tolerance. For a few tolerances (rel_tol of the Runge-Kutta, and the momentum tolerance of the guiding centre),
+// prints the number of steps, the run time, and the errors in energy and position at the end. The last step is shortened to end exactly at the
+// end time. The guiding centre should need far fewer steps than the Runge-Kutta in the strong magnetic fields.
+
+class result
+{
+public:
+    size_t num_steps;
+    double time;
+    vec3 position;
+    vec3 momentum;
+};
+
+enum step_method {RUNGE_KUTTA, GUIDING_CENTRE};
+
+result follow(apply_charged_force& force_engine, step_method method, double end_time, double energy)
+{
+    electron_T electron;
+    electron.set_position(0, 0, 0);
+    electron.set_momentum(0, KE_to_mom(energy)*0.6, KE_to_mom(energy)*0.8);
+    electron.update_energy();
+    electron.timestep=1.0E-4;
+    electron.next_timestep=1.0E-4;
+    electron.keep_interpolant=false;
+
+    result out;
+    out.num_steps=0;
+    clock_t start=clock();
+    while(electron.current_time<end_time)
+    {
+        electron.next_timestep=min(electron.next_timestep, end_time-electron.current_time); //finish exactly at end_time
+        if(method==GUIDING_CENTRE)
+        {
+            force_engine.charged_particle_guiding_centre_step(&electron);
+        }
+        else
+        {
+            force_engine.charged_particle_RungeKuttaDP(&electron);
+        }
+        out.num_steps++;
+    }
+    out.time=double(clock()-start)/CLOCKS_PER_SEC;
+    out.position=electron.position;
+    out.momentum=electron.momentum;
+    return out;
+}
+
+void compare(string name, uniform_field& E_field, uniform_field& B_field, double end_time, double energy)
+{
+    apply_charged_force force_engine(&E_field, &B_field);
+    force_engine.set_max_timestep(1.0);
+
+    force_engine.set_errorTol(1.0E-10);
+    result reference=follow(force_engine, RUNGE_KUTTA, end_time, energy);
+    double reference_energy=mom_to_KE(reference.momentum);
+    double distance=reference.position.norm();
+    print(name, ": final energy", reference_energy*energy_units_kev, "keV, distance travelled", distance);
+
+    for(double tolerance=1.0E-2; tolerance>1.0E-7; tolerance*=0.1)
+    {
+        force_engine.set_errorTol(tolerance);
+        result RK=follow(force_engine, RUNGE_KUTTA, end_time, energy);
+        print("  Runge-Kutta, rel_tol", tolerance, ":", RK.num_steps, "steps", RK.time*1.0E6/RK.num_steps, "us per step.   relative error in energy:",
+              abs(mom_to_KE(RK.momentum)-reference_energy)/reference_energy, "in position:", (RK.position-reference.position).norm()/distance);
+    }
+
+    vec3 E=E_field.get(vec3(0,0,0), 0);
+    vec3 B=B_field.get(vec3(0,0,0), 0);
+
+    //the guiding centre needs a magnetic field, and a slow ExB drift
+    if(B.sum_of_squares()==0 or cross(E, B).norm()/B.sum_of_squares()>0.1) return;
+    for(double tolerance=0.3; tolerance>1.0E-3; tolerance*=0.1)
+    {
+        force_engine.set_guiding_centre(0, 0.1, tolerance);
+        result guiding_centre=follow(force_engine, GUIDING_CENTRE, end_time, energy);
+        print("  guiding centre, momentum_tol", tolerance, ":", guiding_centre.num_steps, "steps", guiding_centre.time*1.0E6/guiding_centre.num_steps, "us per step.   relative error in energy:",
+              abs(mom_to_KE(guiding_centre.momentum)-reference_energy)/reference_energy, "in position:", (guiding_centre.position-reference.position).norm()/distance);
+    }
+}
+
+int main()
+{
+    const double Ez=-(1.7E6)/E_field_units; //about the field in Lehtinen1999
+    const double By=-0.5*Ez;
+    const double energy=1000.0/energy_units_kev;
+
+    uniform_field E_field;
+    E_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    E_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    E_field.set_value(0, 0, Ez);
+
+    uniform_field B_field;
+    B_field.set_minimum(-INFINITY, -INFINITY, -INFINITY);
+    B_field.set_maximum(INFINITY, INFINITY, INFINITY);
+    B_field.set_value(0, 0, 0);
+
+    compare("electric field", E_field, B_field, 0.3, energy);
+
+    B_field.set_value(0, By, 0);
+    compare("electric and magnetic field", E_field, B_field, 0.3, energy);
+
+    E_field.set_value(0, 0, 0);
+    B_field.set_value(0, -20*Ez, 0);
+    compare("strong magnetic field", E_field, B_field, 0.3, 10*energy);
+    E_field.set_value(0, 0, Ez);
+    compare("strong magnetic field, electric field", E_field, B_field, 0.05, 10*energy);
+    E_field.set_value(0, Ez, 0);
+    compare("strong magnetic field, parallel electric field", E_field, B_field, 0.05, 10*energy);
+}
@@ -0,0 +1,171 @@
+#ifndef CSDA_TABLE_HPP
+#define CSDA_TABLE_HPP
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "constants.hpp"
+#include "gen_ex.hpp"
+
+#include "bethe_eq.hpp"
+#include "relativistic_formulas.hpp"
+
+//// continuous-slowing-down approximation (CSDA) of electrons ////
+// Tables, on an even grid in log(energy), of the stopping power (which is the energy lost per distance, in the dimensionless units), the energy lost
+// per time, the CSDA range (distance to slow from an energy down to lowest_energy), and the CSDA time (time to do so, without fields).
+// The stopping power is from ionization_table::lookup, so the table needs to have a constant minimum energy, or not remove moller losses.
+//
+// set_timestep_prediction also tabulates a first timestep for electrons that are new or were just scattered, from their energy and the field magnitudes,
+// so they do not start from whatever timestep they had before. It is the smaller of:
+//   the Runge-Kutta step: 1.6*rel_tol^(1/5) * p/(friction + |E| + beta*|B|), which is about the largest step that the Dormand-Prince accepts
+//      the first time (see algorithm_tests/initial_timestep_benchmark.cpp),
+//   the interaction step: the time to change the energy by energy_fraction, which keeps the change in interaction rates within the error bounds
+//      of interaction_chooser_quadratic,
+//   and the maximum timestep.
+//
+// runaway_threshold is the energy below which friction is larger than an electric force at every energy. Electrons below it can only lose energy, so
+// they can be removed early, counting the rest of their life as the CSDA time (of a table that does not remove moller losses, so that it includes the
+// mean energy lost to moller scattering). Low energy electrons scatter so often that their direction is about random, so the work done by the field
+// averages out (see sim_cls::cull_electron in Lehtinen1999.cpp, and algorithm_tests/runaway_culling_benchmark.cpp).
+
+class CSDA_table
+{
+public:
+    double lowest_energy;
+    double highest_energy;
+    double log_lowest_energy;
+    double inverse_log_step;
+
+    std::vector<double> energies;
+    std::vector<double> stopping_powers; //friction, energy lost per distance
+    std::vector<double> loss_rates; //energy lost per time
+    std::vector<double> ranges; //distance to slow down to lowest_energy
+    std::vector<double> stopping_times; //time to slow down to lowest_energy
+    std::vector<double> timesteps; //see set_timestep_prediction
+    size_t minimum_index; //of the smallest stopping power. The stopping power decreases with energy below it
+
+    template<typename species_T>
+    CSDA_table(ionization_table<species_T>& ionization, double lowest_energy_, double highest_energy_, size_t num_points=400)
+    //energies are dimensionless kinetic energies
+    {
+        if(lowest_energy_<=0 or highest_energy_<=lowest_energy_ or num_points<2)
+        {
+            throw gen_exception("CSDA_table needs 0<lowest_energy<highest_energy, and at least two points");
+        }
+
+        lowest_energy=lowest_energy_;
+        highest_energy=highest_energy_;
+        log_lowest_energy=std::log(lowest_energy);
+        double log_step=(std::log(highest_energy)-log_lowest_energy)/(num_points-1);
+        inverse_log_step=1.0/log_step;
+
+        energies.resize(num_points);
+        stopping_powers.resize(num_points);
+        loss_rates.resize(num_points);
+        for(size_t i=0; i<num_points; i++)
+        {
+            double energy= i==num_points-1 ? highest_energy : std::exp(log_lowest_energy + i*log_step);
+            double momentum=KE_to_mom(energy);
+            energies[i]=energy;
+            stopping_powers[i]=std::max(ionization.lookup(momentum*momentum), 0.0);
+            loss_rates[i]=stopping_powers[i]*momentum/(energy+1);
+        }
+
+        //trapezoid rule in log(energy), where dE=E*dlog(E)
+        ranges.resize(num_points);
+        stopping_times.resize(num_points);
+        ranges[0]=0;
+        stopping_times[0]=0;
+        for(size_t i=1; i<num_points; i++)
+        {
+            ranges[i]=ranges[i-1] + 0.5*log_step*( energies[i-1]/stopping_powers[i-1] + energies[i]/stopping_powers[i] );
+            stopping_times[i]=stopping_times[i-1] + 0.5*log_step*( energies[i-1]/loss_rates[i-1] + energies[i]/loss_rates[i] );
+        }
+
+        timesteps.assign(num_points, INFINITY);
+        minimum_index=std::min_element(stopping_powers.begin(), stopping_powers.end()) - stopping_powers.begin();
+    }
+
+    void set_timestep_prediction(double E_field_magnitude, double B_field_magnitude, double rel_tol, double max_timestep, double energy_fraction=0.03)
+    //tabulate the first timestep of new electrons, see above. rel_tol is the relative error tolerance of the Runge-Kutta
+    {
+        double RK_fraction=1.6*std::pow(rel_tol, 0.2);
+        for(size_t i=0; i<energies.size(); i++)
+        {
+            double momentum=KE_to_mom(energies[i]);
+            double beta=momentum/(energies[i]+1);
+
+            double RK_timestep=RK_fraction*momentum/(stopping_powers[i] + E_field_magnitude + beta*B_field_magnitude);
+            double interaction_timestep=energy_fraction*energies[i]/(beta*(stopping_powers[i] + E_field_magnitude));
+            timesteps[i]=std::min(max_timestep, std::min(RK_timestep, interaction_timestep));
+        }
+    }
+
+    double runaway_threshold(double electric_force)
+    //lowest energy where the stopping power is electric_force. If electric_force is less than the smallest stopping power, no electron can run away,
+    //and this is the energy of the smallest stopping power. Is lowest_energy if electric_force is larger than the stopping power at lowest_energy
+    {
+        if(electric_force>=stopping_powers[0]) return lowest_energy;
+        if(electric_force<=stopping_powers[minimum_index]) return energies[minimum_index];
+
+        //stopping_powers[low] > electric_force >= stopping_powers[high]
+        size_t low=0;
+        size_t high=minimum_index;
+        while(high-low>1)
+        {
+            size_t middle=(low+high)/2;
+            if(stopping_powers[middle]>electric_force)
+            {
+                low=middle;
+            }
+            else
+            {
+                high=middle;
+            }
+        }
+
+        double weight=(stopping_powers[low]-electric_force)/(stopping_powers[low]-stopping_powers[high]);
+        return energies[low]*std::pow(energies[high]/energies[low], weight);
+    }
+
+    inline double interpolate(const std::vector<double>& table, double energy)
+    //linear in log(energy). Constant outside the table
+    {
+        double F=(std::log(energy)-log_lowest_energy)*inverse_log_step;
+        if(not (F>0)) return table.front();
+        size_t index=size_t(F);
+        if(index>=table.size()-1) return table.back();
+
+        double weight=F-index;
+        return table[index] + weight*(table[index+1]-table[index]);
+    }
+
+    inline double stopping_power(double energy)
+    {
+        return interpolate(stopping_powers, energy);
+    }
+
+    inline double loss_rate(double energy)
+    {
+        return interpolate(loss_rates, energy);
+    }
+
+    inline double range(double energy)
+    {
+        return interpolate(ranges, energy);
+    }
+
+    inline double stopping_time(double energy)
+    {
+        return interpolate(stopping_times, energy);
+    }
+
+    inline double initial_timestep(double energy)
+    //first timestep for an electron at energy. Needs set_timestep_prediction
+    {
+        return interpolate(timesteps, energy);
+    }
+};
+
+#endif
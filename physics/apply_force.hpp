@@ -2,43 +2,85 @@
 #ifndef APPLY_FORCE_HPP
 #define APPLY_FORCE_HPP
 
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
 #include "vector.hpp"
 
+#include "vec3.hpp"
 #include "GSL_utils.hpp"
 #include "constants.hpp"
 
 #include "particles.hpp"
+#include "electron_store.hpp"
 #include "quasi_static_fields.hpp"
+#include "atmosphere.hpp"
 #include "bethe_eq.hpp"
 
-class apply_charged_force
+//// classical forces on charged particles ////
+// Templated on the types of the electric and magnetic fields, which are looked up with their non-virtual evaluate and evaluate_batch
+// (see quasi_static_fields.hpp), so the field look-ups in the Runge-Kutta stages can be inlined. apply_charged_force, below, works with any field
+// through the virtual functions.
+// Also templated on the species of the particles, electron_species or positron_species (see bethe_eq.hpp), which picks the stopping power table.
+// One force engine steps one species, so the stopping power is looked up without checking the charge. Stepping a particle of the other species throws.
+
+template<typename E_field_T, typename B_field_T, typename species_T=electron_species>
+class apply_charged_force_fields
 {
     public:
 
-    electron_ionization_table electron_table;
-    field* E_field; //do not own these two fields
-    field* B_field;
-    unsigned int remove_moller; //0 for not remove moller, 1 for constant_min_energy , 2 for variable min energy
+    ionization_table<species_T> ionization;
+    E_field_T* E_field; //do not own these two fields
+    B_field_T* B_field;
+    unsigned int remove_moller; //0 for not remove moller (or bhabha), 1 for constant_min_energy , 2 for variable min energy
     double min_energy;
+    removal_energy_T min_energy_removal; //min_energy, for ionization.lookup_variable_RML
 
     //runge kutta variables
     double maximum_timestep;
 
     double kappa;
     double rel_tol;
+
+    //step size controller, see set_step_controller
+    double PI_alpha;
+    double PI_beta;
+    double min_step_factor;
+    double max_step_factor;
+
+    //number of Runge-Kutta steps since reset_step_counters. Atomic, since many threads can share the force engine
+    std::atomic<size_t> num_accepted_steps;
+    std::atomic<size_t> num_rejected_steps;
+
+    //guiding centre variables, see charged_particle_guiding_centre_step
+    double guiding_centre_gyrations;
+    double guiding_centre_drift_speed;
+    double guiding_centre_momentum_tol;
+
+    //air density, see set_atmosphere
+    density_profile* atmosphere; //do not own
+    double max_density_change;
     //double pos_tol;
     //double mom_tol;
 
-    apply_charged_force(double const_min_energy_dimensionless, field* E_field_, field* B_field_) : electron_table(const_min_energy_dimensionless, true)
+    electron_T working_electron; //for electrons in an electron_store
+
+    apply_charged_force_fields(double const_min_energy_dimensionless, E_field_T* E_field_, B_field_T* B_field_) : ionization(const_min_energy_dimensionless, true)
     //use this constructor if the minimum_energy is constant
     {
         E_field=E_field_;
         B_field=B_field_;
         remove_moller=1;
         min_energy=const_min_energy_dimensionless;
+        min_energy_removal=ionization.removal_energy(min_energy);
+        set_guiding_centre(0);
+        set_step_controller();
+        reset_step_counters();
+        atmosphere=nullptr;
     }
 
-    apply_charged_force(field* E_field_, field* B_field_, bool do_moller=false) : electron_table()
+    apply_charged_force_fields(E_field_T* E_field_, B_field_T* B_field_, bool do_moller=false) : ionization()
     //use this constructor if the minimum_energy is variable or not doing moller scattering
     {
         E_field=E_field_;
@@ -52,12 +94,33 @@ class apply_charged_force
             remove_moller=0;
         }
         min_energy=lowest_physical_energy;
+        min_energy_removal=ionization.removal_energy(min_energy);
+        set_guiding_centre(0);
+        set_step_controller();
+        reset_step_counters();
+        atmosphere=nullptr;
     }
 
     void set_min_energy(double min_energy_)
     //set min energy. Only usefull if min_energy is variable
     {
         min_energy=min_energy_;
+        min_energy_removal=ionization.removal_energy(min_energy);
+    }
+
+    void make_loss_table(double lowest_min_energy, double highest_min_energy, std::string fname="")
+    //tabulate moller (or bhabha) losses for min energies in this range, so that a variable min energy is as fast as a constant one (see ionization_table).
+    //If fname is given, the table is loaded from it if it exists and matches, else it is made and saved there
+    {
+        if(fname.size()==0 or not ionization.load_loss_table(fname))
+        {
+            ionization.make_loss_table(lowest_min_energy, highest_min_energy);
+            if(fname.size()>0)
+            {
+                ionization.save_loss_table(fname);
+            }
+        }
+        min_energy_removal=ionization.removal_energy(min_energy);
     }
 
 
@@ -79,41 +142,136 @@ class apply_charged_force
         kappa=kappa_;
     }
 
-    gsl::vector force(gsl::vector &position, gsl::vector &momentum, double time, int charge)
+    void set_step_controller(double beta=0.04, double min_factor=0.2, double max_factor=10.0)
+    //PI (Gustafsson) step size control of charged_particle_RungeKuttaDP. With error the estimated error relative to rel_tol, an accepted step
+    //multiplies the timestep by kappa*error^(-alpha)*last_error^beta, where alpha=0.2-0.75*beta and last_error is the error of the previous
+    //accepted step of the same particle. The factor is kept between min_factor and max_factor, and is not more than one right after a
+    //rejection. A rejected step multiplies the timestep by max(min_factor, kappa*error^(-0.2)). beta=0 is the old I controller
+    {
+        PI_beta=beta;
+        PI_alpha=0.2-0.75*beta;
+        min_step_factor=min_factor;
+        max_step_factor=max_factor;
+    }
+
+    inline double accepted_step_factor(double error, double last_error, bool after_rejection)
+    {
+        double factor=kappa*std::pow(error, -PI_alpha)*std::pow(last_error, PI_beta);
+        factor=std::min(max_step_factor, std::max(min_step_factor, factor));
+        if(after_rejection and factor>1)
+        {
+            factor=1;
+        }
+        return factor;
+    }
+
+    inline double rejected_step_factor(double error)
+    {
+        return std::max(min_step_factor, kappa*std::pow(error, -0.2));
+    }
+
+    void reset_step_counters()
+    {
+        num_accepted_steps=0;
+        num_rejected_steps=0;
+    }
+
+    void print_step_stats()
+    {
+        size_t accepted=num_accepted_steps.load();
+        size_t rejected=num_rejected_steps.load();
+        print("Runge-Kutta steps:", accepted, "accepted", rejected, "rejected (", (100.0*rejected)/std::max(accepted+rejected, size_t(1)), "% )");
+    }
+
+    void set_guiding_centre(double min_gyrations, double max_drift_speed=0.1, double momentum_tol=0.1)
+    //let charged_particle_step use charged_particle_guiding_centre_step when a step spans at least min_gyrations gyrations, and the ExB drift is
+    //slower than max_drift_speed (in units of c). min_gyrations=0 turns the guiding centre off, which is the default. momentum_tol is the largest
+    //relative change of the momentum in one guiding centre step
+    {
+        guiding_centre_gyrations=min_gyrations;
+        guiding_centre_drift_speed=max_drift_speed;
+        guiding_centre_momentum_tol=momentum_tol;
+    }
+
+    void set_atmosphere(density_profile* atmosphere_, double max_density_change_=0.05)
+    //scale the stopping power by the air density at the position of the particle. The timestep is limited so that the density changes by less than
+    //max_density_change (relative) in one step. nullptr is sea level density everywhere, which is the default
+    {
+        atmosphere=atmosphere_;
+        max_density_change=max_density_change_;
+    }
+
+    inline double density_ratio(const vec3& position)
+    //air density at position, relative to sea level
+    {
+        if(atmosphere)
+        {
+            return atmosphere->density_ratio(position[2]);
+        }
+        return 1.0;
+    }
+
+    inline double density_timestep(const vec3& position, const vec3& momentum)
+    //largest timestep for which the density changes by less than max_density_change
+    {
+        if(not atmosphere or momentum[2]==0)
+        {
+            return INFINITY;
+        }
+        double vertical_speed=std::abs(momentum[2])/gamma(momentum);
+        return max_density_change*atmosphere->scale_height(position[2])/vertical_speed;
+    }
+
+    inline void check_species(int charge)
+    //the stopping power is for species_T only
+    {
+        if(charge!=species_T::charge)
+        {
+            throw gen_exception("particle is not the species of the force engine");
+        }
+    }
+
+    double ionization_friction(double momentum_squared)
+    //stopping power of species_T. Can be negative, which should be ignored
+    {
+        double friction=-1;
+        if(remove_moller==0 or remove_moller==1) //if not removing moller losses, or constant min_energy
+        {
+            friction=ionization.lookup(momentum_squared);
+        }
+        else if(remove_moller==2) //variable min energy
+        {
+            friction=ionization.lookup_variable_RML(momentum_squared, min_energy_removal);
+        }
+        return friction;
+    }
+
+    vec3 force(const vec3& position, const vec3& momentum, double time, int charge)
     {
         //values
         double momentum_squared=momentum.sum_of_squares();
-        double momentum_magnitude=sqrt(momentum_squared);
+        double momentum_magnitude=std::sqrt(momentum_squared);
         double G=gamma(momentum_squared);
         double inverse_gamma=1.0/G;
 
         //electric field
-        gsl::vector force=charge*E_field->get(position, time);
+        vec3 force;
+        E_field->evaluate(position, time, force);
+        force*=charge;
 
         //magnetic field
-        gsl::vector B=charge*B_field->get(position, time);
+        vec3 B;
+        B_field->evaluate(position, time, B);
+        B*=charge;
         force[0]+=inverse_gamma*(momentum[1]*B[2]-momentum[2]*B[1]);
         force[1]+=inverse_gamma*(momentum[2]*B[0]-momentum[0]*B[2]);
         force[2]+=inverse_gamma*(momentum[0]*B[1]-momentum[1]*B[0]);
 
         //ionization friction
-        double friction=-1;
-        if(charge==-1)
+        double friction=ionization_friction(momentum_squared);
+        if(atmosphere)
         {
-            if(remove_moller==0 or remove_moller==1) //if not removing moller losses, or constant min_energy
-            {
-                friction=electron_table.electron_lookup(momentum_squared);
-            }
-            else if(remove_moller==2) //variable min energy
-            {
-                friction=electron_table.electron_lookup_variable_RML(momentum_squared, min_energy);
-            }
-        }
-        else
-        {
-            throw gen_exception("positrons not implemented");
-            ////positrons not implemented
-            //friction=ionization.positron_lookup(momentum_squared);
+            friction*=atmosphere->density_ratio(position[2]);
         }
 
         //friction*=0.2;
@@ -136,19 +294,11 @@ class apply_charged_force
     void charged_particle_RungeKuttaDP(electron_T *particle)
     // run Dormand-Prince Runge-Kutta with continuous extension, does not rely on the FSAL property
     {
-        if(particle->pos_K_interpolant.size()==0)
-        //need to initialize particle
-        {
-            particle->pos_K_interpolant.reserve(8);
-            particle->mom_K_interpolant.reserve(8);
-
-            for(int i=0; i<8; i++)
-            {
-                particle->pos_K_interpolant.push_back(gsl::vector({0,0,0}));
-                particle->mom_K_interpolant.push_back(gsl::vector({0,0,0}));
-            }
-        }
+        check_species(particle->charge);
 
+        //the first stage does not depend on the timestep, so is found once for all tries
+        const vec3 K_1_pos_rate=particle->momentum*(1.0/gamma(particle->momentum));
+        const vec3 K_1_mom_rate=force(particle->position, particle->momentum, particle->current_time, particle->charge);
 
         bool acceptable=false;
         //print("run:", particle.next_timestep);//(sqrt(particle.momentum.sum_of_squares()+1)-1)*510);
@@ -162,19 +312,21 @@ class apply_charged_force
             {
                 particle->timestep=maximum_timestep;
             }
+            if(atmosphere)
+            {
+                particle->timestep=std::min(particle->timestep, density_timestep(particle->position, particle->momentum));
+            }
             if(particle->timestep != particle->timestep)
             {
                 throw gen_exception("timestep is Nan");
             }
 
-            gsl::vector pos_step=particle->position;
-            gsl::vector mom_step=particle->momentum;
+            vec3 pos_step=particle->position;
+            vec3 mom_step=particle->momentum;
             double time=particle->current_time;
 
-            gsl::vector K_1_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_1_mom=force(pos_step, mom_step, time, particle->charge); //note that this is a bit redundant. We could calculate this once at the beginning. It doesn't change if stepsize changes
-            K_1_pos*=particle->timestep;
-            K_1_mom*=particle->timestep;
+            vec3 K_1_pos=K_1_pos_rate*particle->timestep;
+            vec3 K_1_mom=K_1_mom_rate*particle->timestep;
 
 
 
@@ -184,8 +336,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep*(1.0/5.0);
 
-            gsl::vector K_2_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_2_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_2_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_2_mom=force(pos_step, mom_step, time, particle->charge);
             K_2_pos*=particle->timestep;
             K_2_mom*=particle->timestep;
 
@@ -201,8 +353,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep*3.0/10.0;
 
-            gsl::vector K_3_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_3_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_3_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_3_mom=force(pos_step, mom_step, time, particle->charge);
             K_3_pos*=particle->timestep;
             K_3_mom*=particle->timestep;
 
@@ -222,8 +374,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep*(4.0/5.0);
 
-            gsl::vector K_4_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_4_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_4_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_4_mom=force(pos_step, mom_step, time, particle->charge);
             K_4_pos*=particle->timestep;
             K_4_mom*=particle->timestep;
 
@@ -246,8 +398,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep*8.0/9.0;
 
-            gsl::vector K_5_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_5_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_5_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_5_mom=force(pos_step, mom_step, time, particle->charge);
             K_5_pos*=particle->timestep;
             K_5_mom*=particle->timestep;
 
@@ -273,8 +425,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep;
 
-            gsl::vector K_6_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_6_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_6_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_6_mom=force(pos_step, mom_step, time, particle->charge);
             K_6_pos*=particle->timestep;
             K_6_mom*=particle->timestep;
 
@@ -303,8 +455,8 @@ class apply_charged_force
             mom_step+=particle->momentum;
             time=particle->current_time + particle->timestep;
 
-            gsl::vector K_7_pos=mom_step*(1.0/gamma(mom_step));
-            gsl::vector K_7_mom=force(pos_step, mom_step, time, particle->charge);
+            vec3 K_7_pos=mom_step*(1.0/gamma(mom_step));
+            vec3 K_7_mom=force(pos_step, mom_step, time, particle->charge);
             K_7_pos*=particle->timestep;
             K_7_mom*=particle->timestep;
 
@@ -312,8 +464,8 @@ class apply_charged_force
 
 
 
-            gsl::vector pos_O4=K_1_pos*(5179.0/57600.0);
-            gsl::vector mom_O4=K_1_mom*(5179.0/57600.0);
+            vec3 pos_O4=K_1_pos*(5179.0/57600.0);
+            vec3 mom_O4=K_1_mom*(5179.0/57600.0);
 
             //pos_O4.mult_add( K_2_pos, 0.0 );
             //mom_O4.mult_add( K_2_mom, 0.0 );
@@ -338,8 +490,8 @@ class apply_charged_force
 
 
 
-            gsl::vector pos_O5=K_1_pos*(35.0/384.0);
-            gsl::vector mom_O5=K_1_mom*(35.0/384.0);
+            vec3 pos_O5=K_1_pos*(35.0/384.0);
+            vec3 mom_O5=K_1_mom*(35.0/384.0);
 
             //pos_O5.mult_add( K_2_pos, 0.0 );
             //mom_O5.mult_add( K_2_mom, 0.0 );
@@ -384,32 +536,21 @@ class apply_charged_force
             if(err_f>1)//error is good, exit
             {
                 //set timestep
-                particle->interpolant_timestep=particle->timestep;
-                particle->next_timestep=particle->timestep*kappa*std::pow( std::sqrt(err_f), 0.25);
-
-                particle->pos_K_interpolant[0]=particle->position;
-                particle->mom_K_interpolant[0]=particle->momentum;
-
-                particle->pos_K_interpolant[1]=K_1_pos;
-                particle->mom_K_interpolant[1]=K_1_mom;
-
-                particle->pos_K_interpolant[2]=K_2_pos;
-                particle->mom_K_interpolant[2]=K_2_mom;
-
-                particle->pos_K_interpolant[3]=K_3_pos;
-                particle->mom_K_interpolant[3]=K_3_mom;
-
-                particle->pos_K_interpolant[4]=K_4_pos;
-                particle->mom_K_interpolant[4]=K_4_mom;
+                double error=1.0/std::sqrt(err_f);
+                particle->next_timestep=particle->timestep*accepted_step_factor(error, particle->last_step_error, N>1);
+                particle->last_step_error=std::max(error, 1.0E-4);
+                num_accepted_steps.fetch_add(1, std::memory_order_relaxed);
 
-                particle->pos_K_interpolant[5]=K_5_pos;
-                particle->mom_K_interpolant[5]=K_5_mom;
-
-                particle->pos_K_interpolant[6]=K_6_pos;
-                particle->mom_K_interpolant[6]=K_6_mom;
-
-                particle->pos_K_interpolant[7]=K_7_pos;
-                particle->mom_K_interpolant[7]=K_7_mom;
+                if(particle->keep_interpolant)
+                {
+                    const vec3 K_pos[5]={K_1_pos, K_3_pos, K_4_pos, K_5_pos, K_6_pos};
+                    const vec3 K_mom[5]={K_1_mom, K_3_mom, K_4_mom, K_5_mom, K_6_mom};
+                    particle->set_interpolant(particle->timestep, particle->position, particle->momentum, K_pos, K_mom);
+                }
+                else
+                {
+                    particle->has_interpolant=false;
+                }
 
                 particle->current_time+=particle->timestep;
                 particle->position=pos_O5;
@@ -426,13 +567,635 @@ class apply_charged_force
                 }
                 //print(pos_O4.sum_of_squares(), mom_O4.sum_of_squares(), max_pos_error_sq, max_mom_error_sq);
 
-                particle->next_timestep=particle->timestep*kappa*std::pow( std::sqrt(err_f), 0.20);
+                num_rejected_steps.fetch_add(1, std::memory_order_relaxed);
+                particle->next_timestep=particle->timestep*rejected_step_factor(1.0/std::sqrt(err_f));
                 acceptable=false;
             }
         }
     }
 
+    void charged_particle_RungeKuttaDP(electron_store& electrons, size_t handle)
+    //same as above, for an electron in an electron_store. The electron is copied into a working electron that is re-used
+    {
+        electrons.load(handle, &working_electron);
+        charged_particle_RungeKuttaDP(&working_electron);
+        electrons.save(handle, &working_electron);
+    }
+
+
+    //// choosing the integrator ////
+    // charged_particle_step uses the guiding centre (see below) if it is turned on and valid for the particle, otherwise the Runge-Kutta.
+
+    bool fields_are_uniform()
+    {
+        return E_field->is_uniform() and B_field->is_uniform();
+    }
+
+    bool charged_particle_step(electron_T *particle)
+    //step a particle with the fastest integrator that the fields allow. Returns true if it was a guiding centre step, which has no interpolant
+    //(see guiding_centre_interpolate)
+    {
+        if(use_guiding_centre(particle))
+        {
+            charged_particle_guiding_centre_step(particle);
+            return true;
+        }
+        else
+        {
+            charged_particle_RungeKuttaDP(particle);
+        }
+        return false;
+    }
+
+    bool charged_particle_step(electron_store& electrons, size_t handle)
+    //same as above, for an electron in an electron_store
+    {
+        electrons.load(handle, &working_electron);
+        bool guiding_centre=charged_particle_step(&working_electron);
+        electrons.save(handle, &working_electron);
+        return guiding_centre;
+    }
+
+    //// guiding centre ////
+    // In a strong magnetic field the Runge-Kutta needs many steps for each gyration, even if the energy changes slowly. charged_particle_guiding_centre_step
+    // follows the guiding centre instead. The particle is Lorentz transformed into the frame that drifts with v_E, where E and B are parallel. There
+    // the momentum is split into the part along B (p_par) and the gyration (p_perp), and one RK4 step integrates
+    //   dp_par/dt = charge*E_par - friction*p_par/p,   dp_perp/dt = -friction*p_perp/p,   d phase/dt = |B|/gamma,   d s/dt = p_par/gamma
+    // The guiding centre moves s along B, the particle is put back on its gyration at the new phase, and transformed back to the lab. So the step
+    // ends with a full position and momentum, and scattering acts on it the same as after a Runge-Kutta step.
+    // Without friction this is exact in uniform fields. Friction is applied in the drift frame, which is only good if the drift is slow, so this is
+    // only used in uniform fields (gradient and curvature drifts are not included), without an atmosphere, and if v_E is less than
+    // guiding_centre_drift_speed. The timestep is limited by guiding_centre_momentum_tol and maximum_timestep, and the step is only taken if it can span
+    // at least guiding_centre_gyrations gyrations. Otherwise charged_particle_step uses the full orbit.
+    // A polynomial cannot follow the gyrations, so the step has no interpolant. Instead guiding_centre_interpolate re-does the step from its start
+    // to any time inside it, which puts the particle exactly on its orbit at a scatter.
+
+    bool use_guiding_centre(electron_T *particle)
+    //true if the guiding centre is turned on, and is valid and faster than the full orbit for this particle
+    {
+        if(guiding_centre_gyrations<=0 or not fields_are_uniform() or atmosphere) return false;
+        vec3 E;
+        vec3 B;
+        E_field->evaluate(particle->position, particle->current_time, E);
+        B_field->evaluate(particle->position, particle->current_time, B);
+        double B_sq=B.sum_of_squares();
+        if(B_sq==0) return false;
+
+        vec3 drift;
+        double frame_gamma;
+        drift_frame(E, B, drift, frame_gamma);
+        if(drift.sum_of_squares() >= guiding_centre_drift_speed*guiding_centre_drift_speed) return false;
+
+        double gyration_time=2*PI*gamma(particle->momentum)/std::sqrt(B_sq);
+        return guiding_centre_timestep(particle->momentum, E, B) >= guiding_centre_gyrations*gyration_time;
+    }
+
+    double guiding_centre_timestep(const vec3& momentum, const vec3& E, const vec3& B)
+    //largest timestep that keeps charged_particle_guiding_centre_step within tolerance
+    {
+        double timestep=maximum_timestep;
+
+        double momentum_sq=momentum.sum_of_squares();
+        double rate=std::abs(dot(E, B))/B.norm() + std::max(ionization_friction(momentum_sq), 0.0);
+        if(rate>0)
+        {
+            timestep=std::min(timestep, guiding_centre_momentum_tol*std::sqrt(momentum_sq)/rate);
+        }
+        return timestep;
+    }
+
+    inline void guiding_centre_rates(const double* state, double electric_force, double B_mag, double* rates)
+    //derivatives of p_par, p_perp, the phase, and the distance along the axis, see above
+    {
+        double momentum_sq=state[0]*state[0] + state[1]*state[1];
+        double inverse_gamma=1.0/std::sqrt(1+momentum_sq);
+        double friction=std::max(ionization_friction(momentum_sq), 0.0);
+        double friction_per_momentum= momentum_sq>0 ? friction/std::sqrt(momentum_sq) : 0.0;
+
+        rates[0]=electric_force - friction_per_momentum*state[0];
+        rates[1]=-friction_per_momentum*state[1];
+        rates[2]=B_mag*inverse_gamma;
+        rates[3]=state[0]*inverse_gamma;
+    }
+
+    vec3 gyration_offset(const vec3& axis, const vec3& perp, double par, double B_mag)
+    //vector from the particle to its guiding centre. Friction damps the gyration, which moves the centre of the spiral by about friction/(p*omega)
+    //gyro-radii from the centre of the circle
+    {
+        double momentum_sq=par*par + perp.sum_of_squares();
+        double G=gamma(momentum_sq);
+        double omega=B_mag/G;
+        double damping= momentum_sq>0 ? std::max(ionization_friction(momentum_sq), 0.0)/std::sqrt(momentum_sq) : 0.0;
+
+        vec3 offset=cross(axis, perp)*omega;
+        offset.mult_add(perp, damping);
+        offset/=G*(omega*omega + damping*damping);
+        return offset;
+    }
+
+    void drift_frame(const vec3& E, const vec3& B, vec3& velocity, double& frame_gamma)
+    //velocity of the frame where E and B are parallel. Zero if they already are. This is the ExB drift, v_E/(1+v_E^2)=ExB/(E^2+B^2)
+    {
+        vec3 S=cross(E, B);
+        double S_mag=S.norm();
+        if(S_mag==0)
+        {
+            velocity.set(0, 0, 0);
+            frame_gamma=1;
+            return;
+        }
+        double A=S_mag/(E.sum_of_squares() + B.sum_of_squares());
+        double speed=2*A/(1 + std::sqrt(1 - 4*A*A));
+        velocity=S*(speed/S_mag);
+        frame_gamma=1.0/std::sqrt(1 - speed*speed);
+    }
+
+    inline void boost(const vec3& velocity, double frame_gamma, vec3& space, double& time)
+    //Lorentz transform a four-vector into the frame that moves with velocity. Use -velocity to transform back
+    {
+        double space_dot_velocity=dot(space, velocity);
+        space.mult_add(velocity, frame_gamma*frame_gamma/(frame_gamma+1)*space_dot_velocity - frame_gamma*time);
+        time=frame_gamma*(time - space_dot_velocity);
+    }
+
+    inline void guiding_centre_gyration(const vec3& axis, const vec3& perp_dir, const double* state, vec3& perp)
+    //perpindicular momentum at the phase in state
+    {
+        perp=perp_dir*(std::cos(state[2])*state[1]);
+        perp.mult_add(cross(axis, perp_dir), std::sin(state[2])*state[1]);
+    }
+
+    void guiding_centre_push(vec3& position, vec3& momentum, const vec3& E, const vec3& B, double timestep, int charge)
+    //move a particle along its guiding centre for timestep, see above
+    {
+        //fields in the drift frame, which are parallel. The start of the step is the origin of both frames
+        vec3 velocity;
+        double frame_gamma;
+        drift_frame(E, B, velocity, frame_gamma);
+        vec3 frame_E=(E + cross(velocity, B))*frame_gamma;
+        vec3 frame_B=(B - cross(velocity, E))*frame_gamma;
+        double B_mag=frame_B.norm();
+        vec3 axis=frame_B*(-charge/B_mag); //the momentum gyrates counter-clockwise around axis
+
+        //split the momentum in the drift frame
+        vec3 frame_momentum=momentum;
+        double frame_energy=gamma(momentum);
+        boost(velocity, frame_gamma, frame_momentum, frame_energy);
+        double par=dot(frame_momentum, axis);
+        vec3 perp=frame_momentum;
+        perp.mult_add(axis, -par);
+        double perp_mag=perp.norm();
+        vec3 perp_dir= perp_mag>0 ? perp/perp_mag : vec3(0, 0, 0);
+        vec3 start_offset=gyration_offset(axis, perp, par, B_mag);
+
+        //RK4 on p_par, p_perp, phase, and distance along axis, in the time of the drift frame
+        double frame_timestep=timestep/frame_gamma;
+        double electric_force=charge*dot(frame_E, axis);
+        double state[4]={par, perp_mag, 0, 0};
+        double K_1[4], K_2[4], K_3[4], K_4[4], stage[4];
+        guiding_centre_rates(state, electric_force, B_mag, K_1);
+        for(int i=0; i<4; i++) stage[i]=state[i] + 0.5*frame_timestep*K_1[i];
+        guiding_centre_rates(stage, electric_force, B_mag, K_2);
+        for(int i=0; i<4; i++) stage[i]=state[i] + 0.5*frame_timestep*K_2[i];
+        guiding_centre_rates(stage, electric_force, B_mag, K_3);
+        for(int i=0; i<4; i++) stage[i]=state[i] + frame_timestep*K_3[i];
+        guiding_centre_rates(stage, electric_force, B_mag, K_4);
+        for(int i=0; i<4; i++) state[i]+=frame_timestep*(K_1[i] + 2*K_2[i] + 2*K_3[i] + K_4[i])/6.0;
+        state[1]=std::max(state[1], 0.0);
+
+        //the end of the step is at lab time timestep, which is frame time timestep/frame_gamma - velocity.(displacement in the frame). Only the gyration
+        //moves along velocity, so this converges in a few iterations, and the extra frame time is small enough to step with the rates at the end
+        vec3 end_perp;
+        guiding_centre_gyration(axis, perp_dir, state, end_perp);
+        vec3 end_offset=gyration_offset(axis, end_perp, state[0], B_mag);
+        if(frame_gamma>1)
+        {
+            double end_rates[4];
+            double end_state[4];
+            guiding_centre_rates(state, electric_force, B_mag, end_rates);
+            double extra_time=0;
+            for(int iteration=0; iteration<4; iteration++)
+            {
+                extra_time=-dot(velocity, start_offset-end_offset);
+                for(int i=0; i<4; i++) end_state[i]=state[i] + extra_time*end_rates[i];
+                end_state[1]=std::max(end_state[1], 0.0);
+                guiding_centre_gyration(axis, perp_dir, end_state, end_perp);
+                end_offset=gyration_offset(axis, end_perp, end_state[0], B_mag);
+            }
+            for(int i=0; i<4; i++) state[i]=end_state[i];
+            frame_timestep+=extra_time;
+        }
+
+        //back to the lab frame
+        vec3 displacement=start_offset - end_offset;
+        displacement.mult_add(axis, state[3]);
+        double elapsed=frame_timestep;
+        boost(-velocity, frame_gamma, displacement, elapsed);
+        position+=displacement;
+
+        momentum=axis*state[0] + end_perp;
+        frame_energy=gamma(momentum);
+        boost(-velocity, frame_gamma, momentum, frame_energy);
+    }
+
+    void charged_particle_guiding_centre_step(electron_T *particle)
+    //step a particle along its guiding centre, see above. Does not check use_guiding_centre
+    {
+        check_species(particle->charge);
+        vec3 E;
+        vec3 B;
+        E_field->evaluate(particle->position, particle->current_time, E);
+        B_field->evaluate(particle->position, particle->current_time, B);
+
+        double timestep=std::min(particle->next_timestep, guiding_centre_timestep(particle->momentum, E, B));
+        if(timestep != timestep)
+        {
+            throw gen_exception("timestep is Nan");
+        }
+
+        guiding_centre_push(particle->position, particle->momentum, E, B, timestep, particle->charge);
+
+        particle->has_interpolant=false;
+        particle->timestep=timestep;
+        particle->current_time+=timestep;
+        particle->next_timestep=guiding_centre_timestep(particle->momentum, E, B);
+    }
+
+    void guiding_centre_interpolate(electron_T *particle, const vec3& pos_0, const vec3& mom_0, double T_bar, vec3& pos_out, vec3& mom_out)
+    //position and momentum at T_bar of the last step of a particle that took a guiding centre step from pos_0 and mom_0. Like electron_T::interpolate,
+    //T_bar=0 is the start of the step and T_bar=1 is the end
+    {
+        vec3 E;
+        vec3 B;
+        double start_time=particle->current_time-particle->timestep;
+        E_field->evaluate(pos_0, start_time, E);
+        B_field->evaluate(pos_0, start_time, B);
+
+        pos_out=pos_0;
+        mom_out=mom_0;
+        guiding_centre_push(pos_out, mom_out, E, B, T_bar*particle->timestep, particle->charge);
+    }
+
+    void guiding_centre_reduce_timestep_to(electron_T *particle, const vec3& pos_0, const vec3& mom_0, double new_timestep)
+    //same as electron_T::reduce_timestep_to, after a guiding centre step from pos_0 and mom_0
+    {
+        vec3 position;
+        vec3 momentum;
+        guiding_centre_interpolate(particle, pos_0, mom_0, new_timestep/particle->timestep, position, momentum);
+
+        particle->current_time+=new_timestep-particle->timestep;
+        particle->timestep=new_timestep;
+        particle->position=position;
+        particle->momentum=momentum;
+        particle->update_energy();
+    }
+
+    //// batched Dormand-Prince ////
+    // charged_particle_RungeKuttaDP_batch steps many electrons in an electron_store, W electrons at a time. Each electron is a lane of the vec3_lanes below,
+    // so every operation is a loop over lanes that the compiler can vectorize (W=4 fills AVX2 registers, W=8 fills AVX-512). The fields and stopping
+    // powers are looked up for all lanes at once. Each lane has its own error estimate and timestep. Lanes that are accepted are masked off, and the
+    // rest are re-done with smaller timesteps untill all lanes are accepted.
+    // Each lane does the same arithmetic, in the same order, as charged_particle_RungeKuttaDP, so the results are the same to the bit, as long as
+    // the compiler is not allowed to contract to fused multiply-adds differently in the two (see algorithm_tests/batched_RK_benchmark.cpp).
+
+    template<int W>
+    void force_batch(const vec3_lanes<W>& position, const vec3_lanes<W>& momentum, const double* time, vec3_lanes<W>& force_out)
+    //force on W particles, same as force
+    {
+        double momentum_squared[W];
+        double momentum_magnitude[W];
+        double inverse_gamma[W];
+        momentum.sum_of_squares(momentum_squared);
+        for(int l=0; l<W; l++)
+        {
+            momentum_magnitude[l]=std::sqrt(momentum_squared[l]);
+            inverse_gamma[l]=1.0/gamma(momentum_squared[l]);
+        }
+
+        //fields
+        vec3_lanes<W> B;
+        E_field->evaluate_batch(position[0], position[1], position[2], time, force_out[0], force_out[1], force_out[2], W);
+        B_field->evaluate_batch(position[0], position[1], position[2], time, B[0], B[1], B[2], W);
+
+        const double charge=species_T::charge;
+        for(int i=0; i<3; i++)
+        {
+            for(int l=0; l<W; l++)
+            {
+                force_out[i][l]*=charge;
+                B[i][l]*=charge;
+            }
+        }
+
+        for(int l=0; l<W; l++)
+        {
+            force_out[0][l]+=inverse_gamma[l]*(momentum[1][l]*B[2][l]-momentum[2][l]*B[1][l]);
+            force_out[1][l]+=inverse_gamma[l]*(momentum[2][l]*B[0][l]-momentum[0][l]*B[2][l]);
+            force_out[2][l]+=inverse_gamma[l]*(momentum[0][l]*B[1][l]-momentum[1][l]*B[0][l]);
+        }
+
+        //ionization friction
+        double friction[W];
+        if(remove_moller==0 or remove_moller==1) //if not removing moller losses, or constant min_energy
+        {
+            ionization.lookup(momentum_squared, friction, W);
+        }
+        else
+        {
+            ionization.lookup_variable_RML(momentum_squared, min_energy_removal, friction, W);
+        }
+
+        if(atmosphere)
+        {
+            for(int l=0; l<W; l++)
+            {
+                friction[l]*=atmosphere->density_ratio(position[2][l]);
+            }
+        }
+
+        for(int i=0; i<3; i++)
+        {
+            for(int l=0; l<W; l++)
+            {
+                double friction_force= friction[l]>0 ? friction[l]*momentum[i][l]/momentum_magnitude[l] : 0.0; //don't want weird stuff
+                force_out[i][l]-=friction_force;
+            }
+        }
+    }
+
+    template<int W>
+    void K_batch(const vec3_lanes<W>& pos_step, const vec3_lanes<W>& mom_step, const double* time, const double* timestep, vec3_lanes<W>& K_pos, vec3_lanes<W>& K_mom)
+    //one stage of Dormand-Prince for W electrons
+    {
+        for(int l=0; l<W; l++)
+        {
+            double inverse_gamma=1.0/std::sqrt(1+mom_step[0][l]*mom_step[0][l]+mom_step[1][l]*mom_step[1][l]+mom_step[2][l]*mom_step[2][l]);
+            for(int i=0; i<3; i++)
+            {
+                K_pos[i][l]=mom_step[i][l]*inverse_gamma;
+            }
+        }
+        force_batch<W>(pos_step, mom_step, time, K_mom);
+        K_pos.multiply_lanes(timestep);
+        K_mom.multiply_lanes(timestep);
+    }
+
+    template<int W>
+    void charged_particle_RungeKuttaDP_lanes(electron_store& electrons, const size_t* handles, int num_lanes)
+    //step up to W electrons at once. Unused lanes are filled with a copy of the first electron, and never saved
+    {
+        vec3_lanes<W> position;
+        vec3_lanes<W> momentum;
+        double current_time[W];
+        double timestep[W];
+        double next_timestep[W];
+        double last_step_error[W];
+        bool active[W];
+        int num_tries[W];
+
+        for(int l=0; l<W; l++)
+        {
+            size_t handle=handles[ l<num_lanes ? l : 0 ];
+            check_species(electrons.charge[handle]);
+            position[0][l]=electrons.pos_x[handle];
+            position[1][l]=electrons.pos_y[handle];
+            position[2][l]=electrons.pos_z[handle];
+            momentum[0][l]=electrons.mom_x[handle];
+            momentum[1][l]=electrons.mom_y[handle];
+            momentum[2][l]=electrons.mom_z[handle];
+            current_time[l]=electrons.current_time[handle];
+            timestep[l]=electrons.timestep[handle];
+            next_timestep[l]=electrons.next_timestep[handle];
+            last_step_error[l]=electrons.last_step_error[handle];
+            active[l]= l<num_lanes;
+            num_tries[l]=0;
+        }
+
+        vec3_lanes<W> pos_step, mom_step;
+        vec3_lanes<W> K_1_pos, K_1_mom, K_2_pos, K_2_mom, K_3_pos, K_3_mom, K_4_pos, K_4_mom, K_5_pos, K_5_mom, K_6_pos, K_6_mom, K_7_pos, K_7_mom;
+        vec3_lanes<W> pos_O4, mom_O4, pos_O5, mom_O5;
+        double time[W];
+
+        //the first stage does not depend on the timestep, so is found once for all tries
+        vec3_lanes<W> K_1_pos_rate, K_1_mom_rate;
+        double unit_timestep[W];
+        for(int l=0; l<W; l++)
+        {
+            time[l]=current_time[l];
+            unit_timestep[l]=1.0;
+        }
+        K_batch<W>(position, momentum, time, unit_timestep, K_1_pos_rate, K_1_mom_rate);
+
+        int num_active=num_lanes;
+        while(num_active>0)
+        {
+            for(int l=0; l<W; l++)
+            {
+                if(not active[l]) continue;
+
+                num_tries[l]++;
+                timestep[l]=next_timestep[l];
+                if(timestep[l]>maximum_timestep)
+                {
+                    timestep[l]=maximum_timestep;
+                }
+                if(atmosphere)
+                {
+                    vec3 lane_position(position[0][l], position[1][l], position[2][l]);
+                    vec3 lane_momentum(momentum[0][l], momentum[1][l], momentum[2][l]);
+                    timestep[l]=std::min(timestep[l], density_timestep(lane_position, lane_momentum));
+                }
+                if(timestep[l] != timestep[l])
+                {
+                    throw gen_exception("timestep is Nan");
+                }
+            }
+
+            K_1_pos=K_1_pos_rate;
+            K_1_mom=K_1_mom_rate;
+            K_1_pos.multiply_lanes(timestep);
+            K_1_mom.multiply_lanes(timestep);
+
+            pos_step.set_scaled(K_1_pos, 1.0/5.0);
+            mom_step.set_scaled(K_1_mom, 1.0/5.0);
+            pos_step+=position;
+            mom_step+=momentum;
+            for(int l=0; l<W; l++) time[l]=current_time[l] + timestep[l]*(1.0/5.0);
+            K_batch<W>(pos_step, mom_step, time, timestep, K_2_pos, K_2_mom);
+
+            pos_step.set_scaled(K_1_pos, 3.0/40.0);
+            mom_step.set_scaled(K_1_mom, 3.0/40.0);
+            pos_step.mult_add(K_2_pos, 9.0/40.0);
+            mom_step.mult_add(K_2_mom, 9.0/40.0);
+            pos_step+=position;
+            mom_step+=momentum;
+            for(int l=0; l<W; l++) time[l]=current_time[l] + timestep[l]*3.0/10.0;
+            K_batch<W>(pos_step, mom_step, time, timestep, K_3_pos, K_3_mom);
+
+            pos_step.set_scaled(K_1_pos, 44.0/45.0);
+            mom_step.set_scaled(K_1_mom, 44.0/45.0);
+            pos_step.mult_add(K_2_pos, -(56.0/15.0));
+            mom_step.mult_add(K_2_mom, -(56.0/15.0));
+            pos_step.mult_add(K_3_pos, 32.0/9.0);
+            mom_step.mult_add(K_3_mom, 32.0/9.0);
+            pos_step+=position;
+            mom_step+=momentum;
+            for(int l=0; l<W; l++) time[l]=current_time[l] + timestep[l]*(4.0/5.0);
+            K_batch<W>(pos_step, mom_step, time, timestep, K_4_pos, K_4_mom);
+
+            pos_step.set_scaled(K_1_pos, 19372.0/6561.0);
+            mom_step.set_scaled(K_1_mom, 19372.0/6561.0);
+            pos_step.mult_add(K_2_pos, -(25360.0/2187.0));
+            mom_step.mult_add(K_2_mom, -(25360.0/2187.0));
+            pos_step.mult_add(K_3_pos, 64448.0/6561.0);
+            mom_step.mult_add(K_3_mom, 64448.0/6561.0);
+            pos_step.mult_add(K_4_pos, -(212.0/729.0));
+            mom_step.mult_add(K_4_mom, -(212.0/729.0));
+            pos_step+=position;
+            mom_step+=momentum;
+            for(int l=0; l<W; l++) time[l]=current_time[l] + timestep[l]*8.0/9.0;
+            K_batch<W>(pos_step, mom_step, time, timestep, K_5_pos, K_5_mom);
+
+            pos_step.set_scaled(K_1_pos, 9017.0/3168.0);
+            mom_step.set_scaled(K_1_mom, 9017.0/3168.0);
+            pos_step.mult_add(K_2_pos, -(355.0/33.0));
+            mom_step.mult_add(K_2_mom, -(355.0/33.0));
+            pos_step.mult_add(K_3_pos, 46732.0/5247.0);
+            mom_step.mult_add(K_3_mom, 46732.0/5247.0);
+            pos_step.mult_add(K_4_pos, 49.0/176.0);
+            mom_step.mult_add(K_4_mom, 49.0/176.0);
+            pos_step.mult_add(K_5_pos, -(5103.0/18656.0));
+            mom_step.mult_add(K_5_mom, -(5103.0/18656.0));
+            pos_step+=position;
+            mom_step+=momentum;
+            for(int l=0; l<W; l++) time[l]=current_time[l] + timestep[l];
+            K_batch<W>(pos_step, mom_step, time, timestep, K_6_pos, K_6_mom);
+
+            //fifth order solution, K2 is zero
+            pos_O5.set_scaled(K_1_pos, 35.0/384.0);
+            mom_O5.set_scaled(K_1_mom, 35.0/384.0);
+            pos_O5.mult_add(K_3_pos, 500.0/1113.0);
+            mom_O5.mult_add(K_3_mom, 500.0/1113.0);
+            pos_O5.mult_add(K_4_pos, 125.0/192.0);
+            mom_O5.mult_add(K_4_mom, 125.0/192.0);
+            pos_O5.mult_add(K_5_pos, -(2187.0/6784.0));
+            mom_O5.mult_add(K_5_mom, -(2187.0/6784.0));
+            pos_O5.mult_add(K_6_pos, 11.0/84.0);
+            mom_O5.mult_add(K_6_mom, 11.0/84.0);
+
+            pos_step=pos_O5;
+            mom_step=mom_O5;
+            pos_step+=position;
+            mom_step+=momentum;
+            K_batch<W>(pos_step, mom_step, time, timestep, K_7_pos, K_7_mom);
+
+            //fourth order solution, K2 is zero
+            pos_O4.set_scaled(K_1_pos, 5179.0/57600.0);
+            mom_O4.set_scaled(K_1_mom, 5179.0/57600.0);
+            pos_O4.mult_add(K_3_pos, 7571.0/16695.0);
+            mom_O4.mult_add(K_3_mom, 7571.0/16695.0);
+            pos_O4.mult_add(K_4_pos, 393.0/640.0);
+            mom_O4.mult_add(K_4_mom, 393.0/640.0);
+            pos_O4.mult_add(K_5_pos, -(92097.0/339200.0));
+            mom_O4.mult_add(K_5_mom, -(92097.0/339200.0));
+            pos_O4.mult_add(K_6_pos, 187.0/2100.0);
+            mom_O4.mult_add(K_6_mom, 187.0/2100.0);
+            pos_O4.mult_add(K_7_pos, 1.0/40.0);
+            mom_O4.mult_add(K_7_mom, 1.0/40.0);
+
+            pos_O4-=pos_O5;//for calculating the error
+            mom_O4-=mom_O5;
+
+            double pos_error_sq[W], mom_error_sq[W], pos_O5_sq[W], mom_O5_sq[W], err_f[W];
+            pos_O4.sum_of_squares(pos_error_sq);
+            mom_O4.sum_of_squares(mom_error_sq);
+            pos_O5.sum_of_squares(pos_O5_sq);
+            mom_O5.sum_of_squares(mom_O5_sq);
+            for(int l=0; l<W; l++)
+            {
+                double max_pos_error_sq=rel_tol*rel_tol*pos_O5_sq[l];
+                double max_mom_error_sq=rel_tol*rel_tol*mom_O5_sq[l];
+                err_f[l]=std::min(max_pos_error_sq/pos_error_sq[l], max_mom_error_sq/mom_error_sq[l]);//note the inverses
+            }
+
+            pos_O5+=position;
+            mom_O5+=momentum;
+
+            //accept or reject each lane
+            for(int l=0; l<W; l++)
+            {
+                if(not active[l]) continue;
+
+                if(err_f[l]>1)//error is good, save the electron
+                {
+                    size_t handle=handles[l];
+                    double error=1.0/std::sqrt(err_f[l]);
+                    electrons.next_timestep[handle]=timestep[l]*accepted_step_factor(error, last_step_error[l], num_tries[l]>1);
+                    electrons.last_step_error[handle]=std::max(error, 1.0E-4);
+                    num_accepted_steps.fetch_add(1, std::memory_order_relaxed);
+                    electrons.timestep[handle]=timestep[l];
+                    electrons.current_time[handle]=current_time[l]+timestep[l];
+
+                    //interpolant, the same as electron_T::set_interpolant
+                    double* coefs=electrons.interpolant_coefficients(handle, timestep[l]);
+                    const vec3_lanes<W>* K_pos[5]={&K_1_pos, &K_3_pos, &K_4_pos, &K_5_pos, &K_6_pos};
+                    const vec3_lanes<W>* K_mom[5]={&K_1_mom, &K_3_mom, &K_4_mom, &K_5_mom, &K_6_mom};
+                    for(int i=0; i<3; i++)
+                    {
+                        coefs[i]=position[i][l];
+                        coefs[3+i]=K_1_pos[i][l];
+                        coefs[3*electron_T::interpolant_order + i]=momentum[i][l];
+                        coefs[3*electron_T::interpolant_order + 3+i]=K_1_mom[i][l];
+                    }
+                    for(int order=2; order<electron_T::interpolant_order; order++)
+                    {
+                        const double* factors=electron_T::interpolant_factors(order);
+                        for(int i=0; i<3; i++)
+                        {
+                            double pos_coef=(*K_pos[0])[i][l]*factors[0];
+                            double mom_coef=(*K_mom[0])[i][l]*factors[0];
+                            for(int k=1; k<5; k++)
+                            {
+                                pos_coef+=(*K_pos[k])[i][l]*factors[k];
+                                mom_coef+=(*K_mom[k])[i][l]*factors[k];
+                            }
+                            coefs[3*order + i]=pos_coef;
+                            coefs[3*(electron_T::interpolant_order+order) + i]=mom_coef;
+                        }
+                    }
+
+                    electrons.set_position(handle, pos_O5[0][l], pos_O5[1][l], pos_O5[2][l]);
+                    electrons.set_momentum(handle, mom_O5[0][l], mom_O5[1][l], mom_O5[2][l]);
+
+                    active[l]=false;
+                    num_active--;
+                }
+                else
+                {//repeat with new timestep
+                    if(num_tries[l]>100)
+                    {
+                        throw gen_exception("error in Dormand-Prince RK: ", num_tries[l]);
+                    }
+                    num_rejected_steps.fetch_add(1, std::memory_order_relaxed);
+                    next_timestep[l]=timestep[l]*rejected_step_factor(1.0/std::sqrt(err_f[l]));
+                }
+            }
+        }
+    }
+
+    template<int W=4>
+    void charged_particle_RungeKuttaDP_batch(electron_store& electrons, const std::vector<size_t>& handles)
+    //charged_particle_RungeKuttaDP for each electron in handles, W at a time. The electrons get an interpolant. Does not update energy
+    {
+        for(size_t first=0; first<handles.size(); first+=W)
+        {
+            int num_lanes=std::min(size_t(W), handles.size()-first);
+            charged_particle_RungeKuttaDP_lanes<W>(electrons, &handles[first], num_lanes);
+        }
+    }
 
 };
 
+typedef apply_charged_force_fields<field, field> apply_charged_force;
+
 #endif
@@ -0,0 +1,154 @@
+#ifndef ATMOSPHERE_HPP
+#define ATMOSPHERE_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "vector.hpp"
+
+#include "gen_ex.hpp"
+#include "binary_IO.hpp"
+#include "arrays_IO.hpp"
+
+//// air density as a function of altitude ////
+// All the tables (stopping power, moller, diffusion, bremsstrahlung) are made at sea level density (bethe_table::density). Rates and stopping
+// powers are proportional to the density, so they are scaled by density_ratio, which is the density at an altitude divided by sea level density.
+// The altitude is the Z coordinate, in distance_units.
+//
+// For rates that are looked up by energy (physical_interaction::rate), scaling the rate by the ratio is the same as sampling with the timestep
+// multiplied by the ratio, and dividing the sampled time by the ratio. The diffusion tables are in timestep, so are sampled with timestep times
+// the ratio. So none of the tables need to know about the density (see sim_cls::step_electron in Lehtinen1999.cpp).
+//
+// scale_height is used to limit the timestep so that the density does not change much in one step (see apply_charged_force::set_atmosphere).
+
+class density_profile
+{
+public:
+    virtual double density_ratio(double altitude)=0;
+
+    virtual double scale_height(double altitude)=0;
+    //density/|d density/d altitude|. Is INFINITY if the density does not change
+};
+
+class exponential_density : public density_profile
+{
+public:
+    double e_folding_height;
+    double inverse_scale_height;
+    double altitude_of_origin;
+
+    exponential_density(double e_folding_height_, double altitude_of_origin_=0)
+    //density_ratio= exp(-(Z + altitude_of_origin)/e_folding_height). altitude_of_origin is the height above sea level of Z=0
+    {
+        e_folding_height=e_folding_height_;
+        inverse_scale_height=1.0/e_folding_height;
+        altitude_of_origin=altitude_of_origin_;
+    }
+
+    inline double density_ratio(double altitude)
+    {
+        return std::exp(-(altitude + altitude_of_origin)*inverse_scale_height);
+    }
+
+    inline double scale_height(double altitude)
+    {
+        return e_folding_height;
+    }
+};
+
+class tabulated_density : public density_profile
+//linear interpolation between samples on an even grid in altitude, which is made from any table of altitude and density ratio.
+//The density is constant above and below the table
+{
+public:
+    double lowest_altitude;
+    double altitude_step;
+    double inverse_altitude_step;
+    std::vector<double> ratios;
+    std::vector<double> inverse_scale_heights; //for each bin
+
+    tabulated_density(const gsl::vector& altitudes, const gsl::vector& ratios_, int samples_per_point=4)
+    //altitudes need to be sorted, with at least two points. ratios_ are density ratios, which need to be positive. The profile is interpolated
+    //exponentially between the points, and sampled samples_per_point times finer than the average spacing of altitudes
+    {
+        make_table(altitudes, ratios_, samples_per_point);
+    }
+
+    tabulated_density(std::string fname, double altitude_of_origin=0, int samples_per_point=4)
+    //load from a file with an array of two arrays of doubles: the altitudes above sea level (in distance_units) and the density ratios.
+    //altitude_of_origin is the height above sea level of Z=0
+    {
+        binary_input fin(fname);
+        array_input table_in(fin);
+        gsl::vector altitudes=table_in.read_doublesArray();
+        gsl::vector ratios_=table_in.read_doublesArray();
+        for(size_t i=0; i<altitudes.size(); i++)
+        {
+            altitudes[i]-=altitude_of_origin;
+        }
+        make_table(altitudes, ratios_, samples_per_point);
+    }
+
+    inline double density_ratio(double altitude)
+    {
+        double F=(altitude-lowest_altitude)*inverse_altitude_step;
+        if(not (F>0)) return ratios.front();
+        size_t index=size_t(F);
+        if(index>=ratios.size()-1) return ratios.back();
+
+        double weight=F-index;
+        return ratios[index] + weight*(ratios[index+1]-ratios[index]);
+    }
+
+    inline double scale_height(double altitude)
+    {
+        double F=(altitude-lowest_altitude)*inverse_altitude_step;
+        if(not (F>=0) or F>ratios.size()-1) return INFINITY;
+        size_t index=size_t(F);
+        if(index>=inverse_scale_heights.size()) index=inverse_scale_heights.size()-1;
+        return 1.0/inverse_scale_heights[index];
+    }
+
+private:
+
+    void make_table(const gsl::vector& altitudes, const gsl::vector& ratios_, int samples_per_point)
+    {
+        size_t num_points=altitudes.size();
+        if(num_points<2 or ratios_.size()!=num_points)
+        {
+            throw gen_exception("tabulated_density needs at least two altitudes, and one density ratio for each");
+        }
+        for(size_t i=0; i<num_points; i++)
+        {
+            if(ratios_[i]<=0 or (i>0 and altitudes[i]<=altitudes[i-1]))
+            {
+                throw gen_exception("tabulated_density needs sorted altitudes, and positive density");
+            }
+        }
+
+        lowest_altitude=altitudes[0];
+        size_t num_samples=(num_points-1)*samples_per_point + 1;
+        altitude_step=(altitudes[num_points-1]-lowest_altitude)/(num_samples-1);
+        inverse_altitude_step=1.0/altitude_step;
+
+        ratios.resize(num_samples);
+        size_t point=0;
+        for(size_t i=0; i<num_samples; i++)
+        {
+            double altitude= i==num_samples-1 ? altitudes[num_points-1] : lowest_altitude + i*altitude_step;
+            while(point<num_points-2 and altitude>altitudes[point+1]) point++;
+
+            double weight=(altitude-altitudes[point])/(altitudes[point+1]-altitudes[point]);
+            ratios[i]=std::exp( (1.0-weight)*std::log(ratios_[point]) + weight*std::log(ratios_[point+1]) );
+        }
+
+        inverse_scale_heights.resize(num_samples-1);
+        for(size_t i=0; i<num_samples-1; i++)
+        {
+            inverse_scale_heights[i]=std::abs(std::log(ratios[i+1]/ratios[i]))*inverse_altitude_step;
+        }
+    }
+};
+
+#endif
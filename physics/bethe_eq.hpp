@@ -3,10 +3,15 @@
 #define BETH_EQUATION_HPP
 
 #include <cmath>
+#include <vector>
+#include <string>
+#include <fstream>
 
 
 #include "vector.hpp"
+#include "vector_long.hpp"
 #include "constants.hpp"
+#include "gen_ex.hpp"
 
 #include "binary_IO.hpp"
 #include "arrays_IO.hpp"
@@ -59,7 +64,60 @@ double bethe_subtract_moller(double mom_sq, double minimum_energy)
     return (std::log(exp_term1)-term2_factor*std::log(exp_term2_factor2)+term3+term4)/beta_sq;
 }
 
-//add bhaba_losses here
+double positron_bethe_formula(double mom_sq)
+//stopping power of positrons, the same as bethe_formula but with the positron F(tau) of ICRU 37, which includes bhabha scattering
+{
+    double gamma_sq=1.0+mom_sq;
+    double gamma=std::sqrt(gamma_sq);
+    double beta_sq=mom_sq/gamma_sq;
+    double KE=gamma-1;
+
+    double exp_term1=beta_sq*KE*gamma_sq*inv_I_sq;
+    double inv_KE_2=1.0/(KE+2);
+    double term2=beta_sq*(23 + inv_KE_2*(14 + inv_KE_2*(10 + inv_KE_2*4)))/12.0;
+
+    return (std::log(exp_term1)+std::log(2)-term2)/beta_sq;
+}
+
+double bhabha_losses(double mom_sq, double min_energy)
+//energy loss due to bhabha scattering for a positron that frees electrons to have energy at least 'min_energy', where KE must be greater than min_energy.
+//The integral of the energy transfer over the bhabha cross section, from delta=min_energy/KE to 1
+{
+    double gamma_sq=1.0+mom_sq;
+    double gamma=std::sqrt(gamma_sq);
+    double beta_sq=mom_sq/gamma_sq;
+    double KE=gamma-1;
+
+    double delta=min_energy/KE;
+    double delta_sq=delta*delta;
+    double y=1.0/(gamma+1);
+    double one_m_2y=1-2*y;
+    double b1=2-y*y;
+    double b2=one_m_2y*(3+y*y);
+    double b4=one_m_2y*one_m_2y*one_m_2y;
+    double b3=b4+one_m_2y*one_m_2y;
+
+    return -std::log(delta)/beta_sq - b1*(1-delta) + b2*(1-delta_sq)/2 - b3*(1-delta_sq*delta)/3 + b4*(1-delta_sq*delta_sq)/4;
+}
+
+double positron_bethe_subtract_bhabha(double mom_sq, double minimum_energy)
+{
+    return positron_bethe_formula(mom_sq)-bhabha_losses(mom_sq, minimum_energy);
+}
+
+class removal_energy_T
+//a minimum energy of secondary removal, with what ionization_table::lookup_variable_RML needs to use it, so that is only found once
+//for each energy. Make with ionization_table::removal_energy
+{
+public:
+    double energy;
+    double min_mom_sq; //where losses start, which is twice energy for moller scattering, and energy for bhabha scattering
+    double log_min_mom_sq;
+    bool in_table; //false if energy is outside the loss table, then losses are calculated
+    size_t energy_index; //in the loss table
+    double energy_weight;
+};
+
 
 ////tables
 namespace bethe_table{
@@ -154,208 +212,505 @@ gsl::vector positron_SP({21.8, 18.25, 15.78, 13.96, 12.56, 10.53, 9.126,
 1.744, 1.766, 1.786, 1.805, 1.823, 1.854, 1.883, 1.908, 1.931, 1.980, 2.020,
 2.055, 2.085, 2.136, 2.176, 2.208});
 
-//positrons not implemented
 
 }
 
 
-class electron_ionization_table
-//class to calculate stopping powers for electrons
+class electron_species
+//what ionization_table needs for electrons. Secondaries are freed by moller scattering, where the primary is the electron with more energy after
+{
+public:
+    static const int charge=-1;
+
+    static gsl::vector& table_energy(){ return bethe_table::electron_energy; }
+    static gsl::vector& table_SP(){ return bethe_table::electron_SP; }
+    static const char* output_fname(){ return "./tables/bethe_info"; }
+
+    static double formula(double mom_sq){ return bethe_formula(mom_sq); }
+    static double losses(double mom_sq, double min_energy){ return moller_losses(mom_sq, min_energy); }
+    static double formula_subtract_losses(double mom_sq, double min_energy){ return bethe_subtract_moller(mom_sq, min_energy); }
+
+    static double losses_start_mom_sq(double min_energy)
+    //losses start at KE=2*min_energy
+    {
+        return (min_energy*2.0+1.0)*(min_energy*2.0+1.0)-1.0;
+    }
+};
+
+class positron_species
+//what ionization_table needs for positrons. Secondaries are freed by bhabha scattering, where any of the energy can go to the electron
+{
+public:
+    static const int charge=1;
+
+    static gsl::vector& table_energy(){ return bethe_table::positron_energy; }
+    static gsl::vector& table_SP(){ return bethe_table::positron_SP; }
+    static const char* output_fname(){ return "./tables/positron_bethe_info"; }
+
+    static double formula(double mom_sq){ return positron_bethe_formula(mom_sq); }
+    static double losses(double mom_sq, double min_energy){ return bhabha_losses(mom_sq, min_energy); }
+    static double formula_subtract_losses(double mom_sq, double min_energy){ return positron_bethe_subtract_bhabha(mom_sq, min_energy); }
+
+    static double losses_start_mom_sq(double min_energy)
+    //losses start at KE=min_energy
+    {
+        return (min_energy+1.0)*(min_energy+1.0)-1.0;
+    }
+};
+
+template<typename species_T>
+class ionization_table
+//class to calculate stopping powers for electrons (electron_ionization_table) or positrons (positron_ionization_table). species_T is
+//electron_species or positron_species, which gives the raw table and the losses to secondaries (moller or bhabha)
 // has three modes:
-//    1) do not remove moller losses: use default constructor and electron_lookup
-//    2) remove moller losses, and minimum energy is constant:  use non_default constructor and electron_lookup
-//    3) remove moller losses, and minimum energy is variable:  use default constructor and electron_lookup_variable_RML
+//    1) do not remove secondary losses: use default constructor and lookup
+//    2) remove secondary losses, and minimum energy is constant:  use non_default constructor and lookup
+//    3) remove secondary losses, and minimum energy is variable:  use default constructor and lookup_variable_RML
+//
+// Inside the table, the stopping power is linear in log-log between samples on an even grid in log(momentum squared). The lookups do not search
+// the table or call std::pow: the bin is found from log(momentum squared), and each bin has a cubic in the position in the bin (the Hermite cubic
+// with the value and slope of the power law at each end), so a lookup is one log and a few multiply-adds. The cubics differ from the power laws by
+// less than 2E-6 above 0.1 keV, and up to 2E-4 in the steep bins below 0.04 keV (see algorithm_tests/stopping_power_speed_test.cpp).
+//
+// For mode 3, make_loss_table tabulates the losses (over a range of minimum energies) on a grid in U=log(mom_sq/min_mom_sq), where
+// min_mom_sq is where the losses start, and log(minimum energy). The losses start at U=0 for any minimum energy, so there is no kink inside the
+// table, and bilinear interpolation is accurate. The table can be saved to a file and loaded (see save_loss_table). Then, with a
+// removal_energy_T, a lookup is the one log of mom_sq, like mode 2.
 {
 public:
     const size_t table_size=100;
 
-    gsl::vector electron_mom_sq;
-    gsl::vector electron_interp_powers;
-    gsl::vector electron_interp_factors;
-    //gsl::vector electron_stopping_power;
-    bool moller_removed;
-    double min_mom_sq_for_moller;
+    gsl::vector table_mom_sq;
+    gsl::vector interp_powers;
+    gsl::vector interp_factors;
+    std::vector<double> interp_cubics; //four coefficients for each bin, see table_stopping_power
+    double log_first_mom_sq;
+    double inverse_log_step;
+
+    //loss table, see make_loss_table. Index is energy_index*num_loss_points + U index
+    std::vector<double> loss_table;
+    size_t num_loss_points; //in U
+    size_t num_loss_energies; //0 if there is no table
+    double inverse_loss_step; //in U
+    double log_lowest_loss_energy;
+    double inverse_loss_energy_step; //in log(energy)
+
+    bool losses_removed;
+    double min_mom_sq_for_losses;
     double min_energy;
 
-    electron_ionization_table( bool save_output_table=false)
+    ionization_table( bool save_output_table=false)
     //use this constructor if minimum energy is a variable
     {
         set_tables(save_output_table);
-        min_mom_sq_for_moller=0.0;
-        moller_removed=false;
+        min_mom_sq_for_losses=0.0;
+        losses_removed=false;
         min_energy=0.0;
     }
 
-    electron_ionization_table(double const_min_energy_dimensionless, bool save_output_table=false)
-    //use this if the minimum energy is a constant or not removing moller losses. const_min_energy_dimensionless should be negative is not removing moller losses
+    ionization_table(double const_min_energy_dimensionless, bool save_output_table=false)
+    //use this if the minimum energy is a constant or not removing secondary losses. const_min_energy_dimensionless should be negative is not removing losses
     {
         set_tables(save_output_table, const_min_energy_dimensionless);
 
-        //for(size_t i=0; i<bethe_table::electron_energy.size(); i++)
-       // {
-           // if(bethe_table::electron_energy[i]>(const_min_energy_dimensionless*2.0*energy_units_kev))
-          //  {
-          //      electron_stopping_power[i]-=moller_losses(electron_mom_sq[i], const_min_energy_dimensionless);
-          //  }
-      //  }
-
-        min_mom_sq_for_moller=const_min_energy_dimensionless*2+1;
-        min_mom_sq_for_moller*=min_mom_sq_for_moller;
-        min_mom_sq_for_moller-=1.0;
+        min_mom_sq_for_losses=species_T::losses_start_mom_sq(const_min_energy_dimensionless);
         min_energy=const_min_energy_dimensionless;
-        moller_removed=true;
+        losses_removed=true;
     }
 
     void set_tables(bool save_output_table, double const_min_energy_dimensionless=-1)
-    //if const_min_energy_dimensionless is positive, remove moller losses
+    //if const_min_energy_dimensionless is positive, remove secondary losses
     {
-        double min_moller_removal_mom_sq=(const_min_energy_dimensionless*2+1)*(const_min_energy_dimensionless*2+1) -1;//convert min energy to min momentum sqaured
-
-        ///// convert electron tables
-        //convert electron energy to electron momentum_sq
-        gsl::vector raw_electron_mom_sq=bethe_table::electron_energy.clone();
-        raw_electron_mom_sq/=energy_units_kev;
-        raw_electron_mom_sq+=1.0; //now gamma
-        raw_electron_mom_sq*=raw_electron_mom_sq; //square
-        raw_electron_mom_sq-=1.0; //subtract one
-
-        //convert electron stopping power
+        num_loss_points=0;
+        num_loss_energies=0;
+        inverse_loss_step=0;
+        log_lowest_loss_energy=0;
+        inverse_loss_energy_step=0;
+
+        double min_removal_mom_sq=species_T::losses_start_mom_sq(const_min_energy_dimensionless);
+
+        ///// convert tables
+        //convert energy to momentum_sq
+        gsl::vector raw_mom_sq=species_T::table_energy().clone();
+        raw_mom_sq/=energy_units_kev;
+        raw_mom_sq+=1.0; //now gamma
+        raw_mom_sq*=raw_mom_sq; //square
+        raw_mom_sq-=1.0; //subtract one
+
+        //convert stopping power
         double conversion_factor=elementary_charge*1.0E8*bethe_table::density/(2.0*3.1415926*average_air_atomic_number*electron_classical_radius*electron_rest_energy*
                                                                                                     electron_classical_radius*average_air_atomic_density);
-        gsl::vector raw_electron_stopping_power=bethe_table::electron_SP*conversion_factor; //multiplication makes a new vector
+        gsl::vector raw_stopping_power=species_T::table_SP()*conversion_factor; //multiplication makes a new vector
 
         if(save_output_table)
         {
             arrays_output output_table;
 
-            std::shared_ptr<doubles_output> electron_mom_sq_raw=std::make_shared<doubles_output>(raw_electron_mom_sq);
-            std::shared_ptr<doubles_output> electron_SP_raw=std::make_shared<doubles_output>(raw_electron_stopping_power);
+            std::shared_ptr<doubles_output> mom_sq_raw=std::make_shared<doubles_output>(raw_mom_sq);
+            std::shared_ptr<doubles_output> SP_raw=std::make_shared<doubles_output>(raw_stopping_power);
 
-            output_table.add_array(electron_mom_sq_raw);
-            output_table.add_array(electron_SP_raw);
-            binary_output fout("./tables/bethe_info");
+            output_table.add_array(mom_sq_raw);
+            output_table.add_array(SP_raw);
+            binary_output fout(species_T::output_fname());
             output_table.write_out(&fout);
         }
 
-        ////// re-interpolation electron table!!
+        ////// re-interpolation of table!!
         //first, we need a linear log-log interpolant of the raw table
-        gsl::vector powers(raw_electron_stopping_power.size()-1);
-        gsl::vector factors(raw_electron_stopping_power.size()-1);
-        for(size_t i=0; i<(raw_electron_stopping_power.size()-1); i++)
+        gsl::vector powers(raw_stopping_power.size()-1);
+        gsl::vector factors(raw_stopping_power.size()-1);
+        for(size_t i=0; i<(raw_stopping_power.size()-1); i++)
         {
-            powers[i]=std::log(raw_electron_stopping_power[i+1]/raw_electron_stopping_power[i]) / std::log(raw_electron_mom_sq[i+1]/raw_electron_mom_sq[i]);
-            factors[i]=raw_electron_stopping_power[i]/std::pow(raw_electron_mom_sq[i], powers[i]);
+            powers[i]=std::log(raw_stopping_power[i+1]/raw_stopping_power[i]) / std::log(raw_mom_sq[i+1]/raw_mom_sq[i]);
+            factors[i]=raw_stopping_power[i]/std::pow(raw_mom_sq[i], powers[i]);
         }
 
 
         //now we use the previous interpolant to sample the energies at a predetermined number of points, with perfect log density
-        electron_mom_sq =logspace( std::log10(raw_electron_mom_sq[0]), std::log10(raw_electron_mom_sq[raw_electron_mom_sq.size()-1]), table_size );
-        gsl::vector electron_stopping_power(table_size);
+        table_mom_sq =logspace( std::log10(raw_mom_sq[0]), std::log10(raw_mom_sq[raw_mom_sq.size()-1]), table_size );
+        gsl::vector stopping_power(table_size);
 
         //get zeroth bit
-        electron_stopping_power[0] = raw_electron_stopping_power[0];
-        if(const_min_energy_dimensionless>0 and electron_mom_sq[0]> min_moller_removal_mom_sq )
+        stopping_power[0] = raw_stopping_power[0];
+        if(const_min_energy_dimensionless>0 and table_mom_sq[0]> min_removal_mom_sq )
         {
-            electron_stopping_power[0]-=moller_losses(electron_mom_sq[0], const_min_energy_dimensionless);
+            stopping_power[0]-=species_T::losses(table_mom_sq[0], const_min_energy_dimensionless);
         }
 
         //do bits larger than zero, except last one
         for(size_t i=1; i<table_size-1; i++)
         {
-            size_t loc=search_sorted_d(raw_electron_mom_sq, electron_mom_sq[i]);
-            electron_stopping_power[i] = factors[loc] * std::pow(electron_mom_sq[i], powers[loc]);
-            if(const_min_energy_dimensionless>0 and electron_mom_sq[i]> min_moller_removal_mom_sq )
+            size_t loc=search_sorted_d(raw_mom_sq, table_mom_sq[i]);
+            stopping_power[i] = factors[loc] * std::pow(table_mom_sq[i], powers[loc]);
+            if(const_min_energy_dimensionless>0 and table_mom_sq[i]> min_removal_mom_sq )
             {
-                electron_stopping_power[i]-=moller_losses(electron_mom_sq[i], const_min_energy_dimensionless);
+                stopping_power[i]-=species_T::losses(table_mom_sq[i], const_min_energy_dimensionless);
             }
         }
 
         //get last bit
-        electron_stopping_power[table_size-1]=raw_electron_stopping_power[raw_electron_stopping_power.size()-1];
-        if(const_min_energy_dimensionless>0 and electron_mom_sq[table_size-1]> min_moller_removal_mom_sq )
+        stopping_power[table_size-1]=raw_stopping_power[raw_stopping_power.size()-1];
+        if(const_min_energy_dimensionless>0 and table_mom_sq[table_size-1]> min_removal_mom_sq )
         {
-            electron_stopping_power[table_size-1]-=moller_losses(electron_mom_sq[table_size-1], const_min_energy_dimensionless);
+            stopping_power[table_size-1]-=species_T::losses(table_mom_sq[table_size-1], const_min_energy_dimensionless);
         }
 
         //finally, we interpolate the previous samples
-        electron_interp_powers=gsl::vector(table_size-1);
-        electron_interp_factors=gsl::vector(table_size-1);
+        interp_powers=gsl::vector(table_size-1);
+        interp_factors=gsl::vector(table_size-1);
         for(size_t i=0; i<(table_size-1); i++)
         {
-            electron_interp_powers[i]=std::log(electron_stopping_power[i+1]/electron_stopping_power[i]) / std::log(electron_mom_sq[i+1]/electron_mom_sq[i]);
-            electron_interp_factors[i]=electron_stopping_power[i]/std::pow(electron_mom_sq[i], electron_interp_powers[i]);
+            interp_powers[i]=std::log(stopping_power[i+1]/stopping_power[i]) / std::log(table_mom_sq[i+1]/table_mom_sq[i]);
+            interp_factors[i]=stopping_power[i]/std::pow(table_mom_sq[i], interp_powers[i]);
         }
-        //now have interpolants of electron stopping power that is in log space and interpolants are linear in log-log
+        //now have interpolants of stopping power that is in log space and interpolants are linear in log-log
         //which has the extra bennifit that they all(namly the first) intercept (0,0)
+
+        //cubic in each bin, in T=(position in the bin) from 0 to 1, from the value and slope (d/dT) of the power law at each end
+        log_first_mom_sq=std::log(table_mom_sq[0]);
+        double log_step=(std::log(table_mom_sq[table_size-1])-log_first_mom_sq)/(table_size-1);
+        inverse_log_step=1.0/log_step;
+        interp_cubics.resize((table_size-1)*4);
+        for(size_t i=0; i<(table_size-1); i++)
+        {
+            double start_value=stopping_power[i];
+            double end_value=interp_factors[i]*std::pow(table_mom_sq[i+1], interp_powers[i]);
+            double start_slope=start_value*interp_powers[i]*log_step;
+            double end_slope=end_value*interp_powers[i]*log_step;
+
+            interp_cubics[i*4]=start_value;
+            interp_cubics[i*4+1]=start_slope;
+            interp_cubics[i*4+2]=3*(end_value-start_value) - 2*start_slope - end_slope;
+            interp_cubics[i*4+3]=2*(start_value-end_value) + start_slope + end_slope;
+        }
     }
 
-    double electron_lookup(double electron_mom_sq_)
-    //give stopping power. Use if minimum energy is a constant, or not subtracting moller losses
+    void make_loss_table(double lowest_min_energy, double highest_min_energy, double energies_per_decade=64, size_t points_per_bin=8)
+    //tabulate secondary losses for minimum energies from lowest_min_energy to highest_min_energy, for mode 3. The U step is points_per_bin times
+    //finer than the stopping power table. With the defaults, the error is less than 5E-5 of the stopping power (see algorithm_tests/moller_loss_table_test.cpp)
+    {
+        if(lowest_min_energy<=0 or highest_min_energy<=lowest_min_energy or energies_per_decade<=0 or points_per_bin<1)
+        {
+            throw gen_exception("loss table needs 0<lowest_min_energy<highest_min_energy");
+        }
+
+        size_t num_energies=std::max(size_t(std::ceil(std::log10(highest_min_energy/lowest_min_energy)*energies_per_decade))+1, size_t(2));
+        log_lowest_loss_energy=std::log(lowest_min_energy);
+        double energy_step=(std::log(highest_min_energy)-log_lowest_loss_energy)/(num_energies-1);
+        inverse_loss_energy_step=1.0/energy_step;
+
+        //covers the whole stopping power table for the lowest minimum energy
+        double loss_step=1.0/(inverse_log_step*points_per_bin);
+        inverse_loss_step=1.0/loss_step;
+        double lowest_min_mom_sq=species_T::losses_start_mom_sq(lowest_min_energy);
+        double max_U=std::log(table_mom_sq[table_size-1]/lowest_min_mom_sq);
+        num_loss_points=std::max(size_t(std::ceil(max_U*inverse_loss_step))+1, size_t(2));
+        num_loss_energies=num_energies;
+
+        loss_table.resize(num_loss_points*num_loss_energies);
+        for(size_t j=0; j<num_loss_energies; j++)
+        {
+            double min_energy_= j==num_loss_energies-1 ? highest_min_energy : std::exp(log_lowest_loss_energy + j*energy_step);
+            double min_mom_sq=species_T::losses_start_mom_sq(min_energy_);
+            loss_table[j*num_loss_points]=0; //at the start of losses
+            for(size_t i=1; i<num_loss_points; i++)
+            {
+                loss_table[j*num_loss_points+i]=species_T::losses(min_mom_sq*std::exp(i*loss_step), min_energy_);
+            }
+        }
+    }
+
+    void save_loss_table(std::string fname)
+    //save the loss table, with ints: num_loss_points, num_loss_energies, table_size and the charge of the species,
+    //doubles: inverse_loss_step, log_lowest_loss_energy, inverse_loss_energy_step, log_first_mom_sq, inverse_log_step, then the table
+    {
+        if(num_loss_energies==0)
+        {
+            throw gen_exception("there is no loss table to save");
+        }
+
+        arrays_output out;
+        gsl::vector_long shape(4);
+        shape[0]=num_loss_points;
+        shape[1]=num_loss_energies;
+        shape[2]=table_size;
+        shape[3]=species_T::charge;
+        out.add_ints(shape);
+        out.add_doubles( gsl::vector({inverse_loss_step, log_lowest_loss_energy, inverse_loss_energy_step, log_first_mom_sq, inverse_log_step}) );
+
+        gsl::vector table(loss_table.size());
+        for(size_t i=0; i<loss_table.size(); i++)
+        {
+            table[i]=loss_table[i];
+        }
+        out.add_doubles(table);
+        out.to_file(fname);
+    }
+
+    bool load_loss_table(std::string fname)
+    //load a table saved by save_loss_table. Returns false if the file does not exist, or was made from a different stopping power table or species
+    {
+        std::ifstream test_file(fname.c_str());
+        if(not test_file.good()) return false;
+        test_file.close();
+
+        binary_input fin(fname);
+        array_input table_in(fin);
+        gsl::vector_long shape=table_in.read_intsArray();
+        gsl::vector steps=table_in.read_doublesArray();
+        gsl::vector table=table_in.read_doublesArray();
+        if(shape.size()!=4 or steps.size()!=5 or size_t(shape[2])!=table_size or shape[3]!=species_T::charge or steps[3]!=log_first_mom_sq or steps[4]!=inverse_log_step
+           or table.size()!=size_t(shape[0]*shape[1]))
+        {
+            return false;
+        }
+
+        num_loss_points=shape[0];
+        num_loss_energies=shape[1];
+        inverse_loss_step=steps[0];
+        log_lowest_loss_energy=steps[1];
+        inverse_loss_energy_step=steps[2];
+        loss_table.resize(table.size());
+        for(size_t i=0; i<table.size(); i++)
+        {
+            loss_table[i]=table[i];
+        }
+        return true;
+    }
+
+    removal_energy_T removal_energy(double min_energy_)
+    //for lookup_variable_RML. Make again if the loss table changes
+    {
+        removal_energy_T out;
+        out.energy=min_energy_;
+        out.min_mom_sq=species_T::losses_start_mom_sq(min_energy_);
+        out.log_min_mom_sq=std::log(out.min_mom_sq);
+
+        double F=(std::log(min_energy_)-log_lowest_loss_energy)*inverse_loss_energy_step;
+        out.in_table= num_loss_energies>0 and F>=0 and F<=num_loss_energies-1;
+        out.energy_index=0;
+        out.energy_weight=0;
+        if(out.in_table)
+        {
+            out.energy_index=std::min(size_t(F), num_loss_energies-2);
+            out.energy_weight=F-out.energy_index;
+        }
+        return out;
+    }
+
+    inline double table_losses(double log_mom_sq, const removal_energy_T& removal)
+    //bilinear in the loss table. mom_sq needs to be in the stopping power table, and above removal.min_mom_sq
+    {
+        double F=(log_mom_sq-removal.log_min_mom_sq)*inverse_loss_step;
+        size_t index= F>0 ? size_t(F) : 0;
+        if(index>=num_loss_points-1) index=num_loss_points-2;
+        double T=F-index;
+
+        const double* low=&loss_table[removal.energy_index*num_loss_points + index];
+        const double* high=low+num_loss_points;
+        double low_loss=low[0] + T*(low[1]-low[0]);
+        double high_loss=high[0] + T*(high[1]-high[0]);
+        return low_loss + removal.energy_weight*(high_loss-low_loss);
+    }
+
+    inline double table_stopping_power(double mom_sq_)
+    //stopping power inside the table, without searching. mom_sq_ needs to be between the first and last table_mom_sq
+    {
+        return table_stopping_power_log(std::log(mom_sq_));
+    }
+
+    inline double table_stopping_power_log(double log_mom_sq)
+    //same, from the log of momentum squared
+    {
+        double F=(log_mom_sq-log_first_mom_sq)*inverse_log_step;
+        size_t index=size_t(F);
+        if(index>=table_size-1) index=table_size-2; //the last point, or rounding
+        double T=F-index;
+        const double* cubic=&interp_cubics[index*4];
+        return cubic[0] + T*(cubic[1] + T*(cubic[2] + T*cubic[3]));
+    }
+
+    double lookup(double mom_sq_)
+    //give stopping power. Use if minimum energy is a constant, or not subtracting secondary losses
 	{
-        if(electron_mom_sq_<electron_mom_sq[0])
+        if(mom_sq_<table_mom_sq[0])
         {
-            return electron_interp_factors[0]*std::pow(electron_mom_sq_, electron_interp_powers[0]); //use first interpolant to extrapolate to very low energy
+            return interp_factors[0]*std::pow(mom_sq_, interp_powers[0]); //use first interpolant to extrapolate to very low energy
         }
-        else if(electron_mom_sq_>electron_mom_sq[electron_mom_sq.size()-1])
+        else if(mom_sq_>table_mom_sq[table_size-1])
         {
-            if(moller_removed and electron_mom_sq_>=min_mom_sq_for_moller)
+            if(losses_removed and mom_sq_>=min_mom_sq_for_losses)
             {
-                return bethe_subtract_moller(electron_mom_sq_, min_energy);
+                return species_T::formula_subtract_losses(mom_sq_, min_energy);
             }
             else
             {
-                return bethe_formula(electron_mom_sq_);
+                return species_T::formula(mom_sq_);
             }
 
         }
         else
         {
-            size_t index=search_sorted_exponential(electron_mom_sq, electron_mom_sq_);
-            return electron_interp_factors[index]* std::pow(electron_mom_sq_, electron_interp_powers[index]);
+            return table_stopping_power(mom_sq_);
         }
 	}
 
-	double electron_lookup_variable_RML(double electron_mom_sq_, double min_energy_)
-	//use this if minimum energy can vary, and used default constructor
+	void lookup(const double* mom_sq_, double* stopping_power, int N)
+	//lookup for N momenta at once. Gives the same results as lookup for each.
+	//The bins and positions of all momenta are found first, which vectorizes, then the cubics are gathered. Momenta outside the table are done after
 	{
-	    min_energy=min_energy_;
-	    double min_mom_sq_for_moller__=min_energy*2.0+1.0;
-	    min_mom_sq_for_moller__*=min_mom_sq_for_moller__;
-	    min_mom_sq_for_moller__-=1.0;
+	    const int chunk=16;
+	    size_t index[chunk];
+	    double T[chunk];
+	    double first_mom_sq=table_mom_sq[0];
+	    double last_mom_sq=table_mom_sq[table_size-1];
+	    for(int start=0; start<N; start+=chunk)
+	    {
+	        int num= N-start<chunk ? N-start : chunk;
+	        const double* mom_sq=mom_sq_+start;
+	        double* out=stopping_power+start;
+
+	        bool all_inside=true;
+	        for(int i=0; i<num; i++)
+	        {
+	            double F=(std::log(mom_sq[i])-log_first_mom_sq)*inverse_log_step;
+	            bool inside= mom_sq[i]>=first_mom_sq and mom_sq[i]<=last_mom_sq;
+	            all_inside= all_inside and inside;
+	            F= inside ? F : 0.0;
+	            size_t I=size_t(F);
+	            I= I>=table_size-1 ? table_size-2 : I;
+	            index[i]=I;
+	            T[i]=F-I;
+	        }
+
+	        for(int i=0; i<num; i++)
+	        {
+	            const double* cubic=&interp_cubics[index[i]*4];
+	            out[i]=cubic[0] + T[i]*(cubic[1] + T[i]*(cubic[2] + T[i]*cubic[3]));
+	        }
+
+	        if(not all_inside)
+	        {
+	            for(int i=0; i<num; i++)
+	            {
+	                if(mom_sq[i]<first_mom_sq or mom_sq[i]>last_mom_sq)
+	                {
+	                    out[i]=lookup(mom_sq[i]);
+	                }
+	            }
+	        }
+	    }
+	}
 
-        if(electron_mom_sq_<electron_mom_sq[0])
+	double lookup_variable_RML(double mom_sq_, double min_energy_)
+	//use this if minimum energy can vary, and used default constructor. The version with a removal_energy_T is faster
+	{
+	    //does not set min_energy, so that this can be used from many threads
+	    return lookup_variable_RML(mom_sq_, removal_energy(min_energy_));
+	}
+
+	double lookup_variable_RML(double mom_sq_, const removal_energy_T& removal)
+	//same, with the minimum energy from removal_energy. Uses the loss table if the energy is in it
+	{
+        if(mom_sq_<table_mom_sq[0])
         {
-            return electron_interp_factors[0]*std::pow(electron_mom_sq_, electron_interp_powers[0]); //use first interpolant to extrapolate to very low energy
+            return interp_factors[0]*std::pow(mom_sq_, interp_powers[0]); //use first interpolant to extrapolate to very low energy
         }
-        else if(electron_mom_sq_>electron_mom_sq[electron_mom_sq.size()-1])
+        else if(mom_sq_>table_mom_sq[table_size-1])
         {
-            if(electron_mom_sq_>=min_mom_sq_for_moller__)
+            if(mom_sq_>=removal.min_mom_sq)
             {
-                return bethe_subtract_moller(electron_mom_sq_, min_energy);
+                return species_T::formula_subtract_losses(mom_sq_, removal.energy);
             }
             else
             {
-                return bethe_formula(electron_mom_sq_);
+                return species_T::formula(mom_sq_);
             }
 
         }
         else
         {
-            size_t index=search_sorted_exponential(electron_mom_sq, electron_mom_sq_);
-            double SP= electron_interp_factors[index]* std::pow(electron_mom_sq_, electron_interp_powers[index]);
-            if( electron_mom_sq_>=min_mom_sq_for_moller__)
-            {
-                return SP-=moller_losses(electron_mom_sq_, min_energy);
-            }
-            else
+            double log_mom_sq=std::log(mom_sq_);
+            double SP=table_stopping_power_log(log_mom_sq);
+            if( mom_sq_>=removal.min_mom_sq)
             {
-                return SP;
+                if(removal.in_table)
+                {
+                    SP-=table_losses(log_mom_sq, removal);
+                }
+                else
+                {
+                    SP-=species_T::losses(mom_sq_, removal.energy);
+                }
             }
+            return SP;
         }
 	}
+
+	void lookup_variable_RML(const double* mom_sq_, double min_energy_, double* stopping_power, int N)
+	//lookup_variable_RML for N momenta at once
+	{
+	    lookup_variable_RML(mom_sq_, removal_energy(min_energy_), stopping_power, N);
+	}
+
+	void lookup_variable_RML(const double* mom_sq_, const removal_energy_T& removal, double* stopping_power, int N)
+	//same, with the minimum energy from removal_energy
+	{
+	    for(int i=0; i<N; i++)
+	    {
+	        stopping_power[i]=lookup_variable_RML(mom_sq_[i], removal);
+	    }
+	}
+
+	//names from before positrons
+	inline double electron_lookup(double electron_mom_sq_){ return lookup(electron_mom_sq_); }
+	inline void electron_lookup(const double* electron_mom_sq_, double* stopping_power, int N){ lookup(electron_mom_sq_, stopping_power, N); }
+	inline double electron_lookup_variable_RML(double electron_mom_sq_, double min_energy_){ return lookup_variable_RML(electron_mom_sq_, min_energy_); }
+	inline double electron_lookup_variable_RML(double electron_mom_sq_, const removal_energy_T& removal){ return lookup_variable_RML(electron_mom_sq_, removal); }
 };
 
+typedef ionization_table<electron_species> electron_ionization_table;
+typedef ionization_table<positron_species> positron_ionization_table;
 
-////positrons not implemented yet
 
 #endif
@@ -0,0 +1,359 @@
+#ifndef ELECTRON_STORE
+#define ELECTRON_STORE
+
+#include <vector>
+#include <cstddef>
+
+#include "gen_ex.hpp"
+
+#include "particles.hpp"
+
+//// structure-of-arrays storage for electrons ////
+// Every electron_T is a seperate heap object, which is slow (cache misses) when there are very many electrons.
+// electron_store keeps each quantity of all the electrons in one contiguous array, and electrons are refered to by an index (a handle).
+// A handle stays valid untill that electron is removed. Slots of removed electrons are re-used, so once the store has grown
+// to its working size, adding and removing electrons does not allocate.
+// load and save copy an electron between the store and a (re-usable) electron_T, for code that works on single electrons.
+// Interpolants are kept in a seperate array of blocks, and only electrons that have an interpolant use a block.
+
+class electron_store
+{
+public:
+    static const size_t npos=size_t(-1); //returned instead of a handle if there is no electron
+    static const size_t interpolant_stride=2*3*electron_T::interpolant_order; //doubles per interpolant block: position then momentum coefficients, with 3 components each
+
+    ////physical data, one entry per slot////
+    std::vector<double> pos_x; //dimensionless, in units of distance_units
+    std::vector<double> pos_y;
+    std::vector<double> pos_z;
+    std::vector<double> mom_x; //dimensionless, in units of electron-rest-mass/c
+    std::vector<double> mom_y;
+    std::vector<double> mom_z;
+    std::vector<double> energy;
+    std::vector<double> weight;
+
+    std::vector<double> current_time;
+    std::vector<double> tally_start_time;
+    std::vector<double> timestep;
+    std::vector<double> next_timestep;
+    std::vector<double> last_step_error;
+    std::vector<double> interpolant_timestep;
+
+    std::vector<size_t> ID;
+    std::vector<int> charge;
+
+    //Dormand-Prince Runge-Kutta
+    std::vector<size_t> interpolant_block; //index of block in interpolant, npos if electron has no interpolant
+
+    ////interpolant blocks////
+    std::vector<double> interpolant;
+    std::vector<size_t> free_interpolant_blocks;
+
+    ////book keeping////
+    std::vector<char> alive;
+    std::vector<size_t> free_slots;
+    size_t num_alive;
+
+    electron_store()
+    {
+        num_alive=0;
+    }
+
+    void reserve(size_t N)
+    //reserve space for N electrons
+    {
+        pos_x.reserve(N);
+        pos_y.reserve(N);
+        pos_z.reserve(N);
+        mom_x.reserve(N);
+        mom_y.reserve(N);
+        mom_z.reserve(N);
+        energy.reserve(N);
+        weight.reserve(N);
+        current_time.reserve(N);
+        tally_start_time.reserve(N);
+        timestep.reserve(N);
+        next_timestep.reserve(N);
+        last_step_error.reserve(N);
+        interpolant_timestep.reserve(N);
+        ID.reserve(N);
+        charge.reserve(N);
+        interpolant_block.reserve(N);
+        alive.reserve(N);
+    }
+
+    inline size_t size()
+    //number of slots, including ones that are not currently used. Handles are always less than this
+    {
+        return alive.size();
+    }
+
+    inline size_t num_electrons()
+    {
+        return num_alive;
+    }
+
+    inline bool is_alive(size_t handle)
+    {
+        return handle<alive.size() and alive[handle];
+    }
+
+    inline bool has_interpolant(size_t handle)
+    {
+        return interpolant_block[handle]!=npos;
+    }
+
+    void clear()
+    //remove all electrons. Keeps the memory
+    {
+        free_slots.clear();
+        for(size_t i=alive.size(); i>0; i--)
+        {
+            alive[i-1]=false;
+            interpolant_block[i-1]=npos;
+            free_slots.push_back(i-1);
+        }
+
+        free_interpolant_blocks.clear();
+        for(size_t i=interpolant.size()/interpolant_stride; i>0; i--)
+        {
+            free_interpolant_blocks.push_back(i-1);
+        }
+        num_alive=0;
+    }
+
+    size_t add()
+    //add a new electron with default values. Returns the handle
+    {
+        size_t handle=new_slot();
+
+        ID[handle]=particle_ID_T::new_ID();
+        charge[handle]=-1;//electron
+        set_position(handle, 0,0,0);
+        set_momentum(handle, 0,0,0);
+        energy[handle]=0;
+        weight[handle]=1;
+        current_time[handle]=0;
+        tally_start_time[handle]=0;
+        timestep[handle]=0.0001;
+        next_timestep[handle]=0.0001;
+        last_step_error[handle]=1.0E-4;
+        interpolant_timestep[handle]=0;
+
+        return handle;
+    }
+
+    size_t add(electron_T* electron)
+    //add a copy of an electron to the store, including its ID. Returns the handle
+    {
+        size_t handle=new_slot();
+        save(handle, electron);
+        return handle;
+    }
+
+    void remove(size_t handle)
+    {
+        if(not is_alive(handle))
+        {
+            throw gen_exception("electron ", handle, " is not in the store");
+        }
+        release_interpolant(handle);
+        alive[handle]=false;
+        free_slots.push_back(handle);
+        num_alive--;
+    }
+
+    inline void set_position(size_t handle, double x, double y, double z)
+    {
+        pos_x[handle]=x;
+        pos_y[handle]=y;
+        pos_z[handle]=z;
+    }
+
+    inline void set_momentum(size_t handle, double x, double y, double z)
+    {
+        mom_x[handle]=x;
+        mom_y[handle]=y;
+        mom_z[handle]=z;
+    }
+
+    inline void update_energy(size_t handle)
+    {
+        energy[handle]=std::sqrt(mom_x[handle]*mom_x[handle] + mom_y[handle]*mom_y[handle] + mom_z[handle]*mom_z[handle] + 1.0) - 1.0;
+    }
+
+    void load_kinematics(size_t handle, electron_T* electron)
+    //copy everything except the interpolant into electron
+    {
+        electron->ID=ID[handle];
+        electron->charge=charge[handle];
+        electron->energy=energy[handle];
+        electron->weight=weight[handle];
+        electron->set_position(pos_x[handle], pos_y[handle], pos_z[handle]);
+        electron->set_momentum(mom_x[handle], mom_y[handle], mom_z[handle]);
+        electron->current_time=current_time[handle];
+        electron->tally_start_time=tally_start_time[handle];
+        electron->timestep=timestep[handle];
+        electron->next_timestep=next_timestep[handle];
+        electron->last_step_error=last_step_error[handle];
+    }
+
+    void save_kinematics(size_t handle, electron_T* electron)
+    //copy everything except the interpolant from electron into the store
+    {
+        ID[handle]=electron->ID;
+        charge[handle]=electron->charge;
+        energy[handle]=electron->energy;
+        weight[handle]=electron->weight;
+        set_position(handle, electron->position[0], electron->position[1], electron->position[2]);
+        set_momentum(handle, electron->momentum[0], electron->momentum[1], electron->momentum[2]);
+        current_time[handle]=electron->current_time;
+        tally_start_time[handle]=electron->tally_start_time;
+        timestep[handle]=electron->timestep;
+        next_timestep[handle]=electron->next_timestep;
+        last_step_error[handle]=electron->last_step_error;
+    }
+
+    void load(size_t handle, electron_T* electron)
+    //copy the electron at handle into electron
+    {
+        load_kinematics(handle, electron);
+
+        size_t block=interpolant_block[handle];
+        electron->has_interpolant= block!=npos;
+        if(block!=npos)
+        {
+            electron->interpolant_timestep=interpolant_timestep[handle];
+
+            const double* coefs=&interpolant[block*interpolant_stride];
+            for(int i=0; i<electron_T::interpolant_order; i++)
+            {
+                electron->pos_interpolant[i].set(coefs[0], coefs[1], coefs[2]);
+                coefs+=3;
+            }
+            for(int i=0; i<electron_T::interpolant_order; i++)
+            {
+                electron->mom_interpolant[i].set(coefs[0], coefs[1], coefs[2]);
+                coefs+=3;
+            }
+        }
+    }
+
+    void save(size_t handle, electron_T* electron)
+    //copy electron into the store, at handle
+    {
+        save_kinematics(handle, electron);
+
+        if(electron->has_interpolant)
+        {
+            size_t block=interpolant_block[handle];
+            if(block==npos)
+            {
+                block=new_interpolant_block();
+                interpolant_block[handle]=block;
+            }
+            interpolant_timestep[handle]=electron->interpolant_timestep;
+
+            double* coefs=&interpolant[block*interpolant_stride];
+            for(int i=0; i<electron_T::interpolant_order; i++)
+            {
+                coefs[0]=electron->pos_interpolant[i][0];
+                coefs[1]=electron->pos_interpolant[i][1];
+                coefs[2]=electron->pos_interpolant[i][2];
+                coefs+=3;
+            }
+            for(int i=0; i<electron_T::interpolant_order; i++)
+            {
+                coefs[0]=electron->mom_interpolant[i][0];
+                coefs[1]=electron->mom_interpolant[i][1];
+                coefs[2]=electron->mom_interpolant[i][2];
+                coefs+=3;
+            }
+        }
+        else
+        {
+            release_interpolant(handle);
+        }
+    }
+
+    double* interpolant_coefficients(size_t handle, double interpolant_timestep_)
+    //give an electron an interpolant over interpolant_timestep_, and return its coefficients to be filled in (laid out as in save).
+    //the pointer is only valid untill the next interpolant is made
+    {
+        size_t block=interpolant_block[handle];
+        if(block==npos)
+        {
+            block=new_interpolant_block();
+            interpolant_block[handle]=block;
+        }
+        interpolant_timestep[handle]=interpolant_timestep_;
+        return &interpolant[block*interpolant_stride];
+    }
+
+private:
+
+    size_t new_slot()
+    //get an unused slot, grow the arrays if there are none
+    {
+        size_t handle;
+        if(free_slots.size()>0)
+        {
+            handle=free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            handle=alive.size();
+
+            pos_x.push_back(0);
+            pos_y.push_back(0);
+            pos_z.push_back(0);
+            mom_x.push_back(0);
+            mom_y.push_back(0);
+            mom_z.push_back(0);
+            energy.push_back(0);
+            weight.push_back(1);
+            current_time.push_back(0);
+            tally_start_time.push_back(0);
+            timestep.push_back(0);
+            next_timestep.push_back(0);
+            last_step_error.push_back(0);
+            interpolant_timestep.push_back(0);
+            ID.push_back(0);
+            charge.push_back(0);
+            interpolant_block.push_back(npos);
+            alive.push_back(false);
+        }
+
+        alive[handle]=true;
+        num_alive++;
+        return handle;
+    }
+
+    size_t new_interpolant_block()
+    {
+        if(free_interpolant_blocks.size()>0)
+        {
+            size_t block=free_interpolant_blocks.back();
+            free_interpolant_blocks.pop_back();
+            return block;
+        }
+
+        size_t block=interpolant.size()/interpolant_stride;
+        interpolant.resize(interpolant.size()+interpolant_stride, 0.0);
+        return block;
+    }
+
+    void release_interpolant(size_t handle)
+    {
+        if(interpolant_block[handle]!=npos)
+        {
+            free_interpolant_blocks.push_back(interpolant_block[handle]);
+            interpolant_block[handle]=npos;
+        }
+    }
+};
+const size_t electron_store::npos;
+const size_t electron_store::interpolant_stride;
+
+#endif
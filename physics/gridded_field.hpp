@@ -0,0 +1,374 @@
+#ifndef GRIDDED_FIELD_HPP
+#define GRIDDED_FIELD_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+#include "vector.hpp"
+#include "vector_float.hpp"
+#include "vector_long.hpp"
+
+#include "vec3.hpp"
+#include "gen_ex.hpp"
+#include "binary_IO.hpp"
+#include "arrays_IO.hpp"
+
+#include "quasi_static_fields.hpp"
+
+//// field on a regular grid, with trilinear interpolation ////
+// For realistic thunderstorm fields. The grid is loaded from a binary file (see gridded_field(fname) for the format), or filled with set_node.
+// The field is zero outside the grid.
+//
+// The nodes are stored in tiles of 4x4x4 nodes (with the three components of a node next to each other), so the 8 corners of a cell, and the cells
+// that a particle passes through next, are nearly always in the same one or two cache lines, instead of being spread over planes that are
+// Nx*Ny nodes apart. storage_T can be float, to halve the memory of large grids. The interpolation is always done in double.
+//
+// If axisymmetric, the grid is in (r, z), with Ny=1, and the three components are (r, phi, z). Positions are converted to (r, 0, z), and the
+// field is rotated back to cartesian.
+//
+// evaluate_batch first finds the cells and weights of all points, which is simple arithmetic that vectorizes, and then gathers the corners.
+
+template<typename storage_T>
+class gridded_field : public field
+{
+public:
+
+    static const int tile_shift=2; //tiles are 2^tile_shift nodes on a side
+    static const int tile_mask=(1<<tile_shift)-1;
+    static const int nodes_per_tile=1<<(3*tile_shift);
+    static const int batch_chunk=16; //points that evaluate_batch locates at once
+
+    int num_nodes[3];
+    int num_tiles[3];
+    size_t tile_stride[3]; //nodes between neighbouring tiles in each direction
+    double origin[3];
+    double spacing[3];
+    double inverse_spacing[3];
+    bool axisymmetric;
+
+    std::vector<storage_T> data;
+
+    gridded_field()
+    {
+        set_grid(vec3(0,0,0), vec3(1,1,1), 2, 2, 2);
+    }
+
+    gridded_field(const vec3& origin_, const vec3& spacing_, int Nx, int Ny, int Nz, bool axisymmetric_=false)
+    //empty grid, fill with set_node
+    {
+        set_grid(origin_, spacing_, Nx, Ny, Nz, axisymmetric_);
+    }
+
+    gridded_field(std::string fname)
+    //load from a file made by write_out. The file has an array of arrays:
+    //  ints: Nx, Ny, Nz, and 1 if axisymmetric (else 0)
+    //  doubles: origin (X, Y, Z), then spacing (X, Y, Z)
+    //  three arrays (doubles or floats) of the X, Y, and Z components (or r, phi, z) at each node, with index (i*Ny + j)*Nz + k
+    {
+        binary_input fin(fname);
+        array_input table_in(fin);
+
+        gsl::vector_long shape=table_in.read_intsArray();
+        gsl::vector geometry=table_in.read_doublesArray();
+        if(shape.size()!=4 or geometry.size()!=6)
+        {
+            throw gen_exception("gridded field file ", fname, " has wrong header");
+        }
+        set_grid(vec3(geometry[0], geometry[1], geometry[2]), vec3(geometry[3], geometry[4], geometry[5]), shape[0], shape[1], shape[2], shape[3]!=0);
+
+        size_t num_total=size_t(num_nodes[0])*num_nodes[1]*num_nodes[2];
+        for(int component=0; component<3; component++)
+        {
+            array_input component_in=table_in.get_array();
+            if(size_t(component_in.get_size())!=num_total)
+            {
+                throw gen_exception("gridded field file ", fname, " has ", component_in.get_size(), " values, expected ", num_total);
+            }
+
+            if(component_in.get_type()==2)
+            {
+                gsl::vector_float values=component_in.read_floats();
+                fill_component(component, values);
+            }
+            else
+            {
+                gsl::vector values=component_in.read_doubles();
+                fill_component(component, values);
+            }
+        }
+    }
+
+    void set_grid(const vec3& origin_, const vec3& spacing_, int Nx, int Ny, int Nz, bool axisymmetric_=false)
+    //set the shape of the grid, and zero the field
+    {
+        axisymmetric=axisymmetric_;
+        num_nodes[0]=Nx;
+        num_nodes[1]=Ny;
+        num_nodes[2]=Nz;
+        if(axisymmetric and Ny!=1)
+        {
+            throw gen_exception("axisymmetric grids need Ny=1");
+        }
+
+        for(int d=0; d<3; d++)
+        {
+            if(num_nodes[d]<1 or (num_nodes[d]<2 and not (axisymmetric and d==1)))
+            {
+                throw gen_exception("gridded field needs at least two nodes in each direction");
+            }
+            origin[d]=origin_[d];
+            spacing[d]=spacing_[d];
+            inverse_spacing[d]=1.0/spacing[d];
+            num_tiles[d]=(num_nodes[d]+tile_mask)>>tile_shift;
+        }
+        tile_stride[0]=nodes_per_tile;
+        tile_stride[1]=tile_stride[0]*num_tiles[0];
+        tile_stride[2]=tile_stride[1]*num_tiles[1];
+
+        data.assign(size_t(num_tiles[0])*num_tiles[1]*num_tiles[2]*nodes_per_tile*3, storage_T(0));
+    }
+
+    inline size_t axis_offset(int d, int i) const
+    //the node index is the sum of one offset for each direction
+    {
+        return (i>>tile_shift)*tile_stride[d] + (size_t(i&tile_mask)<<(d*tile_shift));
+    }
+
+    inline size_t node_index(int i, int j, int k) const
+    //index in data of the X component of node (i,j,k)
+    {
+        return (axis_offset(0, i) + axis_offset(1, j) + axis_offset(2, k))*3;
+    }
+
+    void set_node(int i, int j, int k, double X, double Y, double Z)
+    {
+        size_t index=node_index(i, j, k);
+        data[index]=X;
+        data[index+1]=Y;
+        data[index+2]=Z;
+    }
+
+    vec3 get_node(int i, int j, int k) const
+    {
+        size_t index=node_index(i, j, k);
+        return vec3(data[index], data[index+1], data[index+2]);
+    }
+
+    void write_out(std::string fname, bool as_floats=std::is_same<storage_T, float>::value)
+    //write in the format read by gridded_field(fname)
+    {
+        arrays_output tables_out;
+
+        gsl::vector_long shape(4);
+        shape[0]=num_nodes[0];
+        shape[1]=num_nodes[1];
+        shape[2]=num_nodes[2];
+        shape[3]=axisymmetric ? 1 : 0;
+        tables_out.add_ints(shape);
+
+        gsl::vector geometry({origin[0], origin[1], origin[2], spacing[0], spacing[1], spacing[2]});
+        tables_out.add_doubles(geometry);
+
+        size_t num_total=size_t(num_nodes[0])*num_nodes[1]*num_nodes[2];
+        for(int component=0; component<3; component++)
+        {
+            gsl::vector values(num_total);
+            gsl::vector_float float_values(num_total);
+            size_t n=0;
+            for(int i=0; i<num_nodes[0]; i++)
+            for(int j=0; j<num_nodes[1]; j++)
+            for(int k=0; k<num_nodes[2]; k++)
+            {
+                values[n]=data[node_index(i, j, k)+component];
+                float_values[n]=values[n];
+                n++;
+            }
+
+            if(as_floats)
+            {
+                tables_out.add_array(std::make_shared<floats_output>(float_values));
+            }
+            else
+            {
+                tables_out.add_doubles(values);
+            }
+        }
+
+        tables_out.to_file(fname);
+    }
+
+    //// interpolation ////
+
+    inline bool locate(double X, double Y, double Z, int* index, double* weight) const
+    //cell (lowest corner) and weights of a point. Returns false if outside the grid
+    {
+        double grid_position[3];
+        if(axisymmetric)
+        {
+            grid_position[0]=std::sqrt(X*X + Y*Y);
+            grid_position[1]=origin[1];
+            grid_position[2]=Z;
+        }
+        else
+        {
+            grid_position[0]=X;
+            grid_position[1]=Y;
+            grid_position[2]=Z;
+        }
+
+        bool inside=true;
+        for(int d=0; d<3; d++)
+        {
+            double F=(grid_position[d]-origin[d])*inverse_spacing[d];
+            int last_cell=num_nodes[d]-2;
+            inside= inside and F>=0 and F<=last_cell+1; //false for NaN
+            int I= F>0 ? int(F) : 0;
+            if(I>last_cell) I= last_cell>0 ? last_cell : 0;
+            index[d]=I;
+            weight[d]= num_nodes[d]>1 ? F-I : 0.0;
+        }
+        return inside;
+    }
+
+    inline void interpolate(const int* index, const double* weight, double* out) const
+    //trilinear interpolation in a cell
+    {
+        int next_j= num_nodes[1]>1 ? 1 : 0; //axisymmetric grids only have one node in Y
+        size_t offset_i[2]={axis_offset(0, index[0]), axis_offset(0, index[0]+1)};
+        size_t offset_j[2]={axis_offset(1, index[1]), axis_offset(1, index[1]+next_j)};
+        size_t offset_k[2]={axis_offset(2, index[2]), axis_offset(2, index[2]+1)};
+
+        out[0]=0;
+        out[1]=0;
+        out[2]=0;
+        for(int dk=0; dk<2; dk++)
+        {
+            double w_k= dk ? weight[2] : 1.0-weight[2];
+            for(int dj=0; dj<2; dj++)
+            {
+                double w_jk=w_k*(dj ? weight[1] : 1.0-weight[1]);
+                const storage_T* corner_0=&data[(offset_i[0] + offset_j[dj] + offset_k[dk])*3];
+                const storage_T* corner_1=&data[(offset_i[1] + offset_j[dj] + offset_k[dk])*3];
+                double w_0=w_jk*(1.0-weight[0]);
+                double w_1=w_jk*weight[0];
+                out[0]+=w_0*corner_0[0] + w_1*corner_1[0];
+                out[1]+=w_0*corner_0[1] + w_1*corner_1[1];
+                out[2]+=w_0*corner_0[2] + w_1*corner_1[2];
+            }
+        }
+    }
+
+    inline void to_cartesian(double X, double Y, double* F) const
+    //for axisymmetric grids, rotate (r, phi, z) components at (X,Y) to cartesian
+    {
+        double R=std::sqrt(X*X + Y*Y);
+        double cos_phi=1;
+        double sin_phi=0;
+        if(R>0)
+        {
+            cos_phi=X/R;
+            sin_phi=Y/R;
+        }
+        double F_r=F[0];
+        double F_phi=F[1];
+        F[0]=F_r*cos_phi - F_phi*sin_phi;
+        F[1]=F_r*sin_phi + F_phi*cos_phi;
+    }
+
+    inline void evaluate(const vec3& position, double time, vec3& out)
+    {
+        int index[3];
+        double weight[3];
+        if(not locate(position[0], position[1], position[2], index, weight))
+        {
+            out.set(0,0,0);
+            return;
+        }
+
+        interpolate(index, weight, out.values);
+        if(axisymmetric)
+        {
+            to_cartesian(position[0], position[1], out.values);
+        }
+    }
+
+    inline void evaluate_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
+    {
+        int index[batch_chunk][3];
+        double weight[batch_chunk][3];
+        bool inside[batch_chunk];
+
+        for(int first=0; first<N; first+=batch_chunk)
+        {
+            int num_points= N-first<batch_chunk ? N-first : batch_chunk;
+
+            for(int p=0; p<num_points; p++)
+            {
+                inside[p]=locate(X[first+p], Y[first+p], Z[first+p], index[p], weight[p]);
+            }
+
+            for(int p=0; p<num_points; p++)
+            {
+                double F[3]={0,0,0};
+                if(inside[p])
+                {
+                    interpolate(index[p], weight[p], F);
+                    if(axisymmetric)
+                    {
+                        to_cartesian(X[first+p], Y[first+p], F);
+                    }
+                }
+                out_X[first+p]=F[0];
+                out_Y[first+p]=F[1];
+                out_Z[first+p]=F[2];
+            }
+        }
+    }
+
+    //// virtual interface ////
+
+    vec3 get(const vec3& position)
+    {
+        vec3 out;
+        evaluate(position, 0, out);
+        return out;
+    }
+
+    vec3 get(const vec3& position, double time)
+    {
+        vec3 out;
+        evaluate(position, time, out);
+        return out;
+    }
+
+    void get_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
+    {
+        evaluate_batch(X, Y, Z, time, out_X, out_Y, out_Z, N);
+    }
+
+private:
+
+    template<typename vector_T>
+    void fill_component(int component, const vector_T& values)
+    {
+        size_t n=0;
+        for(int i=0; i<num_nodes[0]; i++)
+        for(int j=0; j<num_nodes[1]; j++)
+        for(int k=0; k<num_nodes[2]; k++)
+        {
+            data[node_index(i, j, k)+component]=values[n];
+            n++;
+        }
+    }
+};
+
+template<typename storage_T> const int gridded_field<storage_T>::tile_shift;
+template<typename storage_T> const int gridded_field<storage_T>::tile_mask;
+template<typename storage_T> const int gridded_field<storage_T>::nodes_per_tile;
+template<typename storage_T> const int gridded_field<storage_T>::batch_chunk;
+
+#endif
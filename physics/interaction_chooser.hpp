@@ -278,6 +278,7 @@ template< int num_interaction_types>
 class interaction_chooser_quadratic
 //find when and which interaction occurs, assuming that interaction rate changes quadraticly during the timestep
 //has warnings if the interaction rate changes too quickly
+//the time of the first interaction is sampled directly, without sampling the number of interactions (see algorithm_tests/interaction_chooser_test.cpp)
 {
 private:
     std::array<physical_interaction*, num_interaction_types> interactions;
@@ -309,7 +310,7 @@ private:
 
 
     ////class to find interaction time
-    class interaction_time_finder : public functor_1D
+    class interaction_time_finder
     {
         public:
         double constant;
@@ -325,11 +326,16 @@ private:
             C=C_;
         }
 
-        double call(double t_bar)
+        double operator()(double t_bar)
         {
             return ((C*t_bar + B)*t_bar + A)*t_bar + constant;
         }
 
+        double derivative(double t_bar)
+        {
+            return (3.0*C*t_bar + 2.0*B)*t_bar + A;
+        }
+
     };
 
 
@@ -436,11 +442,12 @@ private:
 */
 
 
-        //find number of interactions in timestep
+        //interactions are a Poisson process, so the expected number of interactions before the first one is exponentially distributed.
+        //If that is more than the expected number in the timestep, there is no interaction
         double total_expected_num_interactions_in_timestep=(total_A + 0.5*total_B + total_C/3.0)*timestep_size;
-        int total_actuall_interactions=rand.poisson(total_expected_num_interactions_in_timestep);
+        double first_interaction_number=rand.exponential(1.0);
 
-        if(total_actuall_interactions==0)
+        if(not (first_interaction_number<total_expected_num_interactions_in_timestep))
         {
             //no interactions
             interaction_chosen=-1;
@@ -478,21 +485,15 @@ private:
         //}
 
 
-        //select time of interaction
-        double min_interaction_time_rand=2.0;
-        for(int i=0; i<total_actuall_interactions; i++)
-        {
-            double U=rand.uniform();
-            if(U<min_interaction_time_rand)
-            {
-                min_interaction_time_rand=U;
-            }
-        }
-
+        //select time of interaction, by inverting the expected number of interactions (a cubic in time) at first_interaction_number.
+        //The cubic is nearly linear, so Newton's method from the linear inverse converges in a few steps
         double denom=total_A + 0.5*total_B + total_C/3.0;
-        interaction_time_finder finder(-min_interaction_time_rand, total_A/denom, 0.5*total_B/denom, total_C/(3.0*denom));
+        double fraction=first_interaction_number/total_expected_num_interactions_in_timestep;
+        interaction_time_finder finder(-fraction, total_A/denom, 0.5*total_B/denom, total_C/(3.0*denom));
+        auto finder_derivative=[&finder](double t_bar){ return finder.derivative(t_bar); };
 
-        double interaction_Tbar=root_finder_brent(&finder, 1.0, 0.0, 0.0001, 0.0001, 1000);
+        double guess= finder.A>0 ? fraction/finder.A : fraction;
+        double interaction_Tbar=newton_root(finder, finder_derivative, guess, 0.0, 1.0, 1.0E-10, 0.0, 100);
         return interaction_Tbar*timestep_size;
     }
 
@@ -0,0 +1,385 @@
+#ifndef LOW_ENERGY_FLUID_HPP
+#define LOW_ENERGY_FLUID_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "vector.hpp"
+#include "vector_long.hpp"
+
+#include "GSL_utils.hpp"
+#include "vec3.hpp"
+#include "gen_ex.hpp"
+#include "arrays_IO.hpp"
+
+#include "quasi_static_fields.hpp"
+
+//// low energy electrons as a fluid ////
+// The Monte-Carlo is not valid at low energy, and following electrons down to thermal energies is very slow. Instead, electrons that fall
+// below an energy are handed off (deposited) into a density on a regular grid of cells, which drifts with velocity -mobility*E, diffuses,
+// and is lost to attachment. Each deposited electron also adds energy/W ion pairs to its cell, since the rest of its energy goes into ionization.
+//
+// The fluid does not act back on the particles, so deposits are only recorded while the particles are run (in fluid_deposits, one for each
+// thread), and the fluid is evolved after (low_energy_fluid::evolve). Deposits are added at the start of the fluid step that they are in, and the
+// fluid step is limited by the output interval and the stability of the explicit update, which is upwind (donor-cell) advection with the velocity
+// on the faces between cells, and central diffusion. No cell may lose more than its density in one step, so
+//   dt*( sum over directions of max|v|/cell size  + 6*D/cell size^2 ) <= 1
+// Density that leaves the grid is lost. Deposits outside the grid are only counted in escaped_weight.
+// Everything is in the dimensionless units. Mobility is velocity/(dimensionless E), see sim_cls in Lehtinen1999.cpp for values in air.
+
+class fluid_deposits
+//electrons handed off to the fluid, recorded by one thread
+{
+public:
+    std::vector<double> time;
+    std::vector<vec3> position;
+    std::vector<double> weight;
+    std::vector<double> energy;
+
+    void add(double time_, const vec3& position_, double weight_, double energy_)
+    {
+        time.push_back(time_);
+        position.push_back(position_);
+        weight.push_back(weight_);
+        energy.push_back(energy_);
+    }
+
+    void add(fluid_deposits& other)
+    //move the deposits of other into this one
+    {
+        time.insert(time.end(), other.time.begin(), other.time.end());
+        position.insert(position.end(), other.position.begin(), other.position.end());
+        weight.insert(weight.end(), other.weight.begin(), other.weight.end());
+        energy.insert(energy.end(), other.energy.begin(), other.energy.end());
+        other.clear();
+    }
+
+    void reserve(size_t N)
+    //make room for N deposits, so that add does not allocate untill there are more
+    {
+        time.reserve(N);
+        position.reserve(N);
+        weight.reserve(N);
+        energy.reserve(N);
+    }
+
+    void clear()
+    {
+        time.clear();
+        position.clear();
+        weight.clear();
+        energy.clear();
+    }
+
+    size_t size()
+    {
+        return time.size();
+    }
+};
+
+class low_energy_fluid
+{
+public:
+    //grid
+    double origin[3]; //lowest corner of the grid
+    double cell_size;
+    double inverse_cell_size;
+    int num_cells[3];
+
+    //transport
+    double mobility;
+    double diffusion_coefficient;
+    double attachment_rate;
+    double ionization_energy; //W, energy used per ion pair
+    std::vector<double> face_velocity[3]; //velocity normal to the lower face of each cell, in each direction. Has one extra cell at the top
+
+    //state
+    double current_time;
+    std::vector<double> density; //weighted number of electrons in each cell
+    std::vector<double> ionization; //ion pairs made in each cell
+    double escaped_weight; //deposited outside the grid, or carried out of it
+
+    //output, at each output time
+    std::vector<double> output_times;
+    std::vector<double> total_electrons;
+    std::vector<vec3> total_current; //sum of charge*velocity, in units of elementary charge*velocity
+
+    low_energy_fluid(const vec3& origin_, double cell_size_, int Nx, int Ny, int Nz)
+    //grid of Nx*Ny*Nz cubic cells, starting at origin_. Call set_transport before evolve
+    {
+        if(cell_size_<=0 or Nx<1 or Ny<1 or Nz<1)
+        {
+            throw gen_exception("low_energy_fluid needs a positive cell size, and at least one cell in each direction");
+        }
+        for(int d=0; d<3; d++)
+        {
+            origin[d]=origin_[d];
+        }
+        num_cells[0]=Nx;
+        num_cells[1]=Ny;
+        num_cells[2]=Nz;
+        cell_size=cell_size_;
+        inverse_cell_size=1.0/cell_size;
+
+        mobility=0;
+        diffusion_coefficient=0;
+        attachment_rate=0;
+        ionization_energy=1;
+        for(int d=0; d<3; d++)
+        {
+            face_velocity[d].assign(face_count(d), 0.0);
+        }
+        reset();
+    }
+
+    void set_transport(field* E_field, double mobility_, double diffusion_coefficient_, double attachment_rate_, double ionization_energy_)
+    //electrons drift with -mobility_*E. E_field needs to be static, since the velocity is found once at the faces between cells
+    {
+        mobility=mobility_;
+        diffusion_coefficient=diffusion_coefficient_;
+        attachment_rate=attachment_rate_;
+        ionization_energy=ionization_energy_;
+
+        for(int d=0; d<3; d++)
+        {
+            int face_cells[3]={num_cells[0], num_cells[1], num_cells[2]};
+            face_cells[d]++;
+            for(int i=0; i<face_cells[0]; i++)
+            for(int j=0; j<face_cells[1]; j++)
+            for(int k=0; k<face_cells[2]; k++)
+            {
+                //center of the lower face in direction d
+                vec3 face_center(origin[0]+(i+0.5)*cell_size, origin[1]+(j+0.5)*cell_size, origin[2]+(k+0.5)*cell_size);
+                face_center[d]-=0.5*cell_size;
+                face_velocity[d][face_index(d, i, j, k)]=-mobility*E_field->get(face_center)[d];
+            }
+        }
+    }
+
+    void reset()
+    //remove all electrons and outputs
+    {
+        current_time=0;
+        escaped_weight=0;
+        density.assign(cell_count(), 0.0);
+        ionization.assign(cell_count(), 0.0);
+        output_times.clear();
+        total_electrons.clear();
+        total_current.clear();
+    }
+
+    inline size_t cell_count()
+    {
+        return size_t(num_cells[0])*num_cells[1]*num_cells[2];
+    }
+
+    inline size_t cell_index(int i, int j, int k)
+    {
+        return (size_t(i)*num_cells[1] + j)*num_cells[2] + k;
+    }
+
+    bool locate(const vec3& position, size_t& index)
+    //cell that contains position. Returns false if outside the grid
+    {
+        int cell[3];
+        for(int d=0; d<3; d++)
+        {
+            double F=(position[d]-origin[d])*inverse_cell_size;
+            if(not (F>=0 and F<num_cells[d])) return false; //false for NaN
+            cell[d]=int(F);
+        }
+        index=cell_index(cell[0], cell[1], cell[2]);
+        return true;
+    }
+
+    double max_timestep()
+    //largest stable step of the explicit update, see above
+    {
+        double outflow_rate=6.0*diffusion_coefficient*inverse_cell_size*inverse_cell_size;
+        for(int d=0; d<3; d++)
+        {
+            double max_speed=0;
+            for(double V : face_velocity[d])
+            {
+                max_speed=std::max(max_speed, std::abs(V));
+            }
+            outflow_rate+=max_speed*inverse_cell_size;
+        }
+        return outflow_rate>0 ? 1.0/outflow_rate : INFINITY;
+    }
+
+    void evolve(fluid_deposits& deposits, double end_time, double output_interval)
+    //evolve the fluid from current_time to end_time, adding the deposits. Outputs are recorded every output_interval.
+    //Deposits after end_time are not added
+    {
+        if(output_interval<=0)
+        {
+            throw gen_exception("low_energy_fluid needs a positive output interval");
+        }
+
+        std::vector<size_t> order(deposits.size());
+        for(size_t i=0; i<order.size(); i++)
+        {
+            order[i]=i;
+        }
+        std::sort(order.begin(), order.end(), [&deposits](size_t A, size_t B){ return deposits.time[A]<deposits.time[B]; });
+
+        double stable_timestep=max_timestep();
+        size_t next_deposit=0;
+        while(next_deposit<order.size() and deposits.time[order[next_deposit]]<current_time)
+        {
+            next_deposit++; //before this fluid started
+        }
+
+        double next_output=current_time;
+        while(current_time<end_time)
+        {
+            if(current_time>=next_output)
+            {
+                record_output();
+                next_output=current_time+output_interval;
+            }
+
+            double step_end=std::min(std::min(next_output, end_time), current_time+stable_timestep);
+            while(next_deposit<order.size() and deposits.time[order[next_deposit]]<step_end)
+            {
+                size_t n=order[next_deposit];
+                deposit(deposits.position[n], deposits.weight[n], deposits.energy[n]);
+                next_deposit++;
+            }
+
+            step(step_end-current_time);
+            current_time=step_end;
+        }
+        record_output();
+    }
+
+    void deposit(const vec3& position, double weight, double energy)
+    {
+        size_t index;
+        if(locate(position, index))
+        {
+            density[index]+=weight;
+            ionization[index]+=weight*energy/ionization_energy;
+        }
+        else
+        {
+            escaped_weight+=weight;
+        }
+    }
+
+    void step(double timestep)
+    //one explicit step of drift, diffusion, and attachment
+    {
+        std::vector<double> new_density=density;
+        double diffusion_factor=diffusion_coefficient*timestep*inverse_cell_size*inverse_cell_size;
+        double advection_factor=timestep*inverse_cell_size;
+
+        for(int d=0; d<3; d++)
+        {
+            int face_cells[3]={num_cells[0], num_cells[1], num_cells[2]};
+            face_cells[d]++;
+            for(int i=0; i<face_cells[0]; i++)
+            for(int j=0; j<face_cells[1]; j++)
+            for(int k=0; k<face_cells[2]; k++)
+            {
+                //flux through the lower face of cell (i,j,k), from the cell below it (which may be outside the grid) into it
+                int cell[3]={i, j, k};
+                bool has_upper= cell[d]<num_cells[d];
+                size_t upper= has_upper ? cell_index(cell[0], cell[1], cell[2]) : 0;
+                double upper_density= has_upper ? density[upper] : 0.0;
+
+                cell[d]--;
+                bool has_lower= cell[d]>=0;
+                size_t lower= has_lower ? cell_index(cell[0], cell[1], cell[2]) : 0;
+                double lower_density= has_lower ? density[lower] : 0.0;
+
+                double V=face_velocity[d][face_index(d, i, j, k)];
+                double flux=advection_factor*V*(V>0 ? lower_density : upper_density) + diffusion_factor*(lower_density-upper_density);
+
+                if(has_upper) new_density[upper]+=flux;
+                else escaped_weight+=flux;
+                if(has_lower) new_density[lower]-=flux;
+                else escaped_weight-=flux;
+            }
+        }
+
+        double attachment=std::exp(-attachment_rate*timestep);
+        for(size_t n=0; n<density.size(); n++)
+        {
+            density[n]=new_density[n]*attachment;
+        }
+    }
+
+    void record_output()
+    {
+        double total=0;
+        vec3 current(0, 0, 0);
+        for(int i=0; i<num_cells[0]; i++)
+        for(int j=0; j<num_cells[1]; j++)
+        for(int k=0; k<num_cells[2]; k++)
+        {
+            double N=density[cell_index(i, j, k)];
+            total+=N;
+            //velocity at the cell center, from the faces on either side. Electrons have a charge of -1
+            current[0]-=N*0.5*(face_velocity[0][face_index(0, i, j, k)] + face_velocity[0][face_index(0, i+1, j, k)]);
+            current[1]-=N*0.5*(face_velocity[1][face_index(1, i, j, k)] + face_velocity[1][face_index(1, i, j+1, k)]);
+            current[2]-=N*0.5*(face_velocity[2][face_index(2, i, j, k)] + face_velocity[2][face_index(2, i, j, k+1)]);
+        }
+        output_times.push_back(current_time);
+        total_electrons.push_back(total);
+        total_current.push_back(current);
+    }
+
+    void save_data(std::string fname)
+    //arrays of: output times, total electrons, the three components of the total current,
+    //then the grid (ints: Nx, Ny, Nz, doubles: origin and cell size), and the ion pairs and final density in each cell, with index (i*Ny + j)*Nz + k
+    {
+        arrays_output out;
+        out.add_doubles( make_vector(output_times) );
+        out.add_doubles( make_vector(total_electrons) );
+        for(int d=0; d<3; d++)
+        {
+            gsl::vector component(total_current.size());
+            for(size_t n=0; n<total_current.size(); n++)
+            {
+                component[n]=total_current[n][d];
+            }
+            out.add_doubles(component);
+        }
+
+        gsl::vector_long shape(3);
+        shape[0]=num_cells[0];
+        shape[1]=num_cells[1];
+        shape[2]=num_cells[2];
+        out.add_ints(shape);
+        out.add_doubles( gsl::vector({origin[0], origin[1], origin[2], cell_size}) );
+        out.add_doubles( make_vector(ionization) );
+        out.add_doubles( make_vector(density) );
+        out.to_file(fname);
+    }
+
+private:
+
+    inline size_t face_count(int d)
+    {
+        size_t count=1;
+        for(int e=0; e<3; e++)
+        {
+            count*= e==d ? num_cells[e]+1 : num_cells[e];
+        }
+        return count;
+    }
+
+    inline size_t face_index(int d, int i, int j, int k)
+    //faces normal to d, where the lower face of cell (i,j,k) has the same index as the cell, on a grid with one more cell in direction d
+    {
+        int Ny= d==1 ? num_cells[1]+1 : num_cells[1];
+        int Nz= d==2 ? num_cells[2]+1 : num_cells[2];
+        return (size_t(i)*Ny + j)*Nz + k;
+    }
+};
+
+#endif
@@ -15,9 +15,11 @@
 #include "rand.hpp"
 #include "root_finding.hpp"
 #include "chebyshev.hpp"
+#include "object_pool.hpp"
 
 #include "interaction_chooser.hpp"
 #include "particles.hpp"
+#include "electron_store.hpp"
 
 
 class moller_cross_section : public functor_1D
@@ -100,7 +102,8 @@ class moller_sampler : public functor_1D
     //rand needs to be a uniformaly distributed random number between 0 to maximum rate of moller stcattering
     {
         current_rand=rand;
-        return root_finder_brent(this, cross_section->energy/2.0, lowest_energy, 0.001, 0.001, 10000);
+        auto integral_left=[this](double Ep){ return cross_section->integral(Ep)-current_rand; };
+        return brent_root(integral_left, lowest_energy, cross_section->energy/2.0, 0.001, 0.001, 10000);
     }
 
 };
@@ -121,10 +124,17 @@ class moller_table : public physical_interaction
     method_functor_1D<moller_cross_section> cross_section_integral;
     moller_sampler zero_finding_sampler;
 
+    //for electrons in an electron_store
+    electron_T working_electron;
+    electron_T working_secondary;
+
+    object_pool<electron_T>* electron_pool; //new electrons are made in this pool, if set. Not owned
+
     moller_table(double lowest_sim_energy_, double upper_energy, size_t num_energies,bool save_tables=false)
     {
         cross_section_integral.reset(&cross_section, &moller_cross_section::integral);
         zero_finding_sampler.set_cross_section(&cross_section);
+        electron_pool=nullptr;
 
         lowest_sim_energy=lowest_sim_energy_;
 
@@ -196,9 +206,10 @@ class moller_table : public physical_interaction
         }
         else if( energy >= energies.back() )
         {
-            cross_section.set_energy(energy);
+            //local cross section, so that this can be called from many threads
+            moller_cross_section high_energy_cross_section(energy);
 
-            return cross_section.integral(energy/2.0) - cross_section.integral(lowest_sim_energy);
+            return high_energy_cross_section.integral(energy/2.0) - high_energy_cross_section.integral(lowest_sim_energy);
 
         }
         else
@@ -217,10 +228,11 @@ class moller_table : public physical_interaction
         if( energy >= energies.back() )
         {
 
-            cross_section.set_energy(energy);
-            double lowest_rate=cross_section.integral(lowest_sim_energy);
-            double upper_rate=cross_section.integral(energy/2.0);
-            double R=zero_finding_sampler.sample(lowest_sim_energy, lowest_rate + U*(upper_rate-lowest_rate));
+            moller_cross_section high_energy_cross_section(energy);
+            moller_sampler high_energy_sampler(&high_energy_cross_section);
+            double lowest_rate=high_energy_cross_section.integral(lowest_sim_energy);
+            double upper_rate=high_energy_cross_section.integral(energy/2.0);
+            double R=high_energy_sampler.sample(lowest_sim_energy, lowest_rate + U*(upper_rate-lowest_rate));
 
             return R;
 
@@ -235,15 +247,54 @@ class moller_table : public physical_interaction
         }
     }
 
+    void set_pool(object_pool<electron_T>* electron_pool_)
+    {
+        electron_pool=electron_pool_;
+    }
+
     double sample_azimuth()
     {
         return rand.uniform()*2*PI;
     }
 
     electron_T* single_interaction(double initial_energy, electron_T *electron)
+    //returns the new electron, or NULL if the energy is too low to interact
     {
         if(initial_energy< energies[0]) return NULL;
 
+        electron_T* new_electron;
+        if(electron_pool)
+        {
+            new_electron=electron_pool->create();
+        }
+        else
+        {
+            new_electron=new electron_T;
+        }
+        single_interaction(initial_energy, electron, new_electron);
+        return new_electron;
+    }
+
+    size_t single_interaction(double initial_energy, electron_store& electrons, size_t handle)
+    //same as above, for an electron in an electron_store. Returns the handle of the new electron, or electron_store::npos if there is no interaction
+    {
+        if(initial_energy< energies[0]) return electron_store::npos;
+
+        electrons.load_kinematics(handle, &working_electron);
+        working_secondary.set_defaults();
+        working_secondary.ID=particle_ID_T::new_ID();
+
+        single_interaction(initial_energy, &working_electron, &working_secondary);
+
+        electrons.save_kinematics(handle, &working_electron);
+        return electrons.add(&working_secondary);
+    }
+
+    bool single_interaction(double initial_energy, electron_T *electron, electron_T *new_electron)
+    //do a moller scattering. new_electron is set to the produced electron. Returns false, and does nothing, if the energy is too low to interact
+    {
+        if(initial_energy< energies[0]) return false;
+
         double initial_momentum=std::sqrt((initial_energy+1)*(initial_energy+1)-1);
 
         double azimuth_angle=sample_azimuth();
@@ -260,16 +311,15 @@ class moller_table : public physical_interaction
         double old_inclination_scatter=std::acos( ((initial_energy+1)*(new_energy+1)-(production_energy+1))/(initial_momentum*new_momentum) );
         double new_inclination_scatter=std::acos( ((initial_energy+1)*(production_energy+1)-(new_energy+1))/(initial_momentum*production_mom) );
 
-        //make new electron
-        electron_T* new_electron=new electron_T;
-
+        //set new electron
         normalize(electron->momentum);
 
-        new_electron->position=electron->position.clone();
-        new_electron->momentum=electron->momentum*production_mom;
+        new_electron->set_position(electron->position[0], electron->position[1], electron->position[2]);
+        new_electron->set_momentum(electron->momentum[0]*production_mom, electron->momentum[1]*production_mom, electron->momentum[2]*production_mom);
         new_electron->timestep=electron->timestep;
         new_electron->charge=-1;//set_electron
         new_electron->current_time=electron->current_time;
+        new_electron->weight=electron->weight; //secondaries stand for as many real electrons as the primary
 
         //adjust energy of old electron
         electron->momentum*=new_momentum;
@@ -281,7 +331,7 @@ class moller_table : public physical_interaction
         electron->update_energy();
         new_electron->update_energy();
 
-        return new_electron;
+        return true;
     }
 };
 
@@ -7,18 +7,26 @@
 #include<list>
 #include<vector>
 #include <cmath>
+#include <mutex>
+#include <cstring>
 
 #include "binary_IO.hpp"
+#include "vec3.hpp"
+#include "ID_allocator.hpp"
 
 #include "relativistic_formulas.hpp"
 
 class particle_ID_T
 {
 public:
-    static size_t next_ID;
     size_t ID;
+
+    static size_t new_ID()
+    //return a new unique ID. Thread safe, see ID_allocator for reproducible IDs with many threads
+    {
+        return ID_allocator::new_ID();
+    }
 };
-size_t particle_ID_T::next_ID=0;
 
 class electron_data; //needs to be defined laster
 
@@ -28,48 +36,60 @@ public:
     ////physical data///
     int charge; //-1 for electron, 1 for positron
     double energy;
-    gsl::vector position; //dimensionless, in units of distance_units
-    gsl::vector momentum; //dimensionless, in units of electron-rest-mass/c
+    double weight; //number of real electrons that this electron stands for
+    vec3 position; //dimensionless, in units of distance_units
+    vec3 momentum; //dimensionless, in units of electron-rest-mass/c
 
     double timestep; //timestep that the particle did have
     double current_time;
+    double tally_start_time; //time that the electron was last counted from, used by analyzers
 
     //data needed for solving for path
     double next_timestep; //timestep that particle will have
+    double last_step_error; //error of the last accepted Runge-Kutta step, relative to the tolerance. For the step size controller
 
-    //Dormand-Prince Runge-Kutta
-    std::vector< gsl::vector > pos_K_interpolant;
-    std::vector< gsl::vector > mom_K_interpolant;
+    //Dormand-Prince Runge-Kutta continuous extension, stored as polynomial coefficients:
+    // position(theta) = sum_i pos_interpolant[i]*theta^i, where theta is the fraction of interpolant_timestep
+    static const int interpolant_order=5;
+    vec3 pos_interpolant[interpolant_order];
+    vec3 mom_interpolant[interpolant_order];
     double interpolant_timestep; //timestep size that the interpolant is meant to cover
+    bool has_interpolant; //false untill the first Runge-Kutta step
+    bool keep_interpolant; //if false, the Runge-Kutta does not make the interpolant. Set this for particles that are never interpolated
 
     electron_T()
     //some default values
     {
-        ID=next_ID;
-        next_ID++;
-        if(next_ID<ID){throw gen_exception("Too many particles");}
+        ID=new_ID();
+        set_defaults();
+    }
 
+    void set_defaults()
+    //reset everything but the ID to the default values
+    {
         charge=-1;//electron
-		position=gsl::vector({0,0,0});
-		momentum=gsl::vector({0,0,0});
+        set_position(0,0,0);
+        set_momentum(0,0,0);
         timestep=0.0001;
         next_timestep=0.0001;
+        last_step_error=1.0E-4;
         current_time=0;
+        tally_start_time=0;
         energy=0;
+        weight=1;
+        interpolant_timestep=0;
+        has_interpolant=false;
+        keep_interpolant=true;
     }
 
     void set_position(double x, double y, double z)
 	{
-		position[0]=x;
-		position[1]=y;
-		position[2]=z;
+		position.set(x, y, z);
 	}
 
 	void set_momentum(double x, double y, double z)
 	{
-		momentum[0]=x;
-		momentum[1]=y;
-		momentum[2]=z;
+		momentum.set(x, y, z);
 	}
 
 	void update_energy()
@@ -88,22 +108,20 @@ public:
 		double C=std::sin(inclination)*sin(azimuth); //basis vector will be vector Cv below
 
 		//find vector Bv, perpinduclar to momentum
-		gsl::vector init({0,1,0});
-		gsl::vector Bv=cross(init, momentum);
+		vec3 Bv=cross(vec3(0,1,0), momentum);
 		if(Bv.sum_of_squares()<0.1*momentum_squared) //init and momentum are close to parellel. Which would cause errors below
 		{
-			init=gsl::vector({0,0,1}); //so we try a different init. momentum cannot be parrellel to both inits
-			Bv=cross(init, momentum);
+			Bv=cross(vec3(0,0,1), momentum); //so we try a different init. momentum cannot be parrellel to both inits
 		}
 
 		//normalize Bv
-		Bv/=sqrt(Bv.sum_of_squares());
+		Bv/=Bv.norm();
 
 		//now we find Cv
-		gsl::vector Cv=cross(Bv, momentum); //Bv and momentum are garenteed to be perpindicular.
+		vec3 Cv=cross(Bv, momentum); //Bv and momentum are garenteed to be perpindicular.
 
 		//give Bv correct magnitude
-		Bv*=sqrt(momentum_squared);
+		Bv*=std::sqrt(momentum_squared);
 
 		//find new momentum
 		momentum=A*momentum + B*Bv + C*Cv;
@@ -111,61 +129,115 @@ public:
 
 	void reduce_timestep_to(double new_timestep_size)
 	{
+        if(not has_interpolant)
+        {
+            throw gen_exception("electron ", ID, " has no interpolant to reduce timestep");
+        }
+
 	    current_time-=timestep;
 	    current_time+= new_timestep_size;
         timestep=new_timestep_size;
 
-        position=interpolate_pos(1.0);
-        momentum=interpolate_mom(1.0);
+        interpolate(1.0, position, momentum);
         update_energy();
 	}
 
+    static inline const double* interpolant_factors(int order)
+    //factors of the K-vectors 1, 3, 4, 5, and 6 in the coefficient of theta^order, for order 2 to 4. Coefficient of theta^1 is K_1
+    {
+        static const double C[3][5]={ {-1337.0/480.0,  4216.0/1113.0,  -27.0/16.0,  -2187.0/8480.0,  33.0/35.0},
+                                      {1039.0/360.0,   -18728.0/3339.0, 9.0/2.0,    2673.0/2120.0,   -319.0/105.0},
+                                      {-1163.0/1152.0, 7580.0/3339.0,  -415.0/192.0, -8991.0/6784.0, 187.0/84.0} };
+        return C[order-2];
+    }
 
-	gsl::vector interpolate_pos(double T_bar)
-	// when T_bar=0, give position at current_time-timestep, when T_bar=1, give position at current_time
-	{
-        double theta=T_bar*timestep/interpolant_timestep;
+    void set_interpolant(double timestep_, const vec3& pos_0, const vec3& mom_0, const vec3* K_pos, const vec3* K_mom)
+    //make the interpolant from the start of a Dormand-Prince step, and K-vectors 1, 3, 4, 5, and 6 (the ones used by the continuous extension)
+    {
+        interpolant_timestep=timestep_;
+        pos_interpolant[0]=pos_0;
+        mom_interpolant[0]=mom_0;
+        pos_interpolant[1]=K_pos[0];
+        mom_interpolant[1]=K_mom[0];
 
-        double B1= ((((-1163.0/1152.0)*theta + (1039.0/360.0))*theta + (-1337.0/480.0))*theta + 1.0)*theta;
-        //double B2=0.0;
-        double B3= (((7580.0/3339.0)*theta + (-18728.0/3339.0))*theta + (4216.0/1113.0))*theta*theta;
-        double B4= (((-415.0/192.0)*theta + (9.0/2.0))*theta + (-27.0/16.0))*theta*theta;
-        double B5= (((-8991.0/6784.0)*theta + (2673.0/2120.0))*theta + (-2187.0/8480.0))*theta*theta;
-        double B6= (((187.0/84.0)*theta + (-319.0/105.0))*theta + (33.0/35.0))*theta*theta;
+        for(int order=2; order<interpolant_order; order++)
+        {
+            const double* coef=interpolant_factors(order);
+            vec3& pos_coef=pos_interpolant[order];
+            vec3& mom_coef=mom_interpolant[order];
+            pos_coef=K_pos[0]*coef[0];
+            mom_coef=K_mom[0]*coef[0];
+            for(int k=1; k<5; k++)
+            {
+                pos_coef.mult_add(K_pos[k], coef[k]);
+                mom_coef.mult_add(K_mom[k], coef[k]);
+            }
+        }
+        has_interpolant=true;
+    }
 
+    void set_hermite_interpolant(double timestep_, const vec3& pos_0, const vec3& mom_0, const vec3& vel_0, const vec3& force_0,
+                                 const vec3& pos_1, const vec3& mom_1, const vec3& vel_1, const vec3& force_1)
+    //make a cubic interpolant from the position and momentum, and their derivatives, at the start and end of a step. For integrators other than Dormand-Prince
+    {
+        interpolant_timestep=timestep_;
+        pos_interpolant[0]=pos_0;
+        mom_interpolant[0]=mom_0;
+        pos_interpolant[1]=vel_0*timestep_;
+        mom_interpolant[1]=force_0*timestep_;
+        pos_interpolant[2]=(pos_1-pos_0)*3.0 - (vel_0*2.0 + vel_1)*timestep_;
+        mom_interpolant[2]=(mom_1-mom_0)*3.0 - (force_0*2.0 + force_1)*timestep_;
+        pos_interpolant[3]=(pos_0-pos_1)*2.0 + (vel_0 + vel_1)*timestep_;
+        mom_interpolant[3]=(mom_0-mom_1)*2.0 + (force_0 + force_1)*timestep_;
+        for(int order=4; order<interpolant_order; order++)
+        {
+            pos_interpolant[order].set(0, 0, 0);
+            mom_interpolant[order].set(0, 0, 0);
+        }
+        has_interpolant=true;
+    }
 
-        gsl::vector pos_interp = pos_K_interpolant[6]*B6;
-        pos_interp.mult_add(pos_K_interpolant[5], B5 );
-        pos_interp.mult_add(pos_K_interpolant[4], B4 );
-        pos_interp.mult_add(pos_K_interpolant[3], B3 );
-        //pos_interp.mult_add(pos_K_interpolant[2], B2 );
-        pos_interp.mult_add(pos_K_interpolant[1], B1 );
-        pos_interp+=pos_K_interpolant[0];
+    void interpolate(double T_bar, vec3& pos_out, vec3& mom_out)
+    // position and momentum at the same time. When T_bar=0, give values at current_time-timestep, when T_bar=1, give values at current_time
+    {
+        double theta=T_bar*timestep/interpolant_timestep;
 
-        return pos_interp;
-	}
+        pos_out=pos_interpolant[interpolant_order-1];
+        mom_out=mom_interpolant[interpolant_order-1];
+        for(int order=interpolant_order-2; order>=0; order--)
+        {
+            pos_out*=theta;
+            mom_out*=theta;
+            pos_out+=pos_interpolant[order];
+            mom_out+=mom_interpolant[order];
+        }
+    }
 
-	gsl::vector interpolate_mom(double T_bar)
+	vec3 interpolate_pos(double T_bar)
 	// when T_bar=0, give position at current_time-timestep, when T_bar=1, give position at current_time
 	{
         double theta=T_bar*timestep/interpolant_timestep;
 
-        double B1= ((((-1163.0/1152.0)*theta + (1039.0/360.0))*theta + (-1337.0/480.0))*theta + 1.0)*theta;
-        //double B2=0.0;
-        double B3= (((7580.0/3339.0)*theta + (-18728.0/3339.0))*theta + (4216.0/1113.0))*theta*theta;
-        double B4= (((-415.0/192.0)*theta + (9.0/2.0))*theta + (-27.0/16.0))*theta*theta;
-        double B5= (((-8991.0/6784.0)*theta + (2673.0/2120.0))*theta + (-2187.0/8480.0))*theta*theta;
-        double B6= (((187.0/84.0)*theta + (-319.0/105.0))*theta + (33.0/35.0))*theta*theta;
-
+        vec3 pos_interp=pos_interpolant[interpolant_order-1];
+        for(int order=interpolant_order-2; order>=0; order--)
+        {
+            pos_interp*=theta;
+            pos_interp+=pos_interpolant[order];
+        }
+        return pos_interp;
+	}
 
-        gsl::vector mom_interp = mom_K_interpolant[6]*B6;
-        mom_interp.mult_add(mom_K_interpolant[5], B5 );
-        mom_interp.mult_add(mom_K_interpolant[4], B4 );
-        mom_interp.mult_add(mom_K_interpolant[3], B3 );
-        //mom_interp.mult_add(mom_K_interpolant[2], B2 );
-        mom_interp.mult_add(mom_K_interpolant[1], B1 );
-        mom_interp+=mom_K_interpolant[0];
+	vec3 interpolate_mom(double T_bar)
+	// when T_bar=0, give momentum at current_time-timestep, when T_bar=1, give momentum at current_time
+	{
+        double theta=T_bar*timestep/interpolant_timestep;
 
+        vec3 mom_interp=mom_interpolant[interpolant_order-1];
+        for(int order=interpolant_order-2; order>=0; order--)
+        {
+            mom_interp*=theta;
+            mom_interp+=mom_interpolant[order];
+        }
         return mom_interp;
 	}
 };
@@ -176,24 +248,22 @@ public:
     //stuff
     double energy; //in units of electron mass
     double current_time;
-    gsl::vector position; //dimensionless, in units of distance_units
-    gsl::vector travel_direction;
+    double weight; //number of real photons that this photon stands for
+    vec3 position; //dimensionless, in units of distance_units
+    vec3 travel_direction;
 
     photon_T()
     //some default values
     {
-        ID=next_ID;
-        next_ID++;
+        ID=new_ID();
         current_time=0;
         energy=0;
-
-        position=gsl::vector({0,0,0});
-        travel_direction=gsl::vector({0,0,0});
+        weight=1;
     }
 
     void propagate(double time)
     {
-        position+=time*travel_direction;
+        position.mult_add(travel_direction, time);
     }
 
     void scatter_angle(double inclination, double azimuth)
@@ -205,23 +275,21 @@ public:
         double C=std::sin(inclination)*sin(azimuth); //basis vector will be vector Cv below
 
         //find vector Bv, perpinduclar to travel_direction
-        gsl::vector init({0,1,0});
-        gsl::vector Bv=cross(init, travel_direction);
+        vec3 Bv=cross(vec3(0,1,0), travel_direction);
         if(Bv.sum_of_squares()<0.1) //init and momentum are close to parellel. Which would cause errors below
         {
-            init=gsl::vector({0,0,1}); //so we try a different init. momentum cannot be parrellel to both inits
-            Bv=cross(init, travel_direction);
+            Bv=cross(vec3(0,0,1), travel_direction); //so we try a different init. momentum cannot be parrellel to both inits
         }
 
         //normalize Bv
-        Bv/=sqrt(Bv.sum_of_squares());
+        Bv/=Bv.norm();
 
         //now we find Cv
-        gsl::vector Cv=cross(Bv, travel_direction); //Bv and momentum are garenteed to be perpindicular.
+        vec3 Cv=cross(Bv, travel_direction); //Bv and momentum are garenteed to be perpindicular.
 
         //find new momentum
         travel_direction=A*travel_direction + B*Bv + C*Cv;
-        travel_direction/=std::sqrt(travel_direction.sum_of_squares()); //insure direction is normalized
+        normalize(travel_direction); //insure direction is normalized
     }
 };
 
@@ -232,6 +300,11 @@ public:
     binary_output out;
     bool record; //if this is false, then this doesn't do anything. Used to turn off recording when it isn't wanted
 
+    //a particle_history_out can be a buffer in memory for another particle_history_out (the target), so that many threads can record.
+    //each thread writes to its own buffer, and calls write_buffer when the records of an electron are complete.
+    particle_history_out* target;
+    std::mutex write_mutex; //held while a buffer writes into this
+
     /*
     commands:
         1 : add electron
@@ -259,32 +332,101 @@ public:
                 3 doubles: momentum
 
         4: end of file
+
+        5: change weight of electron. Electrons have a weight of 1 untill this is given
+            each electron needs
+                int32 ID
+                double new weight
     */
 
     //reasons to remove particles
     static const int TOO_LOW_ENERGY=0;
     static const int OUT_OF_BOUNDS=1;
     static const int EVOLVED_INTO_HIGHER_LIFEFORM=2;  //don't use this one
+    static const int LOST_ROULETTE=3; //removed by population control
+    static const int COMBED_OUT=4; //removed by population combing
+    static const int BELOW_RUNAWAY_THRESHOLD=5; //cannot gain energy from the field, so removed early. See sim_cls::cull_electron in Lehtinen1999.cpp
 
     particle_history_out(bool record_=true) : out("./particle_history_output")
     {
         record=record_;
+        target=nullptr;
     }
 
     particle_history_out(std::string fname, bool record_=true) : out(fname)
     {
         record=record_;
+        target=nullptr;
+    }
+
+    particle_history_out(particle_history_out* target_)
+    //make a buffer for target
+    {
+        record=target_->record;
+        target=target_;
     }
 
     ~particle_history_out()
     {
-        if(record)
+        if(target)
+        {
+            write_buffer();
+        }
+        else if(record)
         {
             out.out_short(4); //command, end file
             out.flush();
         }
     }
 
+    void write_buffer()
+    //write everything in this buffer to the target, and empty the buffer. Can be called from many threads at once
+    {
+        if(not target or out.writes==0) {return;}
+
+        std::lock_guard<std::mutex> lock(target->write_mutex);
+        out.move_to(target->out);
+    }
+
+    template<typename new_ID_T>
+    void renumber(new_ID_T new_ID)
+    //replace the ID of each record in this buffer by new_ID(ID). For records that are written before the IDs are known, see sim_cls::run_parallel in Lehtinen1999.cpp
+    {
+        if(not target) throw gen_exception("only a buffer can be renumbered");
+        if(out.writes==0) return;
+
+        std::string data=out.buffer->str();
+        size_t i=0;
+        while(i<data.size())
+        {
+            int8_t command=data[i];
+            size_t length; //after the command
+            if(command==1 or command==3)
+            {
+                length=4+1+7*8;
+            }
+            else if(command==2)
+            {
+                length=4+7*8;
+            }
+            else if(command==5)
+            {
+                length=4+8;
+            }
+            else
+            {
+                throw gen_exception("unknown command ", int(command), " in particle_history_out buffer");
+            }
+
+            int32_t ID;
+            std::memcpy(&ID, &data[i+1], sizeof(int32_t));
+            ID=new_ID(ID);
+            std::memcpy(&data[i+1], &ID, sizeof(int32_t));
+            i+=1+length;
+        }
+        out.buffer->str(data);
+    }
+
     void new_electron(electron_T *particle)
     {
         if(not record) {return;}
@@ -303,6 +445,21 @@ public:
         out.out_double(particle->momentum[0]);
         out.out_double(particle->momentum[1]);
         out.out_double(particle->momentum[2]);
+
+        if(particle->weight!=1.0)
+        {
+            change_weight(particle);
+        }
+    }
+
+    void change_weight(electron_T *particle)
+    {
+        if(not record) {return;}
+
+        out.out_short(5); //command, change weight
+
+        out.out_int(particle->ID);
+        out.out_double(particle->weight);
     }
 
     void update_electron(electron_T *particle)
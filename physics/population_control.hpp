@@ -0,0 +1,176 @@
+#ifndef POPULATION_CONTROL_HPP
+#define POPULATION_CONTROL_HPP
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <list>
+#include <string>
+
+#include "rand.hpp"
+#include "arrays_IO.hpp"
+#include "GSL_utils.hpp"
+
+#include "particles.hpp"
+
+//// population control for super-particles ////
+// Each electron has a statistical weight, the number of real electrons that it stands for.
+// weight_window keeps the weight of each electron near a target weight of 1/importance:
+//    electrons heavier than upper_weight/importance are split into several electrons of lower weight
+//    electrons lighter than lower_weight/importance play russian roulette. They are either removed, or survive with weight survival_weight/importance.
+// Both keep the expected total weight. Override importance to put the statistics where they are needed.
+// The default window has no limits, so it does nothing.
+
+class weight_window
+{
+public:
+    double lower_weight;
+    double upper_weight;
+    double survival_weight;
+    size_t max_split; //an electron is never split into more than this many electrons
+
+    rand_threadsafe rand;
+
+    weight_window()
+    {
+        lower_weight=0;
+        upper_weight=INFINITY;
+        survival_weight=1;
+        max_split=10;
+    }
+
+    weight_window(double lower_weight_, double upper_weight_, double survival_weight_, size_t max_split_=10)
+    {
+        set_window(lower_weight_, upper_weight_, survival_weight_, max_split_);
+    }
+
+    virtual ~weight_window() {}
+
+    void set_window(double lower_weight_, double upper_weight_, double survival_weight_, size_t max_split_=10)
+    {
+        if(not (lower_weight_<=survival_weight_ and survival_weight_<=upper_weight_) or max_split_<1)
+        {
+            throw gen_exception("bad weight window:", lower_weight_, survival_weight_, upper_weight_, max_split_);
+        }
+        lower_weight=lower_weight_;
+        upper_weight=upper_weight_;
+        survival_weight=survival_weight_;
+        max_split=max_split_;
+    }
+
+    virtual double importance(electron_T* electron)
+    //larger importance gives more electrons with smaller weight
+    {
+        return 1.0;
+    }
+
+    size_t apply(electron_T* electron)
+    //returns the number of electrons that electron should become. 0 if it lost roulette, 1 if it is kept, and more than 1 if it should be split.
+    //the weight of electron is set to the weight that each new electron should have.
+    {
+        double target_weight=1.0/importance(electron);
+        double weight=electron->weight;
+
+        if(weight>upper_weight*target_weight)
+        {
+            double num_split=std::ceil(weight/(survival_weight*target_weight));
+            size_t N=std::min(max_split, size_t(num_split));
+            if(N>1)
+            {
+                electron->weight=weight/N;
+            }
+            return N;
+        }
+        else if(weight<lower_weight*target_weight)
+        {
+            double new_weight=survival_weight*target_weight;
+            if(rand.uniform()*new_weight < weight)
+            {
+                electron->weight=new_weight;
+                return 1;
+            }
+            else
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+};
+
+//// weighted combing ////
+// An avalanche grows exponentially, so the number of electrons needs to be limited. population_comb resamples a population of weighted electrons to a fixed number
+// of electrons, that all have the same weight. The teeth of the comb are evenly spaced (with a random offset) along the cumulative weight of the electrons.
+// Each electron becomes one electron for each tooth that lands on it, so the expected weight of each electron, and the total weight, does not change.
+// The renormalization from each combing is recorded, and can be saved with save_data.
+
+class population_comb
+{
+public:
+    size_t target_number;
+    rand_threadsafe rand;
+
+    //log of each combing
+    std::list<double> comb_time;
+    std::list<double> number_before;
+    std::list<double> total_weight;
+    std::list<double> weight_after; //weight of every electron after combing
+
+    population_comb(size_t target_number_=10000)
+    {
+        target_number=target_number_;
+    }
+
+    double comb(const std::vector<double>& weights, std::vector<size_t>& num_teeth, double time)
+    //weights is the weight of each electron. Sets num_teeth to the number of electrons each electron should become, and returns the weight each of these should have
+    {
+        double weight_sum=0;
+        for(double W : weights)
+        {
+            weight_sum+=W;
+        }
+        double new_weight=weight_sum/target_number;
+
+        num_teeth.assign(weights.size(), 0);
+        double tooth=rand.uniform()*new_weight;
+        double cumulative_weight=0;
+        size_t num_placed=0;
+        for(size_t i=0; i<weights.size() and num_placed<target_number; i++)
+        {
+            cumulative_weight+=weights[i];
+            while(tooth<cumulative_weight and num_placed<target_number)
+            {
+                num_teeth[i]++;
+                num_placed++;
+                tooth+=new_weight;
+            }
+        }
+
+        comb_time.push_back(time);
+        number_before.push_back(weights.size());
+        total_weight.push_back(weight_sum);
+        weight_after.push_back(new_weight);
+
+        return new_weight;
+    }
+
+    void reset()
+    {
+        comb_time.clear();
+        number_before.clear();
+        total_weight.clear();
+        weight_after.clear();
+    }
+
+    void save_data(std::string fname)
+    {
+        arrays_output out;
+        out.add_doubles( make_vector(comb_time) );
+        out.add_doubles( make_vector(number_before) );
+        out.add_doubles( make_vector(total_weight) );
+        out.add_doubles( make_vector(weight_after) );
+        out.to_file(fname);
+    }
+};
+
+#endif
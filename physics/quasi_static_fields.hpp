@@ -2,70 +2,126 @@
 #ifndef QUASI_STATIC_FIELDS
 #define QUASI_STATIC_FIELDS
 /////// tools for representing quasi-static magnetic and electric fields /////////
+// apply_charged_force_fields is templated on the field types, and calls evaluate and evaluate_batch, which are not virtual. So each field type should
+// define those two inline, and make get and get_batch call them. For the base class, evaluate and evaluate_batch call the virtual functions, so
+// apply_charged_force (which is apply_charged_force_fields<field, field>) works with any field.
 
 #include <cmath>
 
-#include "vector.hpp"
+#include "vec3.hpp"
 
 class field
 {
 	public:
-	virtual gsl::vector get(gsl::vector &position, double time)=0;//in case we want time dependance later
-	virtual gsl::vector get(gsl::vector &position)=0;
+	virtual vec3 get(const vec3& position, double time)=0;//in case we want time dependance later
+	virtual vec3 get(const vec3& position)=0;
 	field* pntr(){ return this;}
+
+	virtual bool is_uniform()
+	//true if the field has the same value everywhere, and at all times. Then apply_charged_force can use its guiding centre step
+	{
+		return false;
+	}
+
+	virtual void get_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
+	//field at N points. Fields can override this with a version that vectorizes
+	{
+		for(int i=0; i<N; i++)
+		{
+			vec3 F=get(vec3(X[i], Y[i], Z[i]), time[i]);
+			out_X[i]=F[0];
+			out_Y[i]=F[1];
+			out_Z[i]=F[2];
+		}
+	}
+
+	inline void evaluate(const vec3& position, double time, vec3& out)
+	//adapter to the virtual interface
+	{
+		out=get(position, time);
+	}
+
+	inline void evaluate_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
+	{
+		get_batch(X, Y, Z, time, out_X, out_Y, out_Z, N);
+	}
 };
 
 class uniform_field : public field
 {
 public:
-	gsl::vector minimum;
-	gsl::vector maximum;
-	gsl::vector value;
-
-	uniform_field()
-	{
-		minimum=gsl::vector({0,0,0});
-		maximum=gsl::vector({0,0,0});
-		value=gsl::vector({0,0,0});
-	}
+	vec3 minimum;
+	vec3 maximum;
+	vec3 value;
 
 	void set_minimum(double X, double Y, double Z)
 	{
-		minimum[0]=X;
-		minimum[1]=Y;
-		minimum[2]=Z;
+		minimum.set(X, Y, Z);
 	}
 
 	void set_maximum(double X, double Y, double Z)
 	{
-		maximum[0]=X;
-		maximum[1]=Y;
-		maximum[2]=Z;
+		maximum.set(X, Y, Z);
 	}
 
 	void set_value(double X, double Y, double Z)
 	{
-		value[0]=X;
-		value[1]=Y;
-		value[2]=Z;
+		value.set(X, Y, Z);
 	}
 
-	gsl::vector get(gsl::vector &position)
+	inline bool in_bounds(const vec3& position)
 	{
-		if(position.vec_greaterThan(minimum).all_true() and position.vec_lessThan(maximum).all_true())
+		return position[0]>minimum[0] and position[1]>minimum[1] and position[2]>minimum[2] and
+		       position[0]<maximum[0] and position[1]<maximum[1] and position[2]<maximum[2];
+	}
+
+	inline void evaluate(const vec3& position, double time, vec3& out)
+	{
+		if(in_bounds(position))
 		{
-			return value;
+			out=value;
 		}
 		else
 		{
-			return gsl::vector({0,0,0});
+			out.set(0,0,0);
+		}
+	}
+
+	inline void evaluate_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
+	{
+		for(int i=0; i<N; i++)
+		{
+			bool inside= X[i]>minimum[0] and Y[i]>minimum[1] and Z[i]>minimum[2] and
+			             X[i]<maximum[0] and Y[i]<maximum[1] and Z[i]<maximum[2];
+			out_X[i]= inside ? value[0] : 0.0;
+			out_Y[i]= inside ? value[1] : 0.0;
+			out_Z[i]= inside ? value[2] : 0.0;
 		}
 	}
 
+	vec3 get(const vec3& position)
+	{
+		vec3 out;
+		evaluate(position, 0, out);
+		return out;
+	}
+
+	vec3 get(const vec3& position, double time)
+	{
+		vec3 out;
+		evaluate(position, time, out);
+		return out;
+	}
+
+	bool is_uniform()
+	{
+		return minimum[0]==-INFINITY and minimum[1]==-INFINITY and minimum[2]==-INFINITY and
+		       maximum[0]==INFINITY and maximum[1]==INFINITY and maximum[2]==INFINITY;
+	}
 
-	gsl::vector get(gsl::vector &position, double time)
+	void get_batch(const double* X, const double* Y, const double* Z, const double* time, double* out_X, double* out_Y, double* out_Z, int N)
 	{
-		return get(position);
+		evaluate_batch(X, Y, Z, time, out_X, out_Y, out_Z, N);
 	}
 };
 
@@ -4,6 +4,8 @@
 
 #include <cmath>
 
+#include "vec3.hpp"
+
 //////// usefull converstion functions //////////
 // dimensionless units unless specificied otherwise
 inline double KE_to_mom(double KE)
@@ -12,7 +14,7 @@ inline double KE_to_mom(double KE)
 	return std::sqrt((1+KE)*(1+KE) - 1.0);
 }
 
-inline double mom_to_KE(gsl::vector mom)
+inline double mom_to_KE(const vec3& mom)
 //both KE and momentum are unitless
 {
     return std::sqrt(mom.sum_of_squares()+1.0)-1.0;
@@ -23,7 +25,7 @@ inline double KE_to_beta(double KE)
     return std::sqrt(1.0 - 1.0/((1+KE)*(1+KE)) );
 }
 
-inline double gamma(gsl::vector &mom_)
+inline double gamma(const vec3& mom_)
 {
     return std::sqrt(1+mom_[0]*mom_[0]+mom_[1]*mom_[1]+mom_[2]*mom_[2]);
 }
@@ -24,6 +24,7 @@ class electron_history(object):
         self.pos_history=[ np.array([pos_1, pos_2, pos_3]) ]
         self.mom_history=[ np.array([mom_1, mom_2, mom_3]) ]
         self.timestep_history=[0]
+        self.weight_history=[ (0, 1.0) ] ## (index in pos_history, new weight)
         self.removal_reason=None
         
         self.X=None
@@ -62,6 +63,10 @@ class electron_history(object):
         self.mom_history.append(  np.array([mom_1, mom_2, mom_3]) )
         self.removal_reason=reason_removed
         
+    def change_weight(self, file_in):
+        weight=file_in.in_double()
+        self.weight_history.append( (len(self.pos_history)-1, weight) )
+        
 
     def get_X(self):
         if self.X is None:
@@ -111,6 +116,9 @@ def read_particle_history(fname="./particle_history_output"):
         elif command==3: ##remove existing electron
             ID=fin.in_int()
             electrons[ID].remove(fin)
+        elif command==5: ##change weight of existing electron
+            ID=fin.in_int()
+            electrons[ID].change_weight(fin)
         elif command==4: ##at end!
             break
         else:
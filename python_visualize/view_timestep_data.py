@@ -10,34 +10,12 @@ from read_binary import array_input, binary_input
 
 if __name__=="__main__":
     table_in=array_input( binary_input("./timestep_halving_hist") )
-    energies=table_in.read_doublesArray()
-    TS=table_in.read_doublesArray()
-    halvings=table_in.read_doublesArray()
-    
-    N_bins=100
-    lowest_bin=3.5
-    highest_bin=4000
-    
-    bin_edges=np.logspace(np.log10(lowest_bin), np.log10(highest_bin), N_bins+1)
-    
-    TS_bins=[ [] for x in range(N_bins) ]
-    halvings_bins=[ [] for x in range(N_bins) ]
-    
-    
-    for ei in range(len(energies)):
-        E=energies[ei]*energy_units_kev
-        T=TS[ei]
-        H=halvings[ei]
-        
-        bin_i=np.searchsorted(bin_edges, E)
-        if bin_i>=0 and bin_i<N_bins:
-            TS_bins[bin_i].append(T)
-            halvings_bins[bin_i].append(H)
-            
-    ave_TS=[np.average(b) for b in TS_bins]
-    ave_halvings=[ np.average(b) for b in halvings_bins]
-    TS_std=[np.std(b) for b in TS_bins]
-    halving_std=[np.std(b) for b in halvings_bins]
+    bin_edges=table_in.read_doublesArray()
+    num_steps=table_in.read_doublesArray()
+    ave_TS=table_in.read_doublesArray()
+    TS_std=table_in.read_doublesArray()
+    ave_halvings=table_in.read_doublesArray()
+    halving_std=table_in.read_doublesArray()
     
     fig, ax1 = plt.subplots()
     
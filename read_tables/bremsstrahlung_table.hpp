@@ -10,6 +10,7 @@
 #include "CDF_sampling.hpp"
 #include "rand.hpp"
 #include "span_tree.hpp"
+#include "object_pool.hpp"
 
 #include "../physics/interaction_chooser.hpp"
 #include "../physics/particles.hpp"
@@ -74,8 +75,12 @@ public:
 
     rand_threadsafe rand;
 
+    object_pool<photon_T>* photon_pool; //new photons are made in this pool, if set. Not owned
+
     bremsstrahlung_table()
     {
+        photon_pool=nullptr;
+
         binary_input fin("./tables/shielded_coulomb_diffusion");
         array_input table_in(fin);
 
@@ -91,6 +96,11 @@ public:
         rate_vs_electron_energy->lower_fill=0;
     }
 
+    void set_pool(object_pool<photon_T>* photon_pool_)
+    {
+        photon_pool=photon_pool_;
+    }
+
     double rate(double energy)
     {
         double R=rate_vs_electron_energy->call(energy);
@@ -126,9 +136,18 @@ public:
         normalize(electron->momentum);
 
         //make new photon
-        photon_T* new_photon= new photon_T;
-        new_photon->position.clone_from( electron->position);
-        new_photon->travel_direction.clone_from( electron->momentum); //electron momentum is normalized
+        photon_T* new_photon;
+        if(photon_pool)
+        {
+            new_photon=photon_pool->create();
+        }
+        else
+        {
+            new_photon=new photon_T;
+        }
+        new_photon->position=electron->position;
+        new_photon->travel_direction=electron->momentum; //electron momentum is normalized
+        new_photon->weight=electron->weight;
         new_photon->scatter_angle(photon_theta, azimuth_angle);
 
         //fix electron
@@ -7,9 +7,11 @@
 #include <ctime>
 #include <fstream>
 #include <string>
+#include <atomic>
 
 #include "arrays_IO.hpp"
 #include "GSL_utils.hpp"
+#include "vec3.hpp"
 //#include "histogram.hpp"
 #include "gen_ex.hpp"
 #include "integrate.hpp"
@@ -20,6 +22,7 @@
 
 #include "../physics/shielded_coulomb_diffusion.hpp"
 #include "../physics/particles.hpp"
+#include "../physics/electron_store.hpp"
 
 class diffusion_table
 {
@@ -100,10 +103,12 @@ class diffusion_table
     std::vector<energy_level> energy_samplers;
     rand_threadsafe rand;
 
-    //stats:
-    int fast_steps;
-    int slow_steps_below_timestep;
-    int slow_steps_above_energy;
+    electron_T working_electron; //for electrons in an electron_store
+
+    //stats: atomic, since sim_cls::run_parallel scatters from many threads
+    std::atomic<int> fast_steps;
+    std::atomic<int> slow_steps_below_timestep;
+    std::atomic<int> slow_steps_above_energy;
 
     diffusion_table()
     {
@@ -169,7 +174,7 @@ class diffusion_table
         }
 
 
-        gsl::vector T({0,0,1});
+        vec3 T(0,0,1);
         for(size_t current_num_interactions=0; current_num_interactions<expected_num_samples; current_num_interactions++)
         {
 
@@ -186,19 +191,17 @@ class diffusion_table
             double C=-sin(inclination_scattering)*sin(azimuth_scattering); //basis vector will be vector Cv below
 
             //find vector Bv, perpinduclar to momentum
-            gsl::vector init({1,0,0});
-            gsl::vector Bv=cross(init, T);
+            vec3 Bv=cross(vec3(1,0,0), T);
             if(Bv.sum_of_squares()<0.1) //init and momentum are close to parellel. Which would cause errors below
             {
-                init=gsl::vector({0,1,0}); //so we try a different init. momentum cannot be parrellel to both inits
-                Bv=cross(init, T);
+                Bv=cross(vec3(0,1,0), T); //so we try a different init. momentum cannot be parrellel to both inits
             }
 
             //normalize Bv
-            Bv/=sqrt(Bv.sum_of_squares());
+            Bv/=Bv.norm();
 
             //now we find Cv
-            gsl::vector Cv=cross(Bv, T); //Bv and momentum are garenteed to be perpindicular,therefor Cv should have unit magnitude
+            vec3 Cv=cross(Bv, T); //Bv and momentum are garenteed to be perpindicular,therefor Cv should have unit magnitude
 
             //find new vector
             T=A*T + B*Bv + C*Cv;
@@ -212,17 +215,26 @@ class diffusion_table
         return rand.uniform()*2*PI;
     }
 
-    inline void scatter(double energy, electron_T *particle)
+    inline void scatter(double energy, electron_T *particle, double density_ratio=1)
+    //density_ratio is the air density relative to sea level (see atmosphere.hpp). The amount of scattering only depends on timestep times density
     {
-        double inclination=sample(energy, particle->timestep);
+        double inclination=sample(energy, particle->timestep*density_ratio);
         particle->scatter_angle(inclination, sample_azimuth() );
     }
 
+    void scatter(double energy, electron_store& electrons, size_t handle, double density_ratio=1)
+    //same as above, for an electron in an electron_store
+    {
+        electrons.load_kinematics(handle, &working_electron);
+        scatter(energy, &working_electron, density_ratio);
+        electrons.save_kinematics(handle, &working_electron);
+    }
+
     void print_stats()
     {
-        print("num. fast diffusion steps:", fast_steps);
-        print("num. slow diffusion steps below timestep:", slow_steps_below_timestep);
-        print("num. slow diffusion steps above energy:", slow_steps_above_energy);
+        print("num. fast diffusion steps:", fast_steps.load());
+        print("num. slow diffusion steps below timestep:", slow_steps_below_timestep.load());
+        print("num. slow diffusion steps above energy:", slow_steps_above_energy.load());
     }
 };
 
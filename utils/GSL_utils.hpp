@@ -135,7 +135,8 @@ gsl::vector make_vector(const std::vector<double> &data)
 	return out;
 }
 
-gsl::vector cross(gsl::vector& A, gsl::vector& B)
+gsl::vector cross(const gsl::vector& A, const gsl::vector& B)
+//allocates a new vector. For kinematics use vec3 and the cross in vec3.hpp instead
 {
 	if((A.size() != 3) or (B.size() != 3))
 	{
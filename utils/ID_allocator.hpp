@@ -0,0 +1,158 @@
+#ifndef ID_ALLOCATOR_HPP
+#define ID_ALLOCATOR_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+#include "gen_ex.hpp"
+
+/* ID_allocator hands out unique IDs (for particles), and can be used from many threads.
+
+IDs are given out in blocks of block_size. Each thread takes IDs from its own block, so only one in block_size calls touches shared data.
+
+Normally blocks come from an atomic counter. With one thread the IDs are sequential: 0, 1, 2...
+Which thread gets which block from the counter depends on timing, so for reproducible IDs with many threads:
+    call begin_workers(N) on the main thread,
+    then each of the N worker threads calls register_worker(index), with index from 0 to N-1,
+    and call end_workers() on the main thread after the workers are joined.
+Between these, worker i takes blocks i, i+N, i+2N... (after the blocks already used), so that the IDs only depend on the number of workers
+and on what each worker does. Threads that are not registered can not make IDs untill end_workers is called.
+*/
+
+class ID_allocator
+{
+public:
+    static const size_t block_size=1024;
+    static const size_t max_blocks=size_t(-1)/block_size;
+
+private:
+    struct thread_IDs
+    {
+        size_t next; //next ID to hand out
+        size_t end; //one past the last ID in the block
+        size_t epoch; //block is only valid in this epoch
+        bool is_worker;
+        size_t worker_index;
+        size_t blocks_used; //blocks taken by this worker since begin_workers
+    };
+
+    static thread_IDs& local_IDs()
+    {
+        static thread_local thread_IDs IDs={0, 0, 0, false, 0, 0};
+        return IDs;
+    }
+
+    static std::atomic<size_t> next_block;
+    static std::atomic<size_t> epoch; //changes at begin_workers and end_workers, which makes all the old blocks invalid
+    static bool have_workers;
+    static size_t worker_base_block;
+    static size_t num_workers;
+    static std::vector<size_t> worker_blocks_used;
+
+    static void new_block(thread_IDs& IDs)
+    {
+        size_t current_epoch=epoch.load(std::memory_order_relaxed);
+        size_t block;
+        if(IDs.is_worker and IDs.epoch==current_epoch)
+        {
+            block=worker_base_block + IDs.blocks_used*num_workers + IDs.worker_index;
+            IDs.blocks_used++;
+            worker_blocks_used[IDs.worker_index]=IDs.blocks_used;
+        }
+        else
+        {
+            if(have_workers)
+            {
+                throw gen_exception("thread that is not a registered worker asked for an ID");
+            }
+            IDs.is_worker=false;
+            block=next_block.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(block>=max_blocks)
+        {
+            throw gen_exception("Too many particles");
+        }
+
+        IDs.next=block*block_size;
+        IDs.end=IDs.next+block_size;
+        IDs.epoch=current_epoch;
+    }
+
+public:
+
+    static size_t new_ID()
+    //return a new unique ID
+    {
+        thread_IDs& IDs=local_IDs();
+        if(IDs.next==IDs.end or IDs.epoch!=epoch.load(std::memory_order_relaxed))
+        {
+            new_block(IDs);
+        }
+        size_t ID=IDs.next;
+        IDs.next++;
+        return ID;
+    }
+
+    static void begin_workers(size_t num_workers_)
+    //call on the main thread before starting num_workers_ worker threads
+    {
+        if(have_workers)
+        {
+            throw gen_exception("begin_workers called twice");
+        }
+        have_workers=true;
+        worker_base_block=next_block.load();
+        num_workers=num_workers_;
+        worker_blocks_used.assign(num_workers, 0);
+        epoch++;
+    }
+
+    static void register_worker(size_t worker_index)
+    //call on each worker thread, after begin_workers and before the worker makes any IDs
+    {
+        if(not have_workers or worker_index>=num_workers)
+        {
+            throw gen_exception("worker ", worker_index, " is not expected");
+        }
+        thread_IDs& IDs=local_IDs();
+        IDs.is_worker=true;
+        IDs.worker_index=worker_index;
+        IDs.blocks_used=0;
+        IDs.epoch=epoch.load();
+        IDs.next=IDs.end; //take a new block on next ID
+    }
+
+    static void restart()
+    //hand out IDs from 0 again. Call on the main thread, with no workers, when no particles with IDs are kept (to repeat a run with the same IDs)
+    {
+        if(have_workers)
+        {
+            throw gen_exception("restart called between begin_workers and end_workers");
+        }
+        next_block=0;
+        epoch++;
+    }
+
+    static void end_workers()
+    //call on the main thread after the worker threads are finished
+    {
+        size_t max_used=0;
+        for(size_t used : worker_blocks_used)
+        {
+            if(used>max_used) max_used=used;
+        }
+        next_block=worker_base_block + max_used*num_workers;
+        have_workers=false;
+        epoch++;
+    }
+};
+std::atomic<size_t> ID_allocator::next_block(0);
+std::atomic<size_t> ID_allocator::epoch(0);
+bool ID_allocator::have_workers=false;
+size_t ID_allocator::worker_base_block=0;
+size_t ID_allocator::num_workers=0;
+std::vector<size_t> ID_allocator::worker_blocks_used;
+
+#endif
@@ -164,6 +164,12 @@ public:
         return size;
     }
 
+    int get_type()
+    //0 for arrays, 1 for ints, 2 for floats, 3 for doubles
+    {
+        return type;
+    }
+
     gsl::vector_long read_ints()
     {
         if(type!=1){ throw gen_exception("cannot read integers from file"); }
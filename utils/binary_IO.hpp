@@ -4,6 +4,7 @@
 #include<string>
 #include<iostream>
 #include<fstream>
+#include<sstream>
 #include<cstdint>
 #include<memory>
 
@@ -13,7 +14,8 @@
 class binary_output
 {
    public:
-    std::shared_ptr<std::ofstream> out_file;
+    std::shared_ptr<std::ostream> out_file;
+    std::shared_ptr<std::ostringstream> buffer; //set if this writes to memory
 
     int writes;
 
@@ -23,6 +25,14 @@ class binary_output
 		out_file=std::make_shared<std::ofstream>(fname.c_str(), std::ios_base::binary);
 	}
 
+    binary_output()
+    //write into memory. Use move_to to write the memory to another binary_output
+    {
+        writes=0;
+        buffer=std::make_shared<std::ostringstream>(std::ios_base::binary);
+        out_file=buffer;
+    }
+
     void out_short(int8_t out)
     {
         writes++;
@@ -51,6 +61,19 @@ class binary_output
     {
         out_file->flush();
     }
+
+    void move_to(binary_output& other)
+    //write everything in memory to other, and empty the memory
+    {
+        if(not buffer) throw gen_exception("binary_output is not writing to memory");
+
+        const std::string& data=buffer->str();
+        other.out_file->write(data.data(), data.size());
+        other.writes+=writes;
+
+        buffer->str("");
+        writes=0;
+    }
 };
 
 class binary_input
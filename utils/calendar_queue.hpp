@@ -0,0 +1,280 @@
+#ifndef CALENDAR_QUEUE_HPP
+#define CALENDAR_QUEUE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "object_pool.hpp"
+
+/*
+calendar_queue keeps objects sorted by time, with the same interface as time_tree.
+
+Based on: R. Brown, "Calendar queues: a fast O(1) priority queue implementation for the simulation event set problem", Comm. ACM 31 (1988)
+
+Time is split into buckets (days) of bucket_width, and the buckets wrap around (a year is num_buckets days). Each bucket is a small array sorted by time.
+The number of buckets and the bucket width are re-sized as the number of objects changes, so that there are about one to two objects in each day.
+Inserting and popping are O(1) on average if the times are spread out. It can be slow if very many objects have nearly the same time.
+Times should not be negative. Objects with the same time come out in the order they were put in.
+*/
+
+template< typename DATA_T>
+class calendar_queue
+{
+    struct entry
+    {
+        double time;
+        size_t order; //for breaking ties
+        DATA_T* data_ptr; //we own this data!
+    };
+
+    // each bucket is sorted so that the first object is at the back
+    std::vector< std::vector<entry> > buckets;
+    double bucket_width;
+    size_t num_entries;
+    size_t next_order;
+
+    // where the search for the first object starts
+    size_t current_bucket;
+    int64_t current_day;
+
+    // If set, data is made and deleted through this pool instead of new and delete. Not owned
+    object_pool<DATA_T>* data_pool;
+
+    static const size_t min_buckets=2;
+
+    static inline bool _before( const entry& A, const entry& B )
+    {
+        return A.time<B.time or (A.time==B.time and A.order<B.order);
+    }
+
+    inline int64_t _day( double time )
+    {
+        return int64_t( std::floor(time/bucket_width) );
+    }
+
+    inline size_t _bucket_index( double time )
+    {
+        return size_t( _day(time) ) & (buckets.size()-1);
+    }
+
+    void _move_to( double time )
+    // set the search to start at the day of time
+    {
+        current_day=_day(time);
+        current_bucket=size_t(current_day) & (buckets.size()-1);
+    }
+
+    void _add_entry( const entry& new_entry )
+    {
+        std::vector<entry>& bucket=buckets[ _bucket_index(new_entry.time) ];
+
+        //insertion sort, with the first object at the back
+        bucket.push_back(new_entry);
+        size_t i=bucket.size()-1;
+        while( i>0 and _before(bucket[i-1], new_entry) )
+        {
+            bucket[i]=bucket[i-1];
+            i--;
+        }
+        bucket[i]=new_entry;
+    }
+
+    size_t _find_first()
+    // return index of bucket that has the first object. Moves the search position to that bucket. There must be at least one object
+    {
+        size_t num_buckets=buckets.size();
+        for( size_t n=0; n<num_buckets; n++ )
+        {
+            std::vector<entry>& bucket=buckets[current_bucket];
+            if( not bucket.empty() and _day(bucket.back().time)<=current_day )
+                return current_bucket;
+
+            current_bucket++;
+            if( current_bucket==num_buckets )
+                current_bucket=0;
+            current_day++;
+        }
+
+        //nothing in this year, search all buckets directly
+        size_t best=num_buckets;
+        for( size_t i=0; i<num_buckets; i++ )
+        {
+            if( not buckets[i].empty() and (best==num_buckets or _before(buckets[i].back(), buckets[best].back())) )
+                best=i;
+        }
+        _move_to( buckets[best].back().time );
+        return best;
+    }
+
+    void _resize( size_t new_num_buckets )
+    // change the number of buckets, and estimate a new bucket width from the spacing between the first objects
+    {
+        std::vector<entry> all_entries;
+        all_entries.reserve(num_entries);
+        for( std::vector<entry>& bucket : buckets )
+        {
+            all_entries.insert( all_entries.end(), bucket.begin(), bucket.end() );
+        }
+
+        //average seperation of the first (up to) 25 objects. Ignore unusually large gaps, as Brown does
+        size_t num_sample=std::min( all_entries.size(), size_t(25) );
+        if( num_sample>1 )
+        {
+            std::partial_sort( all_entries.begin(), all_entries.begin()+num_sample, all_entries.end(), _before );
+            double average_seperation=(all_entries[num_sample-1].time-all_entries[0].time)/(num_sample-1);
+
+            double total=0;
+            size_t num_used=0;
+            for( size_t i=1; i<num_sample; i++ )
+            {
+                double seperation=all_entries[i].time-all_entries[i-1].time;
+                if( seperation<=2*average_seperation )
+                {
+                    total+=seperation;
+                    num_used++;
+                }
+            }
+            if( num_used>0 and total>0 )
+            {
+                bucket_width=3.0*total/num_used;
+            }
+        }
+
+        buckets.clear();
+        buckets.resize( new_num_buckets );
+        for( entry& E : all_entries )
+        {
+            _add_entry( E );
+        }
+
+        if( num_entries>0 )
+            _move_to( all_entries[0].time );
+        else
+            _move_to( 0 );
+    }
+
+public:
+
+    calendar_queue( double initial_bucket_width=1.0 ) : buckets(min_buckets), bucket_width(initial_bucket_width), num_entries(0), next_order(0),
+                                                        current_bucket(0), current_day(0), data_pool(nullptr)
+    {
+    }
+
+    ~calendar_queue()
+    {
+        clear();
+    }
+
+    // Clear out the data in the queue. Keeps the bucket width
+    void clear()
+    {
+        for( std::vector<entry>& bucket : buckets )
+        {
+            for( entry& E : bucket )
+                release( E.data_ptr );
+        }
+        buckets.clear();
+        buckets.resize( min_buckets );
+        num_entries=0;
+        next_order=0;
+        _move_to( 0 );
+    }
+
+    // Make and delete data through pool, instead of new and delete. Set this before anything is inserted
+    void set_pool( object_pool<DATA_T>* pool )
+    {
+        data_pool=pool;
+    }
+
+    // Delete data that is no longer in the queue (for example, after pop_first)
+    void release( DATA_T* data_ptr )
+    {
+        if( data_pool )
+            data_pool->destroy( data_ptr );
+        else
+            delete data_ptr;
+    }
+
+    inline size_t size()
+    {
+        return num_entries;
+    }
+
+    //return data that is first in the queue, and remove it from the queue.
+    //the queue relinquishes ownership of the object
+    DATA_T* pop_first()
+    {
+        if( num_entries==0 )
+            return nullptr;
+
+        std::vector<entry>& bucket=buckets[ _find_first() ];
+        DATA_T* ret=bucket.back().data_ptr;
+        bucket.pop_back();
+        num_entries--;
+
+        if( buckets.size()>min_buckets and num_entries<buckets.size()/2 )
+            _resize( buckets.size()/2 );
+
+        return ret;
+    }
+
+    //return the data that is first in the queue without removing it
+    //queue keeps ownershp of the object
+    DATA_T* get_first()
+    {
+        if( num_entries==0 )
+            return nullptr;
+        return buckets[ _find_first() ].back().data_ptr;
+    }
+
+    //return the time that is first in the queue without removing it
+    double get_first_time()
+    {
+        if( num_entries==0 )
+            return 0;
+        return buckets[ _find_first() ].back().time;
+    }
+
+    // Insert data into the queue
+    void insert( double time_value, DATA_T* data_ptr )
+    {
+        entry new_entry;
+        new_entry.time=time_value;
+        new_entry.order=next_order;
+        new_entry.data_ptr=data_ptr;
+        next_order++;
+
+        _add_entry( new_entry );
+        num_entries++;
+
+        //the search must not start after the new object
+        if( num_entries==1 or _day(time_value)<current_day )
+            _move_to( time_value );
+
+        if( num_entries>2*buckets.size() )
+            _resize( 2*buckets.size() );
+    }
+
+    //make a new object with arguments, place it in the queue
+    //return pointer to new object, but queue maintains ownership of the object
+    template< typename... args_T >
+    DATA_T* emplace(double time, args_T&& ...args)
+    {
+        DATA_T* new_data_ptr;
+        if(data_pool)
+        {
+            new_data_ptr=data_pool->create(args...);
+        }
+        else
+        {
+            new_data_ptr=new DATA_T(args...);
+        }
+        insert(time, new_data_ptr);
+        return new_data_ptr;
+    }
+};
+
+#endif
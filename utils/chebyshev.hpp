@@ -378,7 +378,8 @@ public:
         {
             Wr0=W0-N*rate;
 
-            return root_finder_brent(this, Xhigh, Xlow, (Xhigh-Xlow)/100000.0, (Xhigh-Xlow)/1000.0, 10000);
+            auto quartic=[this](double x){ return quartic_inversion_helper::call(x); }; //not virtual, so it can be inlined
+            return brent_root(quartic, Xlow, Xhigh, (Xhigh-Xlow)/100000.0, (Xhigh-Xlow)/1000.0, 10000);
         }
     };
 
@@ -0,0 +1,115 @@
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+/* object_pool hands out objects of one type from large chunks of memory, instead of allocating each object seperately.
+
+Objects that are given back with destroy are re-used by the next create. release_all gives back every object at once, without destructing them, but keeps
+the chunks, so that re-running a simulation does not allocate again or fragment memory. Only use release_all for types that do not need their destructor
+(like electron_T and photon_T).
+
+object_pool is not thread safe. Use one pool per thread.
+*/
+
+template<typename DATA_T>
+class object_pool
+{
+private:
+    typedef typename std::aligned_storage<sizeof(DATA_T), alignof(DATA_T)>::type slot_T;
+
+    std::vector<slot_T*> chunks;
+    std::vector<DATA_T*> free_list; //objects that have been destroyed, and can be re-used
+    size_t chunk_size;
+    size_t current_chunk; //index of chunk that new objects come from
+    size_t next_in_chunk; //index of next unused slot in current_chunk
+    size_t num_live;
+
+    void* next_slot()
+    {
+        if(free_list.size()>0)
+        {
+            DATA_T* ret=free_list.back();
+            free_list.pop_back();
+            return ret;
+        }
+
+        if(next_in_chunk==chunk_size)
+        {
+            current_chunk++;
+            next_in_chunk=0;
+        }
+        if(current_chunk==chunks.size())
+        {
+            chunks.push_back(new slot_T[chunk_size]);
+        }
+
+        slot_T* ret=chunks[current_chunk] + next_in_chunk;
+        next_in_chunk++;
+        return ret;
+    }
+
+public:
+
+    object_pool(size_t chunk_size_=1024)
+    {
+        chunk_size=chunk_size_;
+        current_chunk=0;
+        next_in_chunk=0;
+        num_live=0;
+    }
+
+    ~object_pool()
+    {
+        for(slot_T* chunk : chunks)
+        {
+            delete[] chunk;
+        }
+    }
+
+    object_pool(const object_pool&)=delete;
+    object_pool& operator=(const object_pool&)=delete;
+
+    template< typename... args_T >
+    DATA_T* create(args_T&& ...args)
+    //make a new object with arguments
+    {
+        DATA_T* ret=new(next_slot()) DATA_T(std::forward<args_T>(args)...);
+        num_live++;
+        return ret;
+    }
+
+    void destroy(DATA_T* object)
+    //destruct an object made by create. The memory is re-used
+    {
+        object->~DATA_T();
+        free_list.push_back(object);
+        num_live--;
+    }
+
+    void release_all()
+    //give back all objects, without calling destructors. All pointers from this pool become invalid
+    {
+        static_assert(std::is_trivially_destructible<DATA_T>::value, "release_all needs objects that do not need their destructors");
+        free_list.clear();
+        current_chunk=0;
+        next_in_chunk=0;
+        num_live=0;
+    }
+
+    inline size_t size()
+    //number of objects that are currently made
+    {
+        return num_live;
+    }
+
+    inline size_t capacity()
+    {
+        return chunks.size()*chunk_size;
+    }
+};
+
+#endif
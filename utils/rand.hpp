@@ -82,11 +82,26 @@ public:
 class rand_threadsafe
 //slightly heavier than just the ran class
 //use if need to be threadsafe
+//a thread can set its own generator with set_thread_rand. Then every rand_threadsafe uses that generator on that thread, without locking.
+//this is faster with many threads, and gives reproducible numbers for each thread
 {
 public:
     gsl_rng* rand;
     std::mutex rand_mutex;
 
+    static gsl_rng*& thread_rand()
+    //generator of this thread, or nullptr
+    {
+        static thread_local gsl_rng* thread_rand_=nullptr;
+        return thread_rand_;
+    }
+
+    static void set_thread_rand(gsl_rng* rand_)
+    //set the generator of this thread, does not take ownership. Set to nullptr to go back to the shared generators
+    {
+        thread_rand()=rand_;
+    }
+
     rand_threadsafe(bool do_seed=true)
     {
         rand=gsl_rng_alloc(gsl_rng_mt19937);
@@ -123,24 +138,36 @@ public:
 
     double uniform()
     {
+        gsl_rng* R=thread_rand();
+        if(R) return gsl_rng_uniform(R);
+
         std::lock_guard<std::mutex> lock(rand_mutex);
         return gsl_rng_uniform(rand);
     }
 
     double uniform(double a, double b)
     {
+        gsl_rng* R=thread_rand();
+        if(R) return a + (b-a)*gsl_rng_uniform(R);
+
         std::lock_guard<std::mutex> lock(rand_mutex);
         return a + (b-a)*gsl_rng_uniform(rand);
     }
 
     double poisson(double mu)
     {
+        gsl_rng* R=thread_rand();
+        if(R) return gsl_ran_poisson(R, mu);
+
         std::lock_guard<std::mutex> lock(rand_mutex);
         return gsl_ran_poisson(rand, mu);
     }
 
     double exponential(double mu)
     {
+        gsl_rng* R=thread_rand();
+        if(R) return gsl_ran_exponential(R, mu);
+
         std::lock_guard<std::mutex> lock(rand_mutex);
         return gsl_ran_exponential (rand, mu);
     }
@@ -1,55 +1,384 @@
-
 #ifndef ROOT_FINDING_HPP
 #define ROOT_FINDING_HPP
 
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
 #include <gsl/gsl_roots.h>
 #include <gsl/gsl_errno.h>
 
 #include "functor.hpp"
 #include "gen_ex.hpp"
 
-double root_finder_brent(gsl_function& func, double upper_bound, double lower_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+//// bracketed root finders ////
+// brent_root, itp_root and newton_root are templated on the function, which is anything that can be called with a double (a lambda, or a functor_1D),
+// so the function can be inlined. They keep their state on the stack, and do not allocate. The root needs to be bracketed by lower_bound and upper_bound.
+//   brent_root is the same algorithm as the GSL brent solver, and stops when interval_converged (the same test as gsl_root_test_interval).
+//   itp_root (interpolate, truncate and project, Oliveira and Takahashi 2020) never takes more steps than bisection, plus one, and is usually as fast as brent.
+//   newton_root needs the derivative, and bisects whenever a Newton step would leave the bracket or converges too slowly.
+// cubic_root solves a cubic in closed form, and is used where the function is a polynomial of third order or less.
+// root_finder_brent, with a gsl_function, is the GSL solver. With a functor_1D it is brent_root.
+
+inline bool interval_converged(double lower, double upper, double epsabs, double epsrel)
+//same as gsl_root_test_interval
 {
-    const gsl_root_fsolver_type *T= gsl_root_fsolver_brent;
-    gsl_root_fsolver *solver = gsl_root_fsolver_alloc (T);
+    double min_abs=0;
+    if((lower>0 and upper>0) or (lower<0 and upper<0))
+    {
+        min_abs=std::min(std::abs(lower), std::abs(upper));
+    }
+    return std::abs(upper-lower) < epsabs + epsrel*min_abs;
+}
 
-    gsl_root_fsolver_set (solver, &func, lower_bound, upper_bound);
+template<typename function_T>
+double brent_root(function_T&& func, double lower_bound, double upper_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+{
+    double a=lower_bound;
+    double b=upper_bound;
+    double fa=func(a);
+    double fb=func(b);
+    if((fa<0 and fb<0) or (fa>0 and fb>0))
+    {
+        throw gen_exception("root is not bracketed");
+    }
 
-    double root=0;
-    int iter=0;
-    int status=GSL_CONTINUE;
-    do
+    double c=b;
+    double fc=fb;
+    double d=b-a;
+    double e=b-a;
+    for(int iter=0; iter<max_iter; iter++)
     {
-        iter++;
-        status = gsl_root_fsolver_iterate (solver);
-        root = gsl_root_fsolver_root (solver);
-        lower_bound = gsl_root_fsolver_x_lower (solver);
-        upper_bound = gsl_root_fsolver_x_upper (solver);
-        status = gsl_root_test_interval(lower_bound, upper_bound, epsabs, epsrel);
+        bool ac_equal=false;
+        if((fb<0 and fc<0) or (fb>0 and fc>0))
+        {
+            ac_equal=true;
+            c=a;
+            fc=fa;
+            d=b-a;
+            e=b-a;
+        }
+        if(std::abs(fc)<std::abs(fb))
+        {
+            ac_equal=true;
+            a=b;
+            b=c;
+            c=a;
+            fa=fb;
+            fb=fc;
+            fc=fa;
+        }
 
-        if (status == GSL_SUCCESS) break;
+        double tol=0.5*DBL_EPSILON*std::abs(b);
+        double m=0.5*(c-b);
+        if(fb==0 or std::abs(m)<=tol)
+        {
+            return b;
+        }
+
+        if(std::abs(e)<tol or std::abs(fa)<=std::abs(fb))
+        {
+            d=m; //bisection
+            e=m;
+        }
+        else
+        {
+            double p, q;
+            double s=fb/fa;
+            if(ac_equal) //secant
+            {
+                p=2*m*s;
+                q=1-s;
+            }
+            else //inverse quadratic
+            {
+                double r;
+                q=fa/fc;
+                r=fb/fc;
+                p=s*(2*m*q*(q-r) - (b-a)*(r-1));
+                q=(q-1)*(r-1)*(s-1);
+            }
+
+            if(p>0)
+            {
+                q=-q;
+            }
+            else
+            {
+                p=-p;
+            }
+
+            if(2*p < std::min(3*m*q - std::abs(tol*q), std::abs(e*q)))
+            {
+                e=d;
+                d=p/q;
+            }
+            else
+            {
+                d=m;
+                e=m;
+            }
+        }
+
+        a=b;
+        fa=fb;
+        if(std::abs(d)>tol)
+        {
+            b+=d;
+        }
+        else
+        {
+            b+= m>0 ? tol : -tol;
+        }
+        fb=func(b);
+
+        double other= ((fb<0 and fc<0) or (fb>0 and fc>0)) ? a : c;
+        if(interval_converged(std::min(b, other), std::max(b, other), epsabs, epsrel))
+        {
+            return b;
+        }
     }
-    while (status == GSL_CONTINUE && iter < max_iter);
 
-    if(status != GSL_SUCCESS)
+    throw gen_exception("root finding errored");
+}
+
+template<typename function_T>
+double itp_root(function_T&& func, double lower_bound, double upper_bound, double epsabs)
+//the root to within epsabs
+{
+    double a=lower_bound;
+    double b=upper_bound;
+    double fa=func(a);
+    double fb=func(b);
+    if((fa<0 and fb<0) or (fa>0 and fb>0))
     {
-        throw general_exception("root finding errored");
+        throw gen_exception("root is not bracketed");
     }
+    if(fa==0) return a;
+    if(fb==0) return b;
 
-    gsl_root_fsolver_free (solver);
+    //so that func increases from a to b
+    double sign= fa<0 ? 1.0 : -1.0;
+    fa*=sign;
+    fb*=sign;
 
-    return root;
+    const double k1=0.2/(b-a);
+    const int n_max=std::max(int(std::ceil(std::log2((b-a)/(2*epsabs)))), 0) + 1;
+    for(int j=0; b-a>2*epsabs; j++)
+    {
+        //interpolate
+        double half=0.5*(a+b);
+        double x_f=(fb*a - fa*b)/(fb-fa);
+        //truncate
+        double step_sign= half>x_f ? 1.0 : -1.0;
+        double delta=k1*(b-a)*(b-a);
+        double x_t= delta<=std::abs(half-x_f) ? x_f + step_sign*delta : half;
+        //project
+        double r=epsabs*std::ldexp(1.0, n_max-j) - 0.5*(b-a);
+        double x= std::abs(x_t-half)<=r ? x_t : half - step_sign*r;
 
+        double fx=sign*func(x);
+        if(fx>0)
+        {
+            b=x;
+            fb=fx;
+        }
+        else if(fx<0)
+        {
+            a=x;
+            fa=fx;
+        }
+        else
+        {
+            return x;
+        }
+    }
+    return 0.5*(a+b);
 }
 
-double root_finder_brent(functor_1D* func, double upper_bound, double lower_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+template<typename function_T, typename derivative_T>
+double newton_root(function_T&& func, derivative_T&& derivative, double guess, double lower_bound, double upper_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+//Newton's method from guess, kept inside the bracket
 {
+    double f_low=func(lower_bound);
+    double f_high=func(upper_bound);
+    if((f_low<0 and f_high<0) or (f_low>0 and f_high>0))
+    {
+        throw gen_exception("root is not bracketed");
+    }
+    if(f_low==0) return lower_bound;
+    if(f_high==0) return upper_bound;
+
+    //func is negative at x_low
+    double x_low= f_low<0 ? lower_bound : upper_bound;
+    double x_high= f_low<0 ? upper_bound : lower_bound;
 
+    double x=std::min(std::max(guess, std::min(lower_bound, upper_bound)), std::max(lower_bound, upper_bound));
+    double old_dx=std::abs(upper_bound-lower_bound);
+    double dx=old_dx;
+    double f=func(x);
+    double df=derivative(x);
+    for(int iter=0; iter<max_iter; iter++)
+    {
+        if( ((x-x_high)*df-f)*((x-x_low)*df-f)>0 or std::abs(2*f)>std::abs(old_dx*df) )
+        {
+            old_dx=dx;
+            dx=0.5*(x_high-x_low);
+            x=x_low+dx;
+        }
+        else
+        {
+            old_dx=dx;
+            dx=f/df;
+            x-=dx;
+        }
+
+        if(std::abs(dx) < epsabs + epsrel*std::abs(x))
+        {
+            return x;
+        }
+
+        f=func(x);
+        df=derivative(x);
+        if(f<0)
+        {
+            x_low=x;
+        }
+        else if(f>0)
+        {
+            x_high=x;
+        }
+        else
+        {
+            return x;
+        }
+    }
+
+    throw gen_exception("root finding errored");
+}
+
+inline int solve_quadratic(double c0, double c1, double c2, double* roots)
+//real roots of c2*x^2 + c1*x + c0, returns the number of roots
+{
+    if(c2==0)
+    {
+        if(c1==0) return 0;
+        roots[0]=-c0/c1;
+        return 1;
+    }
+
+    double discriminant=c1*c1 - 4*c2*c0;
+    if(discriminant<0) return 0;
+    double q=-0.5*(c1 + (c1<0 ? -1.0 : 1.0)*std::sqrt(discriminant));
+    if(q==0)
+    {
+        roots[0]=0;
+        return 1;
+    }
+    roots[0]=q/c2;
+    roots[1]=c0/q;
+    return 2;
+}
+
+inline int solve_cubic(double c0, double c1, double c2, double c3, double* roots)
+//real roots of c3*x^3 + c2*x^2 + c1*x + c0, returns the number of roots
+{
+    if(c3==0)
+    {
+        return solve_quadratic(c0, c1, c2, roots);
+    }
+
+    double a=c2/c3;
+    double b=c1/c3;
+    double c=c0/c3;
+    double Q=(a*a - 3*b)/9.0;
+    double R=(2*a*a*a - 9*a*b + 27*c)/54.0;
+    double Q_cubed=Q*Q*Q;
+    if(R*R<Q_cubed) //three roots
+    {
+        double theta=std::acos(R/std::sqrt(Q_cubed));
+        double factor=-2*std::sqrt(Q);
+        roots[0]=factor*std::cos(theta/3.0) - a/3.0;
+        const double third_circle=2.0943951023931957; //2*pi/3
+        roots[1]=factor*std::cos(theta/3.0 + third_circle) - a/3.0;
+        roots[2]=factor*std::cos(theta/3.0 - third_circle) - a/3.0;
+        return 3;
+    }
+    else
+    {
+        double A=-(R<0 ? -1.0 : 1.0)*std::cbrt(std::abs(R) + std::sqrt(R*R-Q_cubed));
+        double B= A==0 ? 0.0 : Q/A;
+        roots[0]=A + B - a/3.0;
+        return 1;
+    }
+}
+
+inline double cubic_root(double c0, double c1, double c2, double c3, double lower_bound, double upper_bound)
+//the root of c3*x^3 + c2*x^2 + c1*x + c0 that is bracketed by lower_bound and upper_bound. Orders that are very small over the bracket are
+//dropped, then the root is polished with Newton's method on the full cubic. Falls back to brent_root if the closed form fails
+{
+    auto cubic=[=](double x){ return ((c3*x + c2)*x + c1)*x + c0; };
+    auto cubic_derivative=[=](double x){ return (3*c3*x + 2*c2)*x + c1; };
+
+    double low=std::min(lower_bound, upper_bound);
+    double high=std::max(lower_bound, upper_bound);
+    double f_low=cubic(low);
+    double f_high=cubic(high);
+    if((f_low<0 and f_high<0) or (f_low>0 and f_high>0))
+    {
+        throw gen_exception("root is not bracketed");
+    }
+    if(f_low==0) return low;
+    if(f_high==0) return high;
+
+    //size of each order over the bracket
+    double width=std::max(std::abs(low), std::abs(high));
+    double order_1=std::abs(c1)*width;
+    double order_2=std::abs(c2)*width*width;
+    double order_3=std::abs(c3)*width*width*width;
+    double drop=1.0E-10*(order_1+order_2+order_3);
+    double C3= order_3<drop ? 0.0 : c3;
+    double C2= (C3==0 and order_2<drop) ? 0.0 : c2;
+
+    double roots[3];
+    int num_roots=solve_cubic(c0, c1, C2, C3, roots);
+
+    //the root closest to the bracket
+    double slack=1.0E-6*(high-low);
+    double best=NAN;
+    double best_distance=INFINITY;
+    for(int i=0; i<num_roots; i++)
+    {
+        double distance=std::max(low-roots[i], roots[i]-high);
+        if(distance<best_distance)
+        {
+            best_distance=distance;
+            best=roots[i];
+        }
+    }
+    if(not (best_distance<=slack))
+    {
+        return brent_root(cubic, low, high, 0.0, 4*DBL_EPSILON, 1000);
+    }
+
+    double x=std::min(std::max(best, low), high);
+    for(int i=0; i<2; i++)
+    {
+        double df=cubic_derivative(x);
+        if(df==0) break;
+        double next=x - cubic(x)/df;
+        if(not (next>=low and next<=high)) break;
+        x=next;
+    }
+    return x;
+}
+
+double root_finder_brent(gsl_function& func, double upper_bound, double lower_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+{
     const gsl_root_fsolver_type *T= gsl_root_fsolver_brent;
-    gsl_root_fsolver *solver = gsl_root_fsolver_alloc(T);
+    gsl_root_fsolver *solver = gsl_root_fsolver_alloc (T);
 
-    auto F=func->get_gsl_func();
-    gsl_root_fsolver_set (solver, &F, lower_bound, upper_bound);
+    gsl_root_fsolver_set (solver, &func, lower_bound, upper_bound);
 
     double root=0;
     int iter=0;
@@ -67,14 +396,20 @@ double root_finder_brent(functor_1D* func, double upper_bound, double lower_boun
     }
     while (status == GSL_CONTINUE && iter < max_iter);
 
+    gsl_root_fsolver_free (solver); //before throwing, so the solver is not leaked
+
     if(status != GSL_SUCCESS)
     {
-        throw general_exception("root finding errored");
+        throw gen_exception("root finding errored");
     }
 
-    gsl_root_fsolver_free (solver);
-
     return root;
+
+}
+
+double root_finder_brent(functor_1D* func, double upper_bound, double lower_bound, double epsabs=0.001, double epsrel=0.001, int max_iter=100)
+{
+    return brent_root(*func, lower_bound, upper_bound, epsabs, epsrel, max_iter);
 }
 
 
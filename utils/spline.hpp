@@ -91,18 +91,28 @@ public:
 };
 
 //need to add some polynomial solving functions here
-double bracketed_poly_solver(polynomial* input_poly, double Xlow, double Xhigh, int max_iter)
+double bracketed_poly_solver(polynomial* input_poly, double Y_solve, double Xlow, double Xhigh, int max_iter)
+//X where input_poly is Y_solve, between Xlow and Xhigh. Cubics and lower are solved in closed form
 {
-    return root_finder_brent(input_poly, Xhigh, Xlow, (Xhigh-Xlow)/100000.0, (Xhigh-Xlow)/1000.0, max_iter);
+    const double* weights=input_poly->weights.data();
+    size_t num_weights=input_poly->weights.size();
+    if(num_weights<=4)
+    {
+        double W[4]={0, 0, 0, 0};
+        for(size_t i=0; i<num_weights; i++)
+        {
+            W[i]=weights[i];
+        }
+        return cubic_root(W[0]-Y_solve, W[1], W[2], W[3], Xlow, Xhigh);
+    }
+
+    auto shifted_poly=[=](double X){ return gsl_poly_eval(weights, num_weights, X) - Y_solve; };
+    return brent_root(shifted_poly, Xlow, Xhigh, (Xhigh-Xlow)/100000.0, (Xhigh-Xlow)/1000.0, max_iter);
 }
 
-double bracketed_poly_solver(polynomial* input_poly, double Y_solve, double Xlow, double Xhigh, int max_iter)
+double bracketed_poly_solver(polynomial* input_poly, double Xlow, double Xhigh, int max_iter)
 {
-    //print(input_poly->call(Xlow), input_poly->call(Xhigh), Y_solve);
-    input_poly->weights[0]-=Y_solve;
-    double ret=root_finder_brent(input_poly, Xhigh, Xlow, (Xhigh-Xlow)/100000.0, (Xhigh-Xlow)/1000.0, max_iter);
-    input_poly->weights[0]+=Y_solve;
-    return ret;
+    return bracketed_poly_solver(input_poly, 0.0, Xlow, Xhigh, max_iter);
 }
 
 
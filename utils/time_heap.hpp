@@ -0,0 +1,189 @@
+#ifndef TIME_HEAP_HPP
+#define TIME_HEAP_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "object_pool.hpp"
+
+/*
+time_heap keeps objects sorted by time, with the same interface as time_tree.
+
+It is a D-ary heap (4 children per node by default) kept in one contiguous array, so inserting and popping do not allocate (after the array has grown),
+and walk much less memory than the red-black tree. Objects with the same time come out in the order they were put in.
+*/
+
+template< typename DATA_T, int D=4>
+class time_heap
+{
+    struct entry
+    {
+        double time;
+        size_t order; //for breaking ties
+        DATA_T* data_ptr; //we own this data!
+    };
+
+    std::vector<entry> heap;
+    size_t next_order;
+
+    // If set, data is made and deleted through this pool instead of new and delete. Not owned
+    object_pool<DATA_T>* data_pool;
+
+    static inline bool _before( const entry& A, const entry& B )
+    {
+        return A.time<B.time or (A.time==B.time and A.order<B.order);
+    }
+
+    void _sift_up( size_t index )
+    {
+        entry moving=heap[index];
+        while( index>0 )
+        {
+            size_t parent=(index-1)/D;
+            if( not _before(moving, heap[parent]) )
+                break;
+            heap[index]=heap[parent];
+            index=parent;
+        }
+        heap[index]=moving;
+    }
+
+    void _sift_down( size_t index )
+    {
+        entry moving=heap[index];
+        size_t size=heap.size();
+        while( true )
+        {
+            size_t first_child=index*D + 1;
+            if( first_child>=size )
+                break;
+
+            size_t last_child=first_child+D;
+            if( last_child>size )
+                last_child=size;
+
+            size_t best=first_child;
+            for( size_t child=first_child+1; child<last_child; child++ )
+            {
+                if( _before(heap[child], heap[best]) )
+                    best=child;
+            }
+
+            if( not _before(heap[best], moving) )
+                break;
+            heap[index]=heap[best];
+            index=best;
+        }
+        heap[index]=moving;
+    }
+
+public:
+
+    time_heap() : next_order(0), data_pool(nullptr)
+    {
+    }
+
+    ~time_heap()
+    {
+        clear();
+    }
+
+    // Clear out the data in the heap
+    void clear()
+    {
+        for( entry& E : heap )
+            release( E.data_ptr );
+        heap.clear();
+        next_order=0;
+    }
+
+    // Make and delete data through pool, instead of new and delete. Set this before anything is inserted
+    void set_pool( object_pool<DATA_T>* pool )
+    {
+        data_pool=pool;
+    }
+
+    // Delete data that is no longer in the heap (for example, after pop_first)
+    void release( DATA_T* data_ptr )
+    {
+        if( data_pool )
+            data_pool->destroy( data_ptr );
+        else
+            delete data_ptr;
+    }
+
+    void reserve( size_t N )
+    {
+        heap.reserve(N);
+    }
+
+    inline size_t size()
+    {
+        return heap.size();
+    }
+
+    //return data that is first in the heap, and remove it from the heap.
+    //the heap relinquishes ownership of the object
+    DATA_T* pop_first()
+    {
+        if( heap.empty() )
+            return nullptr;
+
+        DATA_T* ret=heap[0].data_ptr;
+        heap[0]=heap.back();
+        heap.pop_back();
+        if( not heap.empty() )
+            _sift_down(0);
+        return ret;
+    }
+
+    //return the data that is first in the heap without removing it
+    //heap keeps ownershp of the object
+    DATA_T* get_first()
+    {
+        if( heap.empty() )
+            return nullptr;
+        return heap[0].data_ptr;
+    }
+
+    //return the time that is first in the heap without removing it
+    double get_first_time()
+    {
+        if( heap.empty() )
+            return 0;
+        return heap[0].time;
+    }
+
+    // Insert data into the heap
+    void insert( double time_value, DATA_T* data_ptr )
+    {
+        entry new_entry;
+        new_entry.time=time_value;
+        new_entry.order=next_order;
+        new_entry.data_ptr=data_ptr;
+        next_order++;
+
+        heap.push_back(new_entry);
+        _sift_up( heap.size()-1 );
+    }
+
+    //make a new object with arguments, place it in the heap
+    //return pointer to new object, but heap maintains ownership of the object
+    template< typename... args_T >
+    DATA_T* emplace(double time, args_T&& ...args)
+    {
+        DATA_T* new_data_ptr;
+        if(data_pool)
+        {
+            new_data_ptr=data_pool->create(args...);
+        }
+        else
+        {
+            new_data_ptr=new DATA_T(args...);
+        }
+        insert(time, new_data_ptr);
+        return new_data_ptr;
+    }
+};
+
+#endif
@@ -12,6 +12,8 @@ used red-black tree based on:
 #include <utility>
 #include <memory>
 
+#include "object_pool.hpp"
+
 #ifndef TIME_TREE_HPP
 #define TIME_TREE_HPP
 
@@ -64,6 +66,11 @@ class time_tree
    node_ptr _root;
    node_ptr first;
 
+   // Nodes come from a pool, so that inserting does not allocate
+   object_pool<rb_node> node_pool;
+   // If set, data is made and deleted through this pool instead of new and delete. Not owned
+   object_pool<DATA_T>* data_pool;
+
 
    /*
     * Typedefs
@@ -144,13 +151,13 @@ protected:
 
 
   // Clear out the data in a subtree
+  // The nodes themselves are given back to node_pool all at once
   void _clear( node_ptr subtree )
   {
       if( subtree ) {
           _clear( subtree->left );
           _clear( subtree->right );
-          delete subtree->data_ptr;
-          delete subtree;
+          release( subtree->data_ptr );
       }
   }
 
@@ -517,7 +524,7 @@ public:
 
 
   // Constructor
-  time_tree() : _root(nullptr), first(nullptr)
+  time_tree() : _root(nullptr), first(nullptr), data_pool(nullptr)
   {
   }
 
@@ -537,6 +544,23 @@ public:
       _clear( _root );
       _root = nullptr;
     }
+    first = nullptr;
+    node_pool.release_all();
+  }
+
+  // Make and delete data through pool, instead of new and delete. Set this before anything is inserted
+  void set_pool( object_pool<DATA_T>* pool )
+  {
+      data_pool=pool;
+  }
+
+  // Delete data that is no longer in the tree (for example, after pop_first)
+  void release( DATA_T* data_ptr )
+  {
+      if( data_pool )
+          data_pool->destroy( data_ptr );
+      else
+          delete data_ptr;
   }
 
 //return data that is first in the tree, and remove it from the tree.
@@ -564,7 +588,7 @@ DATA_T* pop_first()
 
         node = _replace_and_remove_node( node );
         _erase_balance( node );
-        delete node;
+        node_pool.destroy( node );
 
 
         return ret;
@@ -629,7 +653,7 @@ double get_first_time()
       }
 
       // Create the node
-      node_ptr node = new rb_node;
+      node_ptr node = node_pool.create();
       node->time = time_value;
       node->data_ptr = data_ptr;
       node->color = RED;
@@ -653,7 +677,15 @@ double get_first_time()
     template< typename... args_T >
     DATA_T* emplace(double time, args_T&& ...args)
     {
-        DATA_T* new_data_ptr=new DATA_T(args...);
+        DATA_T* new_data_ptr;
+        if(data_pool)
+        {
+            new_data_ptr=data_pool->create(args...);
+        }
+        else
+        {
+            new_data_ptr=new DATA_T(args...);
+        }
         insert(time, new_data_ptr);
         return new_data_ptr;
     }
@@ -0,0 +1,221 @@
+#ifndef VEC3_HPP
+#define VEC3_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include "vector.hpp"
+
+//// fixed-size 3-vector ////
+// gsl::vector keeps its data on the heap, so every temporary costs several mallocs. vec3 is a plain value type that lives on the stack,
+// and is meant for all the kinematics (positions, momenta, fields). Only convert to gsl::vector for input and output.
+
+class vec3
+{
+public:
+    double values[3];
+
+    constexpr vec3() : values{0.0, 0.0, 0.0} {}
+
+    constexpr vec3(double X, double Y, double Z) : values{X, Y, Z} {}
+
+    explicit vec3(const gsl::vector& V)
+    //convert from gsl::vector, V must have a length of 3
+    {
+        values[0]=V[0];
+        values[1]=V[1];
+        values[2]=V[2];
+    }
+
+    gsl::vector to_gsl() const
+    {
+        return gsl::vector({values[0], values[1], values[2]});
+    }
+
+    inline double& operator[](size_t i)
+    {
+        return values[i];
+    }
+
+    constexpr const double& operator[](size_t i) const
+    {
+        return values[i];
+    }
+
+    inline void set(double X, double Y, double Z)
+    {
+        values[0]=X;
+        values[1]=Y;
+        values[2]=Z;
+    }
+
+    constexpr double sum_of_squares() const
+    {
+        return values[0]*values[0] + values[1]*values[1] + values[2]*values[2];
+    }
+
+    inline double norm() const
+    {
+        return std::sqrt(sum_of_squares());
+    }
+
+    inline void mult_add(const vec3& V, double factor)
+    //this += V*factor
+    {
+        values[0]+=V.values[0]*factor;
+        values[1]+=V.values[1]*factor;
+        values[2]+=V.values[2]*factor;
+    }
+
+    inline vec3& operator+=(const vec3& V)
+    {
+        values[0]+=V.values[0];
+        values[1]+=V.values[1];
+        values[2]+=V.values[2];
+        return *this;
+    }
+
+    inline vec3& operator-=(const vec3& V)
+    {
+        values[0]-=V.values[0];
+        values[1]-=V.values[1];
+        values[2]-=V.values[2];
+        return *this;
+    }
+
+    inline vec3& operator*=(double factor)
+    {
+        values[0]*=factor;
+        values[1]*=factor;
+        values[2]*=factor;
+        return *this;
+    }
+
+    inline vec3& operator/=(double factor)
+    {
+        values[0]/=factor;
+        values[1]/=factor;
+        values[2]/=factor;
+        return *this;
+    }
+};
+
+constexpr vec3 operator+(const vec3& A, const vec3& B)
+{
+    return vec3(A[0]+B[0], A[1]+B[1], A[2]+B[2]);
+}
+
+constexpr vec3 operator-(const vec3& A, const vec3& B)
+{
+    return vec3(A[0]-B[0], A[1]-B[1], A[2]-B[2]);
+}
+
+constexpr vec3 operator-(const vec3& A)
+{
+    return vec3(-A[0], -A[1], -A[2]);
+}
+
+constexpr vec3 operator*(const vec3& A, double factor)
+{
+    return vec3(A[0]*factor, A[1]*factor, A[2]*factor);
+}
+
+constexpr vec3 operator*(double factor, const vec3& A)
+{
+    return vec3(A[0]*factor, A[1]*factor, A[2]*factor);
+}
+
+constexpr vec3 operator/(const vec3& A, double factor)
+{
+    return vec3(A[0]/factor, A[1]/factor, A[2]/factor);
+}
+
+constexpr double dot(const vec3& A, const vec3& B)
+{
+    return A[0]*B[0] + A[1]*B[1] + A[2]*B[2];
+}
+
+constexpr vec3 cross(const vec3& A, const vec3& B)
+{
+    return vec3(A[1]*B[2] - A[2]*B[1],
+                A[2]*B[0] - A[0]*B[2],
+                A[0]*B[1] - A[1]*B[0]);
+}
+
+inline double norm(const vec3& A)
+{
+    return A.norm();
+}
+
+inline void normalize(vec3& A)
+{
+    A/=A.norm();
+}
+
+
+//// W 3-vectors stored by component ////
+// used to step W particles at once (see apply_charged_force::charged_particle_RungeKuttaDP_batch). Loops over the lanes of one component are
+// simple enough for the compiler to vectorize. The operations do the same arithmetic, in the same order, as the vec3 operations of the same name.
+
+template<int W>
+class vec3_lanes
+{
+public:
+    double values[3][W];
+
+    inline double* operator[](size_t i)
+    {
+        return values[i];
+    }
+
+    inline const double* operator[](size_t i) const
+    {
+        return values[i];
+    }
+
+    inline void set_scaled(const vec3_lanes& V, double factor)
+    //this = V*factor
+    {
+        for(int i=0; i<3; i++)
+            for(int l=0; l<W; l++)
+                values[i][l]=V.values[i][l]*factor;
+    }
+
+    inline void mult_add(const vec3_lanes& V, double factor)
+    //this += V*factor
+    {
+        for(int i=0; i<3; i++)
+            for(int l=0; l<W; l++)
+                values[i][l]+=V.values[i][l]*factor;
+    }
+
+    inline void operator+=(const vec3_lanes& V)
+    {
+        for(int i=0; i<3; i++)
+            for(int l=0; l<W; l++)
+                values[i][l]+=V.values[i][l];
+    }
+
+    inline void operator-=(const vec3_lanes& V)
+    {
+        for(int i=0; i<3; i++)
+            for(int l=0; l<W; l++)
+                values[i][l]-=V.values[i][l];
+    }
+
+    inline void multiply_lanes(const double* factors)
+    //multiply each lane by its own factor
+    {
+        for(int i=0; i<3; i++)
+            for(int l=0; l<W; l++)
+                values[i][l]*=factors[l];
+    }
+
+    inline void sum_of_squares(double* out) const
+    {
+        for(int l=0; l<W; l++)
+            out[l]=values[0][l]*values[0][l] + values[1][l]*values[1][l] + values[2][l]*values[2][l];
+    }
+};
+
+#endif
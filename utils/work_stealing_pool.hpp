@@ -0,0 +1,482 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "gen_ex.hpp"
+
+/* work_stealing_pool runs tasks (particles) on many threads, where each task can make new tasks (secondaries).
+
+Each worker thread has its own deque of tasks. A worker takes tasks from the back of its own deque, and when that is empty it steals from the front
+of the deque of another worker. So workers mostly take their own newest tasks (which are still in cache), and steal the oldest tasks of others,
+which tend to be the ones that make the most new tasks.
+
+The deques are lock-free (Chase-Lev, in the C11 form of Le, Pop, Cohen and Zappa Nardelli 2013). Only the owner pushes and takes from the back,
+and thieves take from the front with a compare-and-swap. A new task is pushed onto the deque as soon as it is made, so other workers can steal it
+while the task that made it is still running. The deques are ring buffers that double when full, and keep their size between batches, so they do
+not allocate once they have grown. task_T needs to be trivially copyable (an index or a pointer is best).
+
+The threads are started once, and then run any number of batches of tasks. Between batches they wait, so a simulation that needs a barrier (like the
+end of a time slab) does not start new threads each time.
+
+usage:
+    work_stealing_pool<task_T> pool;
+    pool.start(num_threads, worker_start);
+    pool.run_tasks(initial_tasks, process); //as many times as needed
+    pool.stop();
+or pool.run(initial_tasks, num_threads, worker_start, process) to do all three for one batch.
+worker_start(worker_index) is called once on each worker thread when it starts (to set up per-thread state),
+and process(worker, task) is called for each task. process can call worker.push(new_task) and worker.get_index().
+If process throws on any worker, the other workers stop and the exception is re-thrown by run_tasks.
+*/
+
+template<typename task_T>
+class work_stealing_pool
+{
+    static_assert(std::is_trivially_copyable<task_T>::value, "work_stealing_pool needs tasks that are trivially copyable");
+
+    static const size_t words_per_task=(sizeof(task_T)+sizeof(uint64_t)-1)/sizeof(uint64_t);
+
+    class task_array
+    //ring buffer of tasks. A task is stored as atomic words, because a thief can read a slot while the owner re-uses it. Then the
+    //thief loses the compare-and-swap on top, and throws the torn task away
+    {
+    public:
+        int64_t capacity; //power of two
+        std::unique_ptr< std::atomic<uint64_t>[] > words;
+
+        task_array(int64_t capacity_) : words(new std::atomic<uint64_t>[capacity_*words_per_task])
+        {
+            capacity=capacity_;
+        }
+
+        void put(int64_t i, const task_T& task)
+        {
+            uint64_t buffer[words_per_task]={};
+            std::memcpy(buffer, &task, sizeof(task_T));
+            std::atomic<uint64_t>* slot=&words[(i&(capacity-1))*words_per_task];
+            for(size_t w=0; w<words_per_task; w++)
+            {
+                slot[w].store(buffer[w], std::memory_order_relaxed);
+            }
+        }
+
+        void get(int64_t i, task_T& task)
+        {
+            uint64_t buffer[words_per_task];
+            std::atomic<uint64_t>* slot=&words[(i&(capacity-1))*words_per_task];
+            for(size_t w=0; w<words_per_task; w++)
+            {
+                buffer[w]=slot[w].load(std::memory_order_relaxed);
+            }
+            std::memcpy(&task, buffer, sizeof(task_T));
+        }
+    };
+
+    class task_deque
+    {
+        std::atomic<int64_t> top; //next task to steal
+        std::atomic<int64_t> bottom; //one past the newest task
+        std::atomic<task_array*> array;
+        std::vector< std::unique_ptr<task_array> > arrays; //the current array is the last. The others may still be read by thieves, and are freed by clear
+
+        task_array* grow(task_array* old_array, int64_t t, int64_t b)
+        {
+            task_array* new_array=new task_array(old_array->capacity*2);
+            arrays.emplace_back(new_array);
+            task_T task;
+            for(int64_t i=t; i<b; i++)
+            {
+                old_array->get(i, task);
+                new_array->put(i, task);
+            }
+            array.store(new_array, std::memory_order_release);
+            return new_array;
+        }
+
+    public:
+
+        task_deque() : top(0), bottom(0)
+        {
+            arrays.emplace_back(new task_array(64));
+            array=arrays.back().get();
+        }
+
+        void clear()
+        //remove all tasks. Only call when no thread is using the deque
+        {
+            top=0;
+            bottom=0;
+            arrays.erase(arrays.begin(), arrays.end()-1);
+        }
+
+        void push(const task_T& task)
+        //add a task at the back. Only called by the owner
+        {
+            int64_t b=bottom.load(std::memory_order_relaxed);
+            int64_t t=top.load(std::memory_order_acquire);
+            task_array* a=array.load(std::memory_order_relaxed);
+            if(b-t > a->capacity-1)
+            {
+                a=grow(a, t, b);
+            }
+            a->put(b, task);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b+1, std::memory_order_relaxed);
+        }
+
+        bool take(task_T& task)
+        //take the newest task. Only called by the owner
+        {
+            int64_t b=bottom.load(std::memory_order_relaxed)-1;
+            task_array* a=array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t=top.load(std::memory_order_relaxed);
+
+            if(t>b) //empty
+            {
+                bottom.store(b+1, std::memory_order_relaxed);
+                return false;
+            }
+
+            a->get(b, task);
+            if(t<b) //more than one task, so no thief can take this one
+            {
+                return true;
+            }
+
+            //last task, race the thieves for it
+            bool won=top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b+1, std::memory_order_relaxed);
+            return won;
+        }
+
+        bool steal(task_T& task)
+        //take the oldest task. Called by other workers. Returns false if the deque is empty, or another thread took the task first
+        {
+            int64_t t=top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b=bottom.load(std::memory_order_acquire);
+            if(t>=b) return false;
+
+            task_array* a=array.load(std::memory_order_acquire);
+            a->get(t, task);
+            return top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+    };
+
+public:
+
+    class worker
+    {
+        friend class work_stealing_pool;
+
+        size_t index;
+        work_stealing_pool* pool;
+        task_deque tasks;
+        size_t next_victim;
+
+    public:
+
+        inline size_t get_index()
+        {
+            return index;
+        }
+
+        inline void push(const task_T& task)
+        //add a new task, which other workers can steal straight away. Only call from the thread running this worker
+        {
+            pool->outstanding_tasks.fetch_add(1); //before the task can be taken, so outstanding_tasks does not reach zero too soon
+            tasks.push(task);
+        }
+
+        //stats for the last batch
+        size_t num_processed;
+        size_t num_stolen;
+    };
+
+private:
+
+    std::vector< std::unique_ptr<worker> > workers;
+    std::atomic<size_t> outstanding_tasks; //tasks that are in a deque, or being processed
+    std::atomic<bool> aborted;
+    std::mutex exception_mutex;
+    std::exception_ptr worker_exception;
+
+    std::vector<std::thread> threads;
+    std::mutex control_mutex;
+    std::condition_variable control_cv; //the workers wait on this for a batch, or to stop
+    std::condition_variable done_cv; //start and run_tasks wait on this for the workers
+    size_t batch_number;
+    size_t num_busy; //workers that have not finished the batch (or worker_start)
+    bool stopping;
+    std::function<void(size_t)> worker_start_function;
+    std::function<void(worker&, task_T&)> process_function;
+
+    void record_exception()
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex);
+        if(not worker_exception)
+        {
+            worker_exception=std::current_exception();
+        }
+        aborted=true;
+    }
+
+    void finished_batch()
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        num_busy--;
+        if(num_busy==0)
+        {
+            done_cv.notify_all();
+        }
+    }
+
+    void wait_for_workers()
+    {
+        std::unique_lock<std::mutex> lock(control_mutex);
+        done_cv.wait(lock, [this](){ return num_busy==0; });
+    }
+
+    bool find_task(worker& W, task_T& task)
+    //get a task for W, stealing if needed. Returns false if all tasks are done
+    {
+        while(true)
+        {
+            if(W.tasks.take(task))
+            {
+                return true;
+            }
+
+            size_t num_workers=workers.size();
+            for(size_t i=1; i<num_workers; i++)
+            {
+                worker& victim=*workers[(W.index + W.next_victim + i)%num_workers];
+                if(victim.tasks.steal(task))
+                {
+                    W.next_victim=(W.next_victim + i)%num_workers; //try the same victim first next time
+                    W.num_stolen++;
+                    return true;
+                }
+            }
+
+            if(outstanding_tasks.load()==0 or aborted.load())
+            {
+                return false;
+            }
+            std::this_thread::yield(); //some worker is still busy, and may make new tasks
+        }
+    }
+
+    void work(worker& W)
+    {
+        try
+        {
+            task_T task;
+            while(find_task(W, task))
+            {
+                process_function(W, task);
+                W.num_processed++;
+                outstanding_tasks.fetch_sub(1);
+            }
+        }
+        catch(...)
+        {
+            record_exception();
+        }
+    }
+
+    void thread_main(size_t index)
+    {
+        try
+        {
+            worker_start_function(index);
+        }
+        catch(...)
+        {
+            record_exception();
+        }
+        finished_batch();
+
+        size_t last_batch=0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(control_mutex);
+                control_cv.wait(lock, [this, last_batch](){ return stopping or batch_number!=last_batch; });
+                if(stopping) return;
+                last_batch=batch_number;
+            }
+            work(*workers[index]);
+            finished_batch();
+        }
+    }
+
+public:
+
+    work_stealing_pool() : outstanding_tasks(0), aborted(false)
+    {
+        batch_number=0;
+        num_busy=0;
+        stopping=false;
+    }
+
+    ~work_stealing_pool()
+    {
+        stop();
+    }
+
+    work_stealing_pool(const work_stealing_pool&)=delete;
+    work_stealing_pool& operator=(const work_stealing_pool&)=delete;
+
+    inline size_t num_workers()
+    {
+        return workers.size();
+    }
+
+    worker& get_worker(size_t index)
+    {
+        return *workers[index];
+    }
+
+    void start(size_t num_threads, std::function<void(size_t)> worker_start)
+    //start num_threads worker threads, which wait for run_tasks. Returns after worker_start is done on all of them
+    {
+        if(num_threads<1)
+        {
+            throw gen_exception("work_stealing_pool needs at least one thread");
+        }
+        if(threads.size()>0)
+        {
+            throw gen_exception("work_stealing_pool is already started");
+        }
+
+        while(workers.size()<num_threads)
+        {
+            workers.emplace_back(new worker);
+        }
+        workers.resize(num_threads);
+        for(size_t i=0; i<num_threads; i++)
+        {
+            workers[i]->index=i;
+            workers[i]->pool=this;
+        }
+
+        worker_start_function=worker_start;
+        aborted=false;
+        worker_exception=nullptr;
+        stopping=false;
+        batch_number=0;
+        num_busy=num_threads;
+
+        threads.reserve(num_threads);
+        for(size_t i=0; i<num_threads; i++)
+        {
+            threads.emplace_back( [this, i](){ thread_main(i); } );
+        }
+        wait_for_workers();
+
+        if(worker_exception)
+        {
+            std::exception_ptr start_exception=worker_exception;
+            stop();
+            std::rethrow_exception(start_exception);
+        }
+    }
+
+    void run_tasks(const std::vector<task_T>& initial_tasks, std::function<void(worker&, task_T&)> process)
+    //process initial_tasks, and all tasks made by them, on the threads made by start. Returns when all tasks are done
+    {
+        if(threads.size()==0)
+        {
+            throw gen_exception("work_stealing_pool is not started");
+        }
+        size_t num_threads=workers.size();
+
+        for(size_t i=0; i<num_threads; i++)
+        {
+            worker& W=*workers[i];
+            W.tasks.clear();
+            W.next_victim=0;
+            W.num_processed=0;
+            W.num_stolen=0;
+        }
+
+        //deal the initial tasks to the workers in blocks, so neighbouring tasks stay on one worker. The workers are waiting, so this thread can push
+        size_t N=initial_tasks.size();
+        for(size_t i=0; i<num_threads; i++)
+        {
+            size_t begin=(N*i)/num_threads;
+            size_t end=(N*(i+1))/num_threads;
+            for(size_t task_i=begin; task_i<end; task_i++)
+            {
+                workers[i]->tasks.push(initial_tasks[task_i]);
+            }
+        }
+        outstanding_tasks=N;
+        aborted=false;
+        worker_exception=nullptr;
+        process_function=process;
+
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+            num_busy=num_threads;
+            batch_number++;
+        }
+        control_cv.notify_all();
+        wait_for_workers();
+
+        if(worker_exception)
+        {
+            std::rethrow_exception(worker_exception);
+        }
+    }
+
+    void stop()
+    //end the worker threads
+    {
+        if(threads.size()==0) return;
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+            stopping=true;
+        }
+        control_cv.notify_all();
+        for(std::thread& T : threads)
+        {
+            T.join();
+        }
+        threads.clear();
+    }
+
+    template<typename start_T, typename process_T>
+    void run(const std::vector<task_T>& initial_tasks, size_t num_threads, start_T worker_start, process_T process)
+    //start num_threads threads, process one batch of tasks, and stop the threads
+    {
+        start(num_threads, worker_start);
+        try
+        {
+            run_tasks(initial_tasks, process);
+        }
+        catch(...)
+        {
+            stop();
+            throw;
+        }
+        stop();
+    }
+};
+
+#endif